@@ -0,0 +1,113 @@
+#ifndef BANDPOOL_HPP_
+#define BANDPOOL_HPP_
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>		/* for handing out rounds of work */
+#include <functional>
+
+/**
+* Worker threads owning fixed bands of rows of a board.
+* Workers are pinned to CPUs grouped by NUMA node, so the bands of a node
+* are next to each other and only their halo rows are read across nodes.
+* A worker keeps its band for the life of the pool, so a band first
+* touched by run() is stepped from the same CPU afterwards and its pages
+* stay on the node of the worker.
+* With a single band everything runs on the calling thread, unpinned.
+*/
+class BandPool {
+private:
+	std::vector<std::thread>     workers;  /**< one per band, none for a single band */
+	std::vector<int>               bands;  /**< first row of every band, and the row count */
+	std::vector<int>                cpus;  /**< CPU of every worker */
+	int                        nodeCount;  /**< NUMA nodes with workers */
+	const std::function<void(int)> *work;  /**< work of the current round */
+	unsigned long                  round;  /**< number of rounds handed out */
+	int                          pending;  /**< workers still working on the round */
+	bool                         closing;  /**< workers shall exit */
+	std::mutex                     mutex;  /**< guards the round */
+	std::condition_variable      started;  /**< signals a new round or closing */
+	std::condition_variable     finished;  /**< signals the end of a round */
+
+public:
+	/**
+	* Constructor.
+	* Initialize member variables
+	*/
+	BandPool():
+			nodeCount(1),
+			work(NULL),
+			round(0),
+			pending(0),
+			closing(false)
+		{}
+
+	/**
+	* Deconstructor.
+	* Stop the workers
+	*/
+	~BandPool() { stop(); }
+
+	/**
+	* Start workers and split the rows into bands.
+	* Workers are spread over the NUMA nodes in proportion to their CPUs.
+	* @param rows rows of the board
+	* @param threads number of workers, at most one per row
+	* @return 0 on success and -1 on failure
+	*/
+	int setup(int rows, int threads);
+
+	/**
+	* Run work on every band, each in the worker owning it.
+	* Returns when all bands are done.
+	* @param band called with the first row and the end row of a band
+	*/
+	void run(const std::function<void(int, int)> &band);
+
+	/**
+	* Run work in every worker, for work not split by rows.
+	* Returns when all workers are done.
+	* @param worker called with the index of a worker
+	*/
+	void runWorkers(const std::function<void(int)> &worker);
+
+	/**
+	* Get number of bands.
+	* @return bands, one per worker
+	*/
+	int getBands() { return bands.empty() ? 0 : (int)bands.size() - 1; }
+
+	/**
+	* Get first row of a band.
+	* @param band index of band, getBands() for the row count
+	* @return row
+	*/
+	int getBandStart(int band) { return bands[band]; }
+
+	/**
+	* Get number of NUMA nodes the workers run on.
+	* @return nodes, 1 without NUMA information
+	*/
+	int getNodes() { return nodeCount; }
+
+private:
+	/**
+	* Stop and join the workers.
+	*/
+	void stop();
+
+	/**
+	* Pin a worker and run its work of every round until closing.
+	* @param worker index of worker
+	*/
+	void serve(int worker);
+
+	/**
+	* Find the CPUs this process may run on, grouped by NUMA node.
+	* @param nodeCpus receives the CPUs of every node with allowed CPUs
+	*/
+	static void findNodes(std::vector<std::vector<int> > &nodeCpus);
+};
+
+#endif
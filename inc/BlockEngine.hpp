@@ -0,0 +1,76 @@
+#ifndef BLOCKENGINE_HPP_
+#define BLOCKENGINE_HPP_
+
+#include <cstdlib>
+#include <cstring>
+
+#include "../inc/CPUEngine.hpp"
+#include "../inc/Topology.hpp"
+
+/**
+* CPU engine stepping 2x2 blocks by table lookup.
+* Every block holds 4 cells in bits 0..3 as (0,0) (1,0) (0,1) (1,1).
+* The table maps a 4x4 neighbourhood (bit 4*y+x) to the
+* next generation of its centre 2x2 block.
+*/
+class BlockEngine : public CPUEngine {
+private:
+	unsigned char            *table;  /**< 65536 entries: 4x4 neighbourhood to centre 2x2 block */
+	unsigned char           *blocks;  /**< blocks of current generation with a border of 1 block */
+	unsigned char             *next;  /**< blocks of next generation with a border of 1 block */
+	int               boardSize[2];  /**< width and height of board in cells */
+	int               blockSize[2];  /**< width and height of board in blocks without border */
+	int                 blockPitch;  /**< blocks per row including border */
+	bool                     clamp;  /**< true: dead border, false: torus */
+
+public:
+	/**
+	* Constructor.
+	* Initialize member variables
+	*/
+	BlockEngine():
+			table(NULL),
+			blocks(NULL),
+			next(NULL),
+			blockPitch(0),
+			clamp(false)
+		{
+			boardSize[0] = boardSize[1] = 0;
+			blockSize[0] = blockSize[1] = 0;
+	}
+
+	/**
+	* Deconstructor.
+	*/
+	~BlockEngine() {
+		free(table);
+		free(blocks);
+		free(next);
+	}
+
+	const char * getName() { return "block"; }
+	int setup(int width, int height, int topology);
+	int setRules(const unsigned char *rules, unsigned int neighbourhood);
+	void load(const unsigned char *image);
+	void nextGeneration();
+	void store(unsigned char *image);
+
+private:
+	/**
+	* Copy opposite edges into the border for torus mode.
+	*/
+	void wrapBorder();
+
+	/**
+	* Get block including the border.
+	* @param bx x coordinate of block, -1 for left border
+	* @param by y coordinate of block, -1 for top border
+	* @param board get block from this board
+	* @return reference to block
+	*/
+	inline unsigned char & block(const int bx, const int by, unsigned char *board) {
+		return board[(bx+1) + blockPitch*(by+1)];
+	}
+};
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef BOARDARENA_HPP_
+#define BOARDARENA_HPP_
+
+#include <cstdlib>
+
+#define ARENA_ALIGNMENT 64				/* bytes, every region starts on a cache line */
+#define ARENA_PAGE ((size_t)2 << 20)		/* bytes of a transparent huge page, the mapping is a multiple */
+
+/**
+* Arena handing out the host buffers of a game from one mapping.
+* The mapping is backed by reserved huge pages (MAP_HUGETLB) of the default
+* size in /proc/meminfo if there are enough of them, else by normal pages
+* on a huge page boundary advised for transparent huge pages (MADV_HUGEPAGE). Regions start on cache lines
+* and are only dropped all at once, the mapping is kept for the next
+* reserve() as long as it is big enough.
+*/
+class BoardArena {
+private:
+	unsigned char             *base;  /**< start of mapping */
+	size_t                 capacity;  /**< bytes of mapping */
+	size_t                     used;  /**< bytes handed out */
+	bool                  hugePages;  /**< mapping is backed by reserved huge pages */
+	size_t                 pageSize;  /**< bytes of the pages backing the mapping */
+
+public:
+	/**
+	* Constructor.
+	* Initialize member variables
+	*/
+	BoardArena():
+			base(NULL),
+			capacity(0),
+			used(0),
+			hugePages(false),
+			pageSize(0)
+		{}
+
+	/**
+	* Deconstructor.
+	* Unmap the arena
+	*/
+	~BoardArena() { release(); }
+
+	/**
+	* Drop all regions and make room for at least a number of bytes,
+	* a mapping big enough is kept.
+	* @param bytes bytes of all regions to come, aligned by align()
+	* @return 0 on success and -1 on failure
+	*/
+	int reserve(size_t bytes);
+
+	/**
+	* Hand out a region, an empty arena is mapped for it first.
+	* Contents are left from earlier regions, except in a new mapping.
+	* @param bytes size of region
+	* @return region starting on a cache line, NULL if it does not fit
+	*/
+	void * allocate(size_t bytes);
+
+	/**
+	* Drop the pages inside a region, the next write faults them in again
+	* on the NUMA node of the writing thread. Pages shared with other
+	* regions are kept.
+	* @param region start of region
+	* @param bytes size of region
+	*/
+	void discard(void *region, size_t bytes);
+
+	/**
+	* Drop all regions and keep the mapping.
+	*/
+	void clear() { used = 0; }
+
+	/**
+	* Check for reserved huge pages.
+	* @return true if the mapping is backed by MAP_HUGETLB pages
+	*/
+	bool hasHugePages() { return hugePages; }
+
+	/**
+	* Get size of a region in the arena.
+	* @param bytes requested size
+	* @return bytes rounded up to a cache line
+	*/
+	static size_t align(size_t bytes) {
+		return (bytes + ARENA_ALIGNMENT-1) & ~(size_t)(ARENA_ALIGNMENT-1);
+	}
+
+private:
+	/**
+	* Unmap the arena.
+	* @return 0 on success and -1 if the mapping could not be unmapped
+	*/
+	int release();
+
+	/**
+	* Get the default size of reserved huge pages.
+	* @return Hugepagesize of /proc/meminfo in bytes, 0 if unknown
+	*/
+	static size_t hugePageSize();
+};
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef CPUENGINE_HPP_
+#define CPUENGINE_HPP_
+
+/**
+* Interface for alternative CPU engines.
+* An engine keeps the board in its own layout, images are
+* only converted from and to RGBA at load/store.
+*/
+class CPUEngine {
+public:
+	/**
+	* Deconstructor.
+	*/
+	virtual ~CPUEngine() {}
+
+	/**
+	* Get name of engine.
+	* @return name
+	*/
+	virtual const char * getName() = 0;
+
+	/**
+	* Allocate the board.
+	* @param width width of board
+	* @param height height of board
+	* @param topology one of TOPOLOGY_*, see Topology.hpp
+	* @return 0 on success and -1 on failure or unsupported topology
+	*/
+	virtual int setup(int width, int height, int topology) = 0;
+
+	/**
+	* Update rules, called whenever the rule changes.
+	* @param rules next state colors indexed by neighbours + 9*(state >> 7)
+	* @param neighbourhood neighbourhood mask
+	* @return 0 on success and -1 for rules the engine does not support
+	*/
+	virtual int setRules(const unsigned char *rules, unsigned int neighbourhood) = 0;
+
+	/**
+	* Load the board from a RGBA image.
+	* @param image RGBA image of width*height pixels
+	*/
+	virtual void load(const unsigned char *image) = 0;
+
+	/**
+	* Calculate next generation.
+	*/
+	virtual void nextGeneration() = 0;
+
+	/**
+	* Store the board to a RGBA image.
+	* @param image RGBA image of width*height pixels
+	*/
+	virtual void store(unsigned char *image) = 0;
+};
+
+#endif
@@ -0,0 +1,138 @@
+#ifndef CENSUS_HPP_
+#define CENSUS_HPP_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>				/* for sort() */
+
+#include "../inc/Neighbourhood.hpp"	/* for neighbourhood masks */
+
+#define CENSUS_MAX_PERIOD 64		/* objects without a period up to this are unknown */
+#define CENSUS_UNKNOWN "zz_UNKNOWN"	/* name of unknown objects */
+#define CENSUS_RADIUS 2				/* cells this far apart may belong to one object */
+
+/**
+* Census of the objects in the ash of settled boards.
+* Live cells are split into 8-connected objects, every object is
+* stepped in isolation to find its period and displacement and named
+* by its canonical code: xs for still lifes, xp for oscillators and
+* xq for spaceships followed by period (population for still lifes)
+* and the extended Wechsler format of the smallest phase and orientation.
+* Objects that are not periodic alone are counted together with the
+* objects up to CENSUS_RADIUS cells away, like the two halves of a beacon.
+*/
+class Census {
+private:
+	typedef std::pair<int, int> Cell;	/* (x,y) */
+
+	unsigned int         birthRule;  /**< bit n set: birth with n neighbours */
+	unsigned int      survivalRule;  /**< bit n set: survival with n neighbours */
+	unsigned int     neighbourhood;  /**< neighbourhood mask, see Neighbourhood.hpp */
+	std::map<std::string, unsigned long>      counts;  /**< number of objects per code */
+	std::map<std::string, std::string>         codes;  /**< known objects: normalised cells to code */
+	unsigned long          objects;  /**< number of counted objects */
+
+public:
+	/**
+	* Constructor.
+	* Initialize member variables
+	*/
+	Census():
+			birthRule(0x008),
+			survivalRule(0x00C),
+			neighbourhood(NEIGHBOURHOOD_MOORE),
+			objects(0)
+		{}
+
+	/**
+	* Set the rule for stepping objects, this clears the census.
+	* @param _birthRule bit n set: birth with n neighbours
+	* @param _survivalRule bit n set: survival with n neighbours
+	* @param _neighbourhood neighbourhood mask
+	*/
+	void setRule(unsigned int _birthRule, unsigned int _survivalRule,
+				 unsigned int _neighbourhood) {
+		birthRule = _birthRule;
+		survivalRule = _survivalRule;
+		neighbourhood = _neighbourhood;
+		counts.clear();
+		codes.clear();
+		objects = 0;
+	}
+
+	/**
+	* Count all objects of a bit-packed torus.
+	* @param rows rows of the board, bit x is column x
+	* @param width width of board, at most 32
+	* @param height height of board
+	*/
+	void addTorus(const unsigned int *rows, int width, int height);
+
+	/**
+	* Print the census table sorted by number of objects.
+	* @param file output stream
+	*/
+	void print(FILE *file);
+
+	/**
+	* Get number of counted objects.
+	* @return objects
+	*/
+	unsigned long getObjects() {
+		return objects;
+	}
+
+	/**
+	* Get number of distinct objects.
+	* @return number of codes in the census
+	*/
+	unsigned long getDistinctObjects() {
+		return counts.size();
+	}
+
+private:
+	/**
+	* Get the code of an object, known objects are looked up.
+	* @param cells cells of the object
+	* @return canonical code
+	*/
+	std::string classify(std::vector<Cell> &cells);
+
+	/**
+	* Split cells into 8-connected objects.
+	* @param cells live cells
+	* @param parts receives the cells of every object
+	*/
+	static void split(const std::vector<Cell> &cells, std::vector<std::vector<Cell> > &parts);
+
+	/**
+	* Calculate the next generation of an object on an unbounded plane.
+	* @param cells sorted live cells, replaced by the next generation
+	*/
+	void step(std::vector<Cell> &cells);
+
+	/**
+	* Move an object to the origin and sort its cells.
+	* @param cells live cells, normalised in place
+	* @return offset the object was moved by
+	*/
+	static Cell normalise(std::vector<Cell> &cells);
+
+	/**
+	* Encode a normalised object in the extended Wechsler format.
+	* @param cells normalised cells
+	* @return code
+	*/
+	static std::string wechsler(const std::vector<Cell> &cells);
+
+	/**
+	* Get the key of a normalised object for looking up known objects.
+	* @param cells normalised cells
+	* @return key
+	*/
+	static std::string key(const std::vector<Cell> &cells);
+};
+
+#endif
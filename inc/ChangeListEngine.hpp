@@ -0,0 +1,120 @@
+#ifndef CHANGELISTENGINE_HPP_
+#define CHANGELISTENGINE_HPP_
+
+#include <cstdlib>
+#include <cstring>
+
+#include "../inc/CPUEngine.hpp"
+#include "../inc/Neighbourhood.hpp"
+#include "../inc/Topology.hpp"
+#include "../inc/Metrics.hpp"		/* for counting evaluated cells */
+
+#define CHANGE_GUARD 2				/* cells around the board: ghost border and a guard ring */
+
+/**
+* CPU engine evaluating only cells next to the cells that changed
+* in the previous generation, so its cost follows the activity.
+* Cells are bytes of a board with a ghost border and a guard ring,
+* lists hold indices into this board. A bitmap removes duplicates
+* from the list of evaluated cells, cells outside of the board are
+* permanently marked in it and so never evaluated.
+*/
+class ChangeListEngine : public CPUEngine {
+private:
+	unsigned char           *cells;  /**< 1 for live cells, board with ghost border and guard ring */
+	unsigned long long      *marks;  /**< bitmap of listed candidates and of cells outside of the board */
+	unsigned char           *edges;  /**< 1 for board cells copied into the ghost border */
+	int                   *changed;  /**< cells changed in the previous generation, ghost cells included */
+	int                   *flipped;  /**< cells changing in the current generation */
+	int                *candidates;  /**< cells evaluated in the current generation */
+	int                 *ringGhost;  /**< ghost cells of the border */
+	int                *ringSource;  /**< board cell of every ghost cell, -1 for dead */
+	int               changedCount;  /**< length of changed */
+	int                  ringCount;  /**< length of ringGhost and ringSource */
+	int               boardSize[2];  /**< width and height of board */
+	int                      pitch;  /**< cells per row including ghost border and guard ring */
+	unsigned int     neighbourhood;  /**< neighbourhood mask */
+	unsigned char        rules[18];  /**< 1 for a live next state, indexed by neighbours + 9*state */
+	int                 offsets[8];  /**< index offsets of the neighbours */
+	int                 reverse[9];  /**< index offsets of the cells counting a cell, the cell included */
+	int            numberOfOffsets;  /**< number of neighbours */
+	Counter             *evaluated;  /**< evaluated cells of all generations */
+
+public:
+	/**
+	* Constructor.
+	* Initialize member variables
+	*/
+	ChangeListEngine():
+			cells(NULL),
+			marks(NULL),
+			edges(NULL),
+			changed(NULL),
+			flipped(NULL),
+			candidates(NULL),
+			ringGhost(NULL),
+			ringSource(NULL),
+			changedCount(0),
+			ringCount(0),
+			pitch(0),
+			neighbourhood(NEIGHBOURHOOD_MOORE),
+			numberOfOffsets(0),
+			evaluated(getMetrics().counter("evaluated cells"))
+		{
+			boardSize[0] = boardSize[1] = 0;
+			memset(rules, 0, sizeof(rules));
+	}
+
+	/**
+	* Deconstructor.
+	*/
+	~ChangeListEngine() { freeMem(); }
+
+	const char * getName() { return "changes"; }
+	int setup(int width, int height, int topology);
+	int setRules(const unsigned char *rules, unsigned int neighbourhood);
+	void load(const unsigned char *image);
+	void nextGeneration();
+	void store(unsigned char *image);
+
+private:
+	/**
+	* Free memory.
+	*/
+	void freeMem();
+
+	/**
+	* Calculate the index offsets of the neighbourhood for the current pitch.
+	*/
+	void updateOffsets();
+
+	/**
+	* Copy changed board cells into the ghost border,
+	* ghost cells that change are appended to the changed list.
+	*/
+	void updateBorder();
+
+	/**
+	* Get index of a cell.
+	* @param x x coordinate of cell, -1 for the ghost border
+	* @param y y coordinate of cell, -1 for the ghost border
+	* @return index into cells
+	*/
+	inline int index(const int x, const int y) const {
+		return (x + CHANGE_GUARD) + pitch*(y + CHANGE_GUARD);
+	}
+
+	/**
+	* Mark a cell in the bitmap.
+	* @param i index of cell
+	* @return true if the cell was not marked before
+	*/
+	inline bool mark(const int i) {
+		unsigned long long bit = 1ULL << (i & 63);
+		if (marks[i >> 6] & bit) return false;
+		marks[i >> 6] |= bit;
+		return true;
+	}
+};
+
+#endif
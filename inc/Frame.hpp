@@ -0,0 +1,70 @@
+#ifndef FRAME_HPP_
+#define FRAME_HPP_
+
+#include <cstdlib>
+
+/**
+* Formats of frames handed from the simulation to the renderer.
+* The renderer expands them to colour in a fragment shader.
+*/
+#define FRAME_BITS 1		/* 1 bit per cell, 8 cells per byte, bit x%8 is column x */
+#define FRAME_R8 8			/* 1 byte per texel, the average color of its cells */
+
+/**
+* Part of the density pyramid shown by a frame.
+* Level k has one texel per 2^k x 2^k cells, only level 0 is bit-packed.
+* Every frame starts with its view, followed by size[0]*size[1] bytes.
+*/
+struct FrameView {
+	int format;     /**< FRAME_BITS or FRAME_R8 */
+	int level;      /**< every texel covers 2^level x 2^level cells */
+	int origin[2];  /**< first texel in x and y */
+	int size[2];    /**< number of texels (bytes) in x and y */
+};
+
+/**
+* Get the number of cells covered by a texel along one axis.
+* @param view view of frame
+* @param axis 0 for x, 1 for y
+* @return cells per texel
+*/
+inline int texelCells(const FrameView &view, int axis) {
+	return (axis == 0 && view.format == FRAME_BITS ? 8 : 1) << view.level;
+}
+
+/**
+* Get the size of a frame including its view.
+* @param view view of frame
+* @return size in bytes
+*/
+inline size_t frameSizeBytes(const FrameView &view) {
+	return sizeof(FrameView) + (size_t)view.size[0] * view.size[1];
+}
+
+/**
+* Choose the level and the texels of a frame for the visible part of the board.
+* The level is the coarsest one with at least one texel per pixel,
+* coarser levels are used until the frame fits into maxSize.
+* @param width width of board
+* @param height height of board
+* @param visible visible cells as x0, y0, x1, y1
+* @param pixels width and height of window in pixels
+* @param format format of level 0, FRAME_BITS or FRAME_R8
+* @param maxSize maximum number of texels in x and y
+* @return view
+*/
+FrameView makeFrameView(int width, int height, const float visible[4],
+						const int pixels[2], int format, const int maxSize[2]);
+
+/**
+* Pack a RGBA image into a frame.
+* @param image RGBA image of width*height pixels
+* @param width width of board
+* @param height height of board
+* @param view view of frame
+* @param frame frame of frameSizeBytes(view) bytes
+*/
+void packFrame(const unsigned char *image, int width, int height,
+			   const FrameView &view, unsigned char *frame);
+
+#endif
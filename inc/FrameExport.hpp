@@ -0,0 +1,156 @@
+#ifndef FRAMEEXPORT_HPP_
+#define FRAMEEXPORT_HPP_
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>					/* for writer thread */
+#include <mutex>
+#include <condition_variable>		/* for waiting on the queue */
+
+#include "../inc/Frame.hpp"			/* for frames and views */
+#include "../inc/Metrics.hpp"		/* for timings */
+
+/**
+* Formats of exported frames, chosen by the extension of the path
+*/
+#define EXPORT_PNG 0		/* one greyscale PNG file per frame */
+#define EXPORT_PPM 1		/* stream of binary PPM images */
+#define EXPORT_Y4M 2		/* YUV4MPEG2 stream with a mono plane */
+
+#define EXPORT_QUEUE 8		/* frames waiting for the writer thread */
+
+/**
+* Headless export of frames.
+* Frames are copied into a bounded queue and written by a background
+* thread, so the simulation only waits if the writer falls behind by
+* more than EXPORT_QUEUE frames. Every frame is one level of the
+* density pyramid, optionally cropped, with one grey byte per texel.
+*/
+class FrameExport {
+private:
+	std::string               path;  /**< file, or pattern for PNG files */
+	int                     format;  /**< EXPORT_PNG, EXPORT_PPM or EXPORT_Y4M */
+	FILE                   *stream;  /**< output of PPM and Y4M streams */
+	FrameView                 view;  /**< part of the board in every frame */
+	size_t              frameBytes;  /**< size of a frame including its view */
+
+	unsigned char *slots[EXPORT_QUEUE];          /**< frames in the queue */
+	unsigned long  slotGeneration[EXPORT_QUEUE]; /**< generation of every frame */
+	int                      first;  /**< slot of the oldest frame in the queue */
+	int                      count;  /**< number of frames in the queue */
+	bool                   closing;  /**< no more frames will be pushed */
+	bool                    failed;  /**< writing a frame failed */
+	unsigned long          written;  /**< number of written frames */
+	unsigned long            waits;  /**< pushes that waited for the writer */
+	Histogram           *writeTime;  /**< time for encoding and writing a frame */
+	std::mutex               mutex;  /**< guards the queue */
+	std::condition_variable  ready;  /**< signals queued frames and free slots */
+	std::thread             writer;  /**< writes queued frames */
+
+public:
+	/**
+	* Constructor.
+	* Initialize member variables
+	*/
+	FrameExport():
+			path(""),
+			format(EXPORT_PNG),
+			stream(NULL),
+			frameBytes(0),
+			first(0),
+			count(0),
+			closing(false),
+			failed(false),
+			written(0),
+			waits(0),
+			writeTime(getMetrics().histogram("export write"))
+		{
+			for (int i = 0; i < EXPORT_QUEUE; i++) {
+				slots[i] = NULL;
+				slotGeneration[i] = 0;
+			}
+	}
+
+	/**
+	* Deconstructor.
+	* Write remaining frames and free memory
+	*/
+	~FrameExport() { finish(); }
+
+	/**
+	* Open the output and start the writer thread.
+	* A path of "-.ppm" or "-.y4m" writes the stream to stdout.
+	* @param _path path ending in .png, .ppm or .y4m, PNG paths may contain
+	*        one printf %lu for the generation, e.g. frames/%06lu.png,
+	*        any other conversion but %% is rejected
+	* @param level level of the density pyramid, downscales by 2^level
+	* @param crop cells as x, y, width, height, a width of 0 exports the whole board
+	* @param width width of board
+	* @param height height of board
+	* @return 0 on success and -1 on failure
+	*/
+	int setup(const char *_path, int level, const int crop[4], int width, int height);
+
+	/**
+	* Get the part of the board every frame has to show.
+	* @return view
+	*/
+	const FrameView & getView() {
+		return view;
+	}
+
+	/**
+	* Queue a frame for writing, waits only if the queue is full.
+	* @param frame frame with the view of getView()
+	* @param generation generation of the frame
+	* @return 0 on success and -1 if writing failed
+	*/
+	int push(const unsigned char *frame, unsigned long generation);
+
+	/**
+	* Write all queued frames, stop the writer thread and close the output.
+	* @return 0 on success and -1 if writing failed
+	*/
+	int finish();
+
+	/**
+	* Get number of written frames.
+	* @return written
+	*/
+	unsigned long getWrittenFrames() {
+		return written;
+	}
+
+	/**
+	* Get number of frames the simulation had to wait for the writer.
+	* @return waits
+	*/
+	unsigned long getWaits() {
+		return waits;
+	}
+
+private:
+	/**
+	* Write queued frames until the queue is closed.
+	*/
+	void writeFrames();
+
+	/**
+	* Write one frame in the format of the export.
+	* @param texels grey bytes of the frame
+	* @param generation generation of the frame
+	* @return 0 on success and -1 on failure
+	*/
+	int writeFrame(const unsigned char *texels, unsigned long generation);
+
+	/**
+	* Write one frame as PNG file.
+	* @param texels grey bytes of the frame
+	* @param generation generation of the frame
+	* @return 0 on success and -1 on failure
+	*/
+	int writePNG(const unsigned char *texels, unsigned long generation);
+};
+
+#endif
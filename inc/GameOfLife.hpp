@@ -5,18 +5,26 @@
 #include <iostream>
 #include <cstring>
 #include <vector>
+#include <algorithm>					/* for min() and max() */
 #include <cassert>					/* for assert() */
 #include <ctime>					/* for time() */
-#include <cstdlib>					/* for srand() and rand() */
-#ifdef WIN32					// Windows system specific
-	#include <windows.h>			/* for QueryPerformanceCounter */
-#else							// Unix based system specific
-	#include <sys/time.h>			/* for gettimeofday() */
-#endif
+#include <cstdlib>
+#include <random>					/* for random starting population */
+#include <thread>					/* for setting up the device during setupHost() */
 #include <CL/cl.h>					/* OpenCL definitions */
 
 #include "../inc/KernelFile.hpp"	/* for reading OpenCL kernel files */
 #include "../inc/PatternFile.hpp"	/* for reading population files */
+#include "../inc/GenerationsBoard.hpp"	/* for multi-state boards */
+#include "../inc/CPUEngine.hpp"		/* for alternative CPU engines */
+#include "../inc/Neighbourhood.hpp"	/* for neighbourhood masks */
+#include "../inc/Topology.hpp"		/* for topologies and ghost borders */
+#include "../inc/Rule.hpp"			/* for rules fixed at compile time */
+#include "../inc/Frame.hpp"			/* for frames of the density pyramid */
+#include "../inc/Metrics.hpp"		/* for timings */
+#include "../inc/BandPool.hpp"		/* for workers of the pixel engine */
+#include "../inc/TileScheduler.hpp"	/* for active tiles of the pixel engine */
+#include "../inc/BoardArena.hpp"		/* for host buffers in one mapping */
 
 /**
 * Definition of live and dead state
@@ -24,6 +32,10 @@
 #define ALIVE 255
 #define DEAD 0
 
+#define STEP_BATCH 64				/* kernels enqueued by step() before waiting for the device */
+#define STAGING_BUFFERS 2			/* pinned buffers for transfers, one is mapped while the next is filled */
+#define RULES_MAX_BYTES (9*256)		/* rules of the most states, so the region fits every rule */
+
 inline unsigned int countDigits(unsigned int x) {
 	unsigned count=1;
 	unsigned int value= 10;
@@ -36,8 +48,14 @@ private:
 	bool                 spawnMode;  /**< false:random mode, true:file mode */
 	unsigned char           *rules;  /**< rules for calculating next generation */
 	size_t          rulesSizeBytes;  /**< size of rules in bytes */
+	unsigned int         birthRule;  /**< bit n set: birth with n neighbours */
+	unsigned int      survivalRule;  /**< bit n set: survival with n neighbours */
+	int                     states;  /**< number of cell states, greater 2 for Generations rules */
+	unsigned int     neighbourhood;  /**< neighbourhood mask, see Neighbourhood.hpp */
 	std::string         humanRules;  /**< rules as an int, 9 separates survival/birth */
 	float               population;  /**< density of live cells when using random starting population */
+	unsigned int              seed;  /**< seed of random starting population, 0 for current time */
+	BoardArena               arena;  /**< host images, ghost cells, pattern and rules in one mapping */
 	PatternFile        patternFile;  /**< file when using static starting population */
 	unsigned char   *startingImage;  /**< image of starting population */
 	unsigned char          *imageA;  /**< first image on the host */
@@ -45,14 +63,37 @@ private:
 	int               imageSize[2];  /**< width and height of image */
 	size_t          imageSizeBytes;  /**< size of image in bytes */
 	bool              switchImages;  /**< switch for image exchange */
+	unsigned char   *ghostCells[2];  /**< pixel engine: live cells of current and next generation with a ghost border of 1 cell */
+	int                 ghostPitch;  /**< bytes per row of ghostCells including the border */
+	int                    threads;  /**< pixel engine: number of workers */
+	BandPool                 bands;  /**< pixel engine: workers owning bands of rows, pinned by NUMA node */
+	TileScheduler        scheduler;  /**< pixel engine: active tiles handed out to the workers */
+	GenerationsBoard         board;  /**< packed board for multi-state rules */
+	int                   topology;  /**< one of TOPOLOGY_*, see Topology.hpp */
+	std::string         kernelFile;  /**< path of OpenCL kernel source */
+	CPUEngine           *cpuEngine;  /**< alternative CPU engine, NULL for pixel engine */
+	FrameView            frameView;  /**< part of the density pyramid written to frames */
 
 	unsigned long      generations;  /**< number of calculated generations */
+	bool         countingLiveCells;  /**< count live cells of every frame packed on the host */
+	long                 liveCells;  /**< number of live cells, -1 if not counted yet */
+	unsigned long liveCellsGeneration;  /**< generation liveCells was counted at */
 	int    generationsPerCopyEvent;  /**< number of executed kernels during 1 read image call */
+	int        generationsPerFrame;  /**< fixed number of generations per frame, 0 for as many as fit into 1 read */
 	bool                   CPUMode;  /**< CPU/OpenCL switch for calculating next generation */
+	bool                   cpuOnly;  /**< OpenCL is never initialised, CPUMode stays on */
 	bool                    paused;  /**< start/stop calculation of next generation */
 	bool                 singleGen;  /**< switch for single generation mode */
-	float            executionTime;  /**< execution time for calculation of 1 generation */
+	Histogram      *generationTime;  /**< time for calculating 1 generation, kernel time in OpenCL mode */
+	Histogram        *readbackTime;  /**< time for reading a frame from the device */
+	Histogram            *packTime;  /**< time for packing a frame on the host */
+	Histogram           *parseTime;  /**< time for parsing the pattern file */
+	Histogram     *deviceStartTime;  /**< time for finding the device and building the program */
+	Histogram      *deviceWaitTime;  /**< time setup() waited for the device thread after setupHost() */
+	Counter     *generationCounter;  /**< calculated generations of all games */
 	cl_bool               readSync;  /**< switch for synchronous reading of images from device */
+	std::thread       deviceThread;  /**< runs setupContext() while setupHost() runs */
+	int               deviceStatus;  /**< result of setupContext(), 0 on success */
 	
 	cl_context             context;  /**< CL context */
 	cl_device_id          *devices;  /**< CL device list */
@@ -64,12 +105,20 @@ private:
 	size_t        globalThreads[2];  /**< CL total number of work items for a kernel */
 	size_t         localThreads[2];  /**< CL number of work items per group */
 	
-	cl_mem            deviceImageA;  /**< CL image object for first image */
-	cl_mem            deviceImageB;  /**< CL image object for second image */
+	cl_kernel      ghostCopyKernel;  /**< CL kernel filling the ghost border of uploaded images */
+	cl_mem            deviceImageA;  /**< CL image object for first image with a ghost border of 1 cell, packed buffer for multi-state rules */
+	cl_mem            deviceImageB;  /**< CL image object for second image with a ghost border of 1 cell, packed buffer for multi-state rules */
 	size_t                rowPitch;  /**< CL row pitch for image objects */
-	size_t               origin[3];  /**< CL offset for image operations */
+	size_t               origin[3];  /**< CL offset of the board in image objects, behind the ghost border */
 	size_t               region[3];  /**< CL region for image operations */
 	cl_mem             deviceRules;  /**< cL memory object for rules */
+	cl_kernel        densityKernel;  /**< CL kernel for levels of the density pyramid */
+	cl_mem             deviceFrame;  /**< CL buffer for texels of a frame */
+	size_t        deviceFrameBytes;  /**< size of deviceFrame in bytes */
+	cl_mem staging[STAGING_BUFFERS];  /**< CL pinned host buffers for transfers of the board */
+	size_t            stagingBytes;  /**< size of every staging buffer in bytes */
+	int                nextStaging;  /**< staging buffer of the next transfer */
+	int              mappedStaging;  /**< staging buffer mapped by mapStaging() */
 
 public:
 	/** 
@@ -79,24 +128,69 @@ public:
 	GameOfLife():
 			spawnMode(false),
 			rules(NULL),
+			birthRule(0),
+			survivalRule(0),
+			states(2),
+			neighbourhood(NEIGHBOURHOOD_MOORE),
 			humanRules(""),
 			population(0.0f),
+			seed(0),
 			startingImage(NULL),
 			imageA(NULL),
 			imageB(NULL),
 			switchImages(true),
+			ghostPitch(0),
+			threads(1),
+			topology(TOPOLOGY_TORUS),
+			kernelFile("kernels.cl"),
+			cpuEngine(NULL),
 			generations(0),
+			countingLiveCells(false),
+			liveCells(-1),
+			liveCellsGeneration(0),
 			generationsPerCopyEvent(0),
+			generationsPerFrame(0),
 			CPUMode(false),
+			cpuOnly(false),
 			paused(true),
 			singleGen(false),
-			executionTime(0.0f),
+			generationTime(getMetrics().histogram("generation")),
+			readbackTime(getMetrics().histogram("readback")),
+			packTime(getMetrics().histogram("pack frame")),
+			parseTime(getMetrics().histogram("parse")),
+			deviceStartTime(getMetrics().histogram("device startup")),
+			deviceWaitTime(getMetrics().histogram("device wait")),
+			generationCounter(getMetrics().counter("generations")),
 			readSync(CL_TRUE),
+			deviceStatus(0),
+			context(NULL),
+			devices(NULL),
+			commandQueue(NULL),
+			program(NULL),
+			kernel(NULL),
 			kernelBuildOptions(""),
-			kernelInfo("")
+			kernelInfo(""),
+			ghostCopyKernel(NULL),
+			deviceImageA(NULL),
+			deviceImageB(NULL),
+			deviceRules(NULL),
+			densityKernel(NULL),
+			deviceFrame(NULL),
+			deviceFrameBytes(0),
+			stagingBytes(0),
+			nextStaging(0),
+			mappedStaging(0)
 		{
+			for (int i = 0; i < STAGING_BUFFERS; i++)
+				staging[i] = NULL;
+			ghostCells[0] = ghostCells[1] = NULL;
+			patternFile.setArena(&arena);
 			imageSize[0] = 0;
 			imageSize[1] = 0;
+			frameView.format = FRAME_R8;
+			frameView.level = 0;
+			frameView.origin[0] = frameView.origin[1] = 0;
+			frameView.size[0] = frameView.size[1] = 0;
 	}
 	
 	/** 
@@ -107,21 +201,79 @@ public:
 
 	/**
 	* Setup host/device memory and OpenCL.
+	* The device is set up by startDevice() while the population
+	* is parsed and spawned, and joined before the first upload.
 	* @return 0 on success and -1 on failure
 	*/
 	int setup();
+	
+	/**
+	* Start finding the device and building the program on a background
+	* thread, as early as the options are known. Called by setup() if it
+	* was not called before, does nothing in pure CPU mode.
+	* The rule of a pattern file is read from its header for the build,
+	* the pattern itself is parsed by setup().
+	*/
+	void startDevice();
 
 	/**
 	* Calculate next generation.
+	* @param frame receives the frame of the new generation for the frame view
 	* @return 0 on success and -1 on failure
 	*/
-	int nextGeneration(unsigned char* bufferImage);
+	int nextGeneration(unsigned char* frame);
+	
+	/**
+	* Calculate generations without reading them back,
+	* in OpenCL mode the kernels are enqueued in batches.
+	* Pause and single generation mode are ignored.
+	* @param n number of generations
+	* @return 0 on success and -1 on failure
+	*/
+	int step(unsigned long n);
+	
+	/**
+	* Get the states of a rectangle of cells of the current generation,
+	* in OpenCL mode only the rectangle, or its rows for multi-state rules,
+	* is read from the device.
+	* @param x x coordinate of first cell
+	* @param y y coordinate of first cell
+	* @param width width of rectangle
+	* @param height height of rectangle
+	* @param states receives width*height states row by row,
+	*        0 dead, 1 alive or firing, 2 and more refractory
+	* @return 0 on success and -1 if the rectangle is outside of the board
+	*/
+	int getRegion(int x, int y, int width, int height, unsigned char *states);
+	
+	/**
+	* Count the live cells of the current generation,
+	* they are read back only if they were not counted yet.
+	* @return number of live or firing cells
+	*/
+	long countLiveCells();
 	
 	/**
 	* Reset the board to the starting population.
+	* @param frame receives the frame of the starting population for the frame view
+	* @return 0 on success and -1 on failure
+	*/
+	int resetGame(unsigned char *frame);
+	
+	/**
+	* Write the current generation to a frame, e.g. after the frame view changed.
+	* @param frame frame of frameSizeBytes(frameView) bytes
 	* @return 0 on success and -1 on failure
 	*/
-	int resetGame(unsigned char *bufferImage);
+	int getFrame(unsigned char *frame);
+	
+	/**
+	* Set the part of the density pyramid written to frames.
+	* @param view view of the next frames
+	*/
+	void setFrameView(const FrameView &view) {
+		frameView = view;
+	}
 	
 	/**
 	* Free memory.
@@ -145,6 +297,23 @@ public:
 		return CPUMode;
 	}
 	
+	/**
+	* Calculate on the CPU only, OpenCL is never initialised.
+	* Call before setup(), CPU mode cannot be switched off.
+	*/
+	void setCPUOnly() {
+		cpuOnly = true;
+		CPUMode = true;
+	}
+	
+	/**
+	* Get pure CPU mode.
+	* @return cpuOnly
+	*/
+	bool isCPUOnly() {
+		return cpuOnly;
+	}
+	
 	/**
 	* Get single generation mode.
 	* @return singleGen
@@ -177,28 +346,74 @@ public:
 		return humanRules;
 	}
 	
+	/**
+	* Get birth rule.
+	* @return birthRule, bit n set: birth with n neighbours
+	*/
+	unsigned int getBirthRule() {
+		return birthRule;
+	}
+	
+	/**
+	* Get survival rule.
+	* @return survivalRule, bit n set: survival with n neighbours
+	*/
+	unsigned int getSurvivalRule() {
+		return survivalRule;
+	}
+	
+	/**
+	* Get neighbourhood.
+	* @return neighbourhood mask
+	*/
+	unsigned int getNeighbourhood() {
+		return neighbourhood;
+	}
+	
+	/**
+	* Check if a multi-state (Generations) rule is used.
+	* @return true if cells have more than 2 states
+	*/
+	bool isMultiState() {
+		return states > 2;
+	}
+	
+	/**
+	* Get name of CPU engine.
+	* @return name
+	*/
+	const char * getCPUEngine() {
+		return cpuEngine ? cpuEngine->getName() : "pixel";
+	}
+	
 	/**
 	* Switch to CPU/OpenCL mode
 	*/
 	void switchCPUMode() {
+		if (cpuOnly) return;
 		CPUMode = !CPUMode;
 		if (generations == 0) return;
 		
 		/* Update first OpenCL/CPU image to last calculated generation */
-		if (CPUMode) {  /* Switch from OpenCL to CPU */
-			cl_int status = clEnqueueReadImage(commandQueue,
-				switchImages ? deviceImageA : deviceImageB,
-				CL_TRUE, origin, region, rowPitch, 0,
-				switchImages ? imageA : imageB,
-				NULL, NULL, NULL);
-			assert(status == CL_SUCCESS);
+		cl_mem deviceImage = switchImages ? deviceImageA : deviceImageB;
+		unsigned char *image = switchImages ? imageA : imageB;
+		if (isMultiState()) {
+			if (CPUMode) {  /* Switch from OpenCL to CPU */
+				unsigned char *mapped = mapStaging(deviceImage, CL_TRUE, NULL, NULL);
+				memcpy(board.getCells(), mapped, board.getSizeBytes());
+				unmapStaging(mapped);
+			} else {        /* Switch from CPU to OpenCL */
+				writeStaging(board.getCells(), deviceImage);
+			}
+		} else if (CPUMode) {  /* Switch from OpenCL to CPU */
+			unsigned char *mapped = mapStaging(deviceImage, CL_TRUE, NULL, NULL);
+			memcpy(image, mapped, imageSizeBytes);
+			unmapStaging(mapped);
+			if (cpuEngine) cpuEngine->load(image);
+			else loadGhostCells(image);
 		} else {        /* Switch from CPU to OpenCL */
-			cl_int status = clEnqueueWriteImage(commandQueue,
-				switchImages ? deviceImageA : deviceImageB,
-				CL_TRUE, origin, region, rowPitch, 0,
-				switchImages ? imageA : imageB,
-				NULL, NULL, NULL);
-			assert(status == CL_SUCCESS);
+			if (cpuEngine) cpuEngine->store(image);
+			uploadImage(image);
 		}
 	}
 
@@ -216,6 +431,15 @@ public:
 		singleGen = !singleGen;
 	}
 	
+	/**
+	* Set number of generations calculated for every frame.
+	* @param _generationsPerFrame generations per frame, 0 for as many
+	*        as can be calculated while reading the first one
+	*/
+	void setGenerationsPerFrame(int _generationsPerFrame) {
+		generationsPerFrame = _generationsPerFrame;
+	}
+	
 	/**
 	* Switch synchronous reading of images on/off.
 	*/
@@ -224,11 +448,11 @@ public:
 	}
 	
 	/**
-	* Get execution time of current generation.
-	* @return executionTime
+	* Get execution time of last generation.
+	* @return time in ms
 	*/
 	float getExecutionTime() {
-		return executionTime;
+		return generationTime->getLast();
 	}
 	
 	/**
@@ -239,6 +463,31 @@ public:
 		return generations;
 	}
 	
+	/**
+	* Count the live cells of every frame packed on the host.
+	* Frames of higher levels read from the device are not counted.
+	* @param count switch for counting
+	*/
+	void setCountLiveCells(bool count) {
+		countingLiveCells = count;
+	}
+	
+	/**
+	* Get number of live cells of the last counted generation.
+	* @return liveCells, -1 if not counted yet
+	*/
+	long getLiveCells() {
+		return liveCells;
+	}
+	
+	/**
+	* Get generation the live cells were counted at.
+	* @return liveCellsGeneration
+	*/
+	unsigned long getLiveCellsGeneration() {
+		return liveCellsGeneration;
+	}
+	
 	/**
 	* Get number of executed kernels while
 	* copying calculated next generation image
@@ -284,6 +533,14 @@ public:
 		return kernelInfo;
 	}
 	
+	/**
+	* Check if the host buffers are backed by reserved huge pages.
+	* @return true for MAP_HUGETLB pages, false for normal or transparent huge pages
+	*/
+	bool hasHugePages() {
+		return arena.hasHugePages();
+	}
+	
 	/**
 	* Set the starting population for random mode.
 	* @param _population chance to create a live cell
@@ -293,6 +550,22 @@ public:
 		population = _population;
 	}
 	
+	/**
+	* Set the seed of the random starting population.
+	* @param _seed seed, 0 for current time
+	*/
+	void setSeed(unsigned int _seed) {
+		seed = _seed;
+	}
+	
+	/**
+	* Set the path of the OpenCL kernel source, used by setup().
+	* @param path path of kernels.cl
+	*/
+	void setKernelFile(const char *path) {
+		kernelFile = path;
+	}
+	
 	/**
 	* Set the filename for file mode.
 	* @param _fileName path to fileName used for starting population
@@ -314,24 +587,59 @@ public:
 	
 	/**
 	* Set the rule for calculating next generations.
-	* @param _rule rule as an array of characters
+	* @param _rule rule as Survival/Birth or Survival/Birth/States
+	*              with an optional neighbourhood suffix H or V
+	* @return 0 on success and -1 on failure
 	*/
 	int setRule(char *_rule);
 	
+	/**
+	* Set the neighbourhood for calculating next generations.
+	* @param name moore, vonneumann, hex or a 3x3 mask like 0x1EF
+	* @return 0 on success and -1 on failure
+	*/
+	int setNeighbourhood(const char *name);
+	
+	/**
+	* Set the engine for calculating next generations in CPU mode.
+	* @param name pixel, block, changes, sparse, tiles or rowtiles
+	* @return 0 on success and -1 on failure
+	*/
+	int setCPUEngine(const char *name);
+	
+	/**
+	* Set the topology of the board.
+	* All topologies share one kernel, the ghost border is filled at runtime.
+	* @param _topology one of TOPOLOGY_*, see Topology.hpp
+	*/
+	void setTopology(int _topology) {
+		topology = _topology;
+	}
+	
+	/**
+	* Set the number of workers of the pixel engine.
+	* Every worker is pinned to a CPU and owns a band of rows,
+	* which is placed on the NUMA node of the CPU.
+	* @param _threads number of workers, 1 for the calling thread only
+	*/
+	void setThreads(int _threads) {
+		threads = _threads;
+	}
+	
+	/**
+	* Get the topology of the board.
+	* @return one of TOPOLOGY_*
+	*/
+	int getTopology() {
+		return topology;
+	}
+	
 	/**
 	* Set the OpenCL kernel work-items per work-group.
-	* @param c switch for clamp mode
 	* @param x work-items per work-group for x
 	* @param y work-items per work-group for y
 	*/
-	void setKernelBuildOptions(int c, std::string x, std::string y) {
-		if (c == 1) {
-			/* Set clamp mode */
-			kernelBuildOptions.append("-D CLAMP ");
-			kernelInfo.append("clamp: on");
-		} else {
-			kernelInfo.append("clamp: off");
-		}
+	void setKernelBuildOptions(std::string x, std::string y) {
 		if (atoi(x.c_str()) > 0) {
 			/* work-items per work-group for x */
 			kernelBuildOptions.append("-D TPBX=");
@@ -346,6 +654,12 @@ public:
 	}
 
 private:
+	/**
+	* Build rules array and human readable rule
+	* from birthRule, survivalRule and states.
+	*/
+	void updateRules();
+
 	/**
 	* Host initialisations.
 	* Allocate and initialize host image
@@ -354,14 +668,33 @@ private:
 	int setupHost();
 
 	/**
-	* Device initialisations.
-	* Set up context, device list, command queue, memory buffers
-	* Allocate device images
-	* Build CL kernel program executable
+	* Device initialisations after setupContext().
+	* Allocate device images and memory buffers
+	* Create kernels and upload the starting population
 	* @return 0 on success and -1 on failure
 	*/
 	int setupDevice();
 	
+	/**
+	* Device discovery on the device thread.
+	* Set up context, device list and command queue
+	* Build CL kernel program executable
+	* Touches no host buffers, so setupHost() runs meanwhile.
+	* @param options complete kernel build options
+	* @return 0 on success and -1 on failure
+	*/
+	int setupContext(const std::string &options);
+	
+	/**
+	* Wait for the device thread started by startDevice().
+	*/
+	void joinDevice();
+	
+	/**
+	* Take over the rule of the pattern file if it specifies one.
+	*/
+	void applyPatternRule();
+	
 	/**
 	* Read initial population from file.
 	*/
@@ -386,22 +719,125 @@ private:
 	* Calculate next generation with OpenCL.
 	* @return 0 on success and -1 on failure
 	*/
-	int nextGenerationOpenCL(unsigned char* bufferImage);
+	int nextGenerationOpenCL(unsigned char* frame);
 	
 	/**
 	* Calculate next generation with CPU.
 	* @return 0 on success and -1 on failure
 	*/
-	int nextGenerationCPU(unsigned char* bufferImage);
+	int nextGenerationCPU(unsigned char* frame);
 	
 	/**
-	* Calculate the number of neighbours for a cell.
-	* @param x x coordinate of cell
-	* @param y y coordinate of cell
-	* @param image search in this image
-	* @return number of neighbours
+	* Calculate one generation on the host.
+	*/
+	void calculateGenerationCPU();
+	
+	/**
+	* Let the kernel read the generation it just wrote.
+	*/
+	void exchangeDeviceImages();
+	
+	/**
+	* Bring the current generation to imageA, reading it from the device in OpenCL mode.
+	* @return RGBA image of current generation
+	*/
+	const unsigned char * readHostImage();
+	
+	/**
+	* Pack the current generation on the host into a frame.
+	* @param frame frame of frameSizeBytes(frameView) bytes
+	* @param image RGBA image of the current generation mapped from the device,
+	*        NULL for the image on the host
+	*/
+	void packHostFrame(unsigned char *frame, const unsigned char *image = NULL);
+	
+	/**
+	* Copy a board of the device into the next staging buffer and map it.
+	* The staging buffers are pinned, so the copy runs as DMA.
+	* @param source device image or packed buffer
+	* @param blocking wait until the board can be read
+	* @param copyEvent receives event of the copy, NULL to trace it here
+	* @param mapEvent receives event of the mapping, NULL to trace it here
+	* @return RGBA image or packed cells, valid until unmapStaging()
+	*/
+	unsigned char * mapStaging(cl_mem source, cl_bool blocking,
+							   cl_event *copyEvent, cl_event *mapEvent);
+	
+	/**
+	* Hand a mapped staging buffer back to the device without waiting.
+	* @param mapped pointer returned by mapStaging()
+	*/
+	void unmapStaging(unsigned char *mapped);
+	
+	/**
+	* Write a board to the device through the next staging buffer.
+	* @param host RGBA image or packed cells
+	* @param destination device image or packed buffer
+	*/
+	void writeStaging(const unsigned char *host, cl_mem destination);
+	
+	/**
+	* Write a RGBA image to the current device image and fill its ghost border.
+	* @param image RGBA image
+	*/
+	void uploadImage(const unsigned char *image);
+	
+	/**
+	* Get an event for a command if device commands are traced.
+	* @param event event to fill
+	* @return pointer to event, NULL if commands are not traced
+	*/
+	cl_event * traceEvent(cl_event &event) {
+		event = NULL;
+		return getTrace().isEnabled() ? &event : NULL;
+	}
+	
+	/**
+	* Hand a command to the trace and release its event.
+	* @param name name of command
+	* @param event event of command, NULL if not traced
+	* @param queued host time right before enqueueing the command
+	*/
+	void traceCommand(const char *name, cl_event event, unsigned long long queued) {
+		if (event == NULL) return;
+		getTrace().addDeviceCommand(name, event, queued);
+		clReleaseEvent(event);
+	}
+	
+	/**
+	* Enqueue calculating a level of the density pyramid on the device
+	* and reading it into a frame.
+	* @param image device image of the generation
+	* @param frame frame of frameSizeBytes(frameView) bytes
+	* @param blocking wait for reading the frame
+	* @param event event of reading the frame, may be NULL
+	*/
+	void enqueueDensityFrame(cl_mem image, unsigned char *frame,
+							 cl_bool blocking, cl_event *event);
+	
+	/**
+	* Calculate next generation for each pixel with CPU.
+	* Neighbours are read from live cells with a ghost border,
+	* so the stencil has no bounds check.
+	* The neighbourhood MASK and the RULE are fixed at compile time,
+	* NEIGHBOURHOOD_CUSTOM uses the neighbourhood member
+	* and RULE_GENERIC uses the rules array.
+	*/
+	template <unsigned int MASK, unsigned int RULE>
+	void nextGenerationPixels();
+	
+	/**
+	* Load the live cells of the pixel engine from a RGBA image
+	* and fill their ghost border.
+	* @param image RGBA image
+	*/
+	void loadGhostCells(const unsigned char *image);
+	
+	/**
+	* Write the host images and ghost cells band by band from the workers,
+	* so each band is placed on the NUMA node of its worker.
 	*/
-	int getNumberOfNeighbours(const int x, const int y, const unsigned char *image);
+	void firstTouch();
 
 	/**
 	* Get the state of a cell.
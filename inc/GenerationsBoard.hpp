@@ -0,0 +1,210 @@
+#ifndef GENERATIONSBOARD_HPP_
+#define GENERATIONSBOARD_HPP_
+
+#include <cstdlib>
+#include <cstring>
+
+#include "../inc/Neighbourhood.hpp"
+#include "../inc/Topology.hpp"
+
+/**
+* Definition of the firing state for multi-state (Generations) rules.
+* State 0 is dead, states 2..states-1 are refractory and decay towards 0.
+*/
+#define FIRING 1
+
+/**
+* Get the color of a cell state used for OpenGL output.
+* @param state state of the cell
+* @param states number of states of the rule
+* @return color value, 255 for firing cells, fading for refractory cells
+*/
+inline unsigned char stateColor(unsigned int state, unsigned int states) {
+	if (state == 0) return 0;
+	if (state == FIRING) return 255;
+	return (unsigned char)(191 * (states - state) / (states - 1));
+}
+
+class GenerationsBoard {
+private:
+	unsigned char           *cells;  /**< packed states of current generation */
+	unsigned char            *next;  /**< packed states of next generation */
+	unsigned char        *starting;  /**< packed states of starting population */
+	int               boardSize[2];  /**< width and height of board */
+	int                     states;  /**< number of states of the rule */
+	int                   cellBits;  /**< bits per cell: 2, 4 or 8 */
+	size_t                rowBytes;  /**< size of one packed row in bytes */
+	size_t               sizeBytes;  /**< size of packed board in bytes */
+	int                   topology;  /**< one of TOPOLOGY_*, see Topology.hpp */
+
+public:
+	/**
+	* Constructor.
+	* Initialize member variables
+	*/
+	GenerationsBoard():
+			cells(NULL),
+			next(NULL),
+			starting(NULL),
+			states(0),
+			cellBits(0),
+			rowBytes(0),
+			sizeBytes(0),
+			topology(TOPOLOGY_TORUS)
+		{
+			boardSize[0] = 0;
+			boardSize[1] = 0;
+	}
+
+	/**
+	* Deconstructor.
+	*/
+	~GenerationsBoard() { freeMem(); }
+
+	/**
+	* Get the number of bits needed to store one cell.
+	* Cells never straddle a byte, so only 2, 4 and 8 are used.
+	* @param states number of states of the rule
+	* @return bits per cell
+	*/
+	static int bitsPerCell(int states) {
+		if (states <= 4) return 2;
+		if (states <= 16) return 4;
+		return 8;
+	}
+
+	/**
+	* Allocate packed boards.
+	* @param width width of board
+	* @param height height of board
+	* @param _states number of states of the rule
+	* @param _topology one of TOPOLOGY_*, see Topology.hpp
+	* @return 0 on success and -1 on failure
+	*/
+	int setup(int width, int height, int _states, int _topology);
+
+	/**
+	* Free memory.
+	* @return 0 on success and -1 on failure
+	*/
+	int freeMem();
+
+	/**
+	* Set the state of a cell in the starting population.
+	* @param x x coordinate of cell
+	* @param y y coordinate of cell
+	* @param state new state of cell
+	*/
+	void setStartingState(const int x, const int y, const unsigned char state) {
+		setState(x, y, state, starting);
+	}
+
+	/**
+	* Reset current generation to the starting population.
+	*/
+	void reset() {
+		memcpy(cells, starting, sizeBytes);
+	}
+
+	/**
+	* Calculate next generation.
+	* @param transition next state indexed by neighbours + 9*state
+	* @param neighbourhood neighbourhood mask
+	*/
+	void nextGeneration(const unsigned char *transition, unsigned int neighbourhood);
+
+	/**
+	* Expand current generation to a RGBA image for OpenGL output.
+	* @param image RGBA image of width*height pixels
+	*/
+	void toImage(unsigned char *image) const;
+
+	/**
+	* Get the state of a cell of the current generation.
+	* @param x x coordinate of cell
+	* @param y y coordinate of cell
+	* @return state, 0 dead, FIRING or refractory
+	*/
+	unsigned char getCellState(const int x, const int y) const {
+		return getState(x, y, cells);
+	}
+
+	/**
+	* Get packed states of current generation.
+	* @return cells
+	*/
+	unsigned char * getCells() {
+		return cells;
+	}
+
+	/**
+	* Get size of one packed row in bytes.
+	* @return rowBytes
+	*/
+	size_t getRowBytes() {
+		return rowBytes;
+	}
+
+	/**
+	* Get size of packed board in bytes.
+	* @return sizeBytes
+	*/
+	size_t getSizeBytes() {
+		return sizeBytes;
+	}
+
+	/**
+	* Get bits per cell.
+	* @return cellBits
+	*/
+	int getCellBits() {
+		return cellBits;
+	}
+
+private:
+	/**
+	* Functor for counting firing neighbours on the current generation,
+	* cells outside of the board are found by the topology.
+	*/
+	struct FiringCell {
+		const GenerationsBoard *board;
+		int operator()(int x, int y) const;
+	};
+
+	/**
+	* Calculate next generation with a neighbourhood fixed at compile time.
+	* @param transition next state indexed by neighbours + 9*state
+	* @param mask neighbourhood used for NEIGHBOURHOOD_CUSTOM
+	*/
+	template <unsigned int MASK>
+	void nextGenerationMasked(const unsigned char *transition, unsigned int mask);
+
+	/**
+	* Get the state of a cell.
+	* @param x x coordinate of cell
+	* @param y y coordinate of cell
+	* @param board get state from this board
+	* @return state
+	*/
+	inline unsigned char getState(const int x, const int y, const unsigned char *board) const {
+		const int cellsPerByte = 8 / cellBits;
+		return (board[y*rowBytes + x/cellsPerByte] >> ((x%cellsPerByte)*cellBits))
+				& ((1 << cellBits) - 1);
+	}
+
+	/**
+	* Set the state of a cell.
+	* @param x x coordinate of cell
+	* @param y y coordinate of cell
+	* @param state new state of cell
+	* @param board update state in this board
+	*/
+	inline void setState(const int x, const int y, const unsigned char state, unsigned char *board) {
+		const int cellsPerByte = 8 / cellBits;
+		const int shift = (x%cellsPerByte)*cellBits;
+		unsigned char *byte = &board[y*rowBytes + x/cellsPerByte];
+		*byte = (*byte & ~(((1 << cellBits) - 1) << shift)) | (state << shift);
+	}
+};
+
+#endif
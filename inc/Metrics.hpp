@@ -0,0 +1,232 @@
+#ifndef METRICS_HPP_
+#define METRICS_HPP_
+
+#include <cstdio>
+#include <string>
+#include <map>
+#include <mutex>
+#include <atomic>					/* for lock-free recording */
+#include <chrono>					/* for monotonic clock */
+
+#include "../inc/Trace.hpp"			/* for tracing timed scopes */
+
+#define METRICS_BUCKETS 48		/* histogram buckets, bucket b counts durations below 2^b ns */
+
+/**
+* Monotonic high-resolution clock used for all timings.
+*/
+typedef std::chrono::steady_clock MetricsClock;
+
+/**
+* Get the current time of the metrics clock.
+* @return nanoseconds since an arbitrary fixed point
+*/
+inline unsigned long long metricsNow() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			MetricsClock::now().time_since_epoch()).count();
+}
+
+/**
+* Counter of events, safe to add to from any thread.
+*/
+class Counter {
+private:
+	std::atomic<unsigned long long> value;  /**< number of events */
+
+public:
+	/**
+	* Constructor.
+	* Initialize member variables
+	*/
+	Counter(): value(0) {}
+
+	/**
+	* Count events.
+	* @param events number of events
+	*/
+	void add(unsigned long long events = 1) {
+		value.fetch_add(events, std::memory_order_relaxed);
+	}
+
+	/**
+	* Get number of events.
+	* @return value
+	*/
+	unsigned long long get() {
+		return value.load(std::memory_order_relaxed);
+	}
+};
+
+/**
+* Latency histogram with power of two buckets,
+* safe to record into from any thread.
+*/
+class Histogram {
+private:
+	std::string                     name;  /**< name in the registry */
+	std::atomic<unsigned long long> buckets[METRICS_BUCKETS];  /**< durations per bucket */
+	std::atomic<unsigned long long> count;  /**< number of durations */
+	std::atomic<unsigned long long>   sum;  /**< sum of durations in ns */
+	std::atomic<unsigned long long>   max;  /**< longest duration in ns */
+	std::atomic<unsigned long long>  last;  /**< last duration in ns */
+
+public:
+	/**
+	* Constructor.
+	* Initialize member variables
+	*/
+	Histogram(const std::string &_name): name(_name), count(0), sum(0), max(0), last(0) {
+		for (int b = 0; b < METRICS_BUCKETS; b++)
+			buckets[b].store(0);
+	}
+
+	/**
+	* Get name of histogram.
+	* @return name
+	*/
+	const char * getName() {
+		return name.c_str();
+	}
+
+	/**
+	* Record a duration.
+	* @param nanoseconds duration in ns
+	*/
+	void record(unsigned long long nanoseconds);
+
+	/**
+	* Get number of recorded durations.
+	* @return count
+	*/
+	unsigned long long getCount() {
+		return count.load(std::memory_order_relaxed);
+	}
+
+	/**
+	* Get sum of all durations.
+	* @return sum in ms
+	*/
+	double getTotal() {
+		return sum.load(std::memory_order_relaxed) * 1.0e-6;
+	}
+
+	/**
+	* Get mean duration.
+	* @return mean in ms, 0 without durations
+	*/
+	double getMean() {
+		unsigned long long n = getCount();
+		return n ? getTotal() / n : 0.0;
+	}
+
+	/**
+	* Get longest duration.
+	* @return maximum in ms
+	*/
+	double getMax() {
+		return max.load(std::memory_order_relaxed) * 1.0e-6;
+	}
+
+	/**
+	* Get last recorded duration.
+	* @return last duration in ms
+	*/
+	double getLast() {
+		return last.load(std::memory_order_relaxed) * 1.0e-6;
+	}
+
+	/**
+	* Get an upper bound of a quantile, exact to a factor of 2.
+	* @param q quantile between 0 and 1, e.g. 0.99
+	* @return upper bound of the bucket holding the quantile in ms
+	*/
+	double getQuantile(double q);
+	
+	/**
+	* Get number of durations in every bucket.
+	* @param counts array of METRICS_BUCKETS counts to fill
+	*/
+	void getBuckets(unsigned long long *counts);
+};
+
+/**
+* Get an upper bound of a quantile of bucket counts, exact to a factor of 2.
+* @param counts array of METRICS_BUCKETS counts
+* @param q quantile between 0 and 1, e.g. 0.99
+* @param max longest duration in ms, bounds the result
+* @return upper bound of the bucket holding the quantile in ms, 0 without durations
+*/
+double bucketQuantile(const unsigned long long *counts, double q, double max);
+
+/**
+* Registry of named counters and histograms.
+* Metrics are created on first use and live until the process exits,
+* so callers can keep the returned pointers.
+*/
+class Metrics {
+private:
+	std::mutex                                 mutex;  /**< guards the maps */
+	std::map<std::string, Counter *>        counters;  /**< counters by name */
+	std::map<std::string, Histogram *>    histograms;  /**< histograms by name */
+
+public:
+	/**
+	* Get a counter, it is created if it does not exist.
+	* @param name name of counter
+	* @return counter
+	*/
+	Counter * counter(const std::string &name);
+
+	/**
+	* Get a histogram, it is created if it does not exist.
+	* @param name name of histogram
+	* @return histogram
+	*/
+	Histogram * histogram(const std::string &name);
+
+	/**
+	* Print all counters and histograms.
+	* @param file output stream
+	*/
+	void print(FILE *file);
+};
+
+/**
+* Get the registry of the process.
+* @return metrics
+*/
+Metrics & getMetrics();
+
+/**
+* Records the lifetime of a scope into a histogram,
+* and into the trace if it is recorded.
+*/
+class ScopedTimer {
+private:
+	Histogram         *histogram;  /**< histogram of durations */
+	unsigned long long     start;  /**< start of scope in ns */
+
+public:
+	/**
+	* Constructor.
+	* Start timer
+	* @param _histogram histogram of durations
+	*/
+	ScopedTimer(Histogram *_histogram):
+			histogram(_histogram),
+			start(metricsNow())
+		{}
+
+	/**
+	* Deconstructor.
+	* Record duration
+	*/
+	~ScopedTimer() {
+		unsigned long long end = metricsNow();
+		histogram->record(end - start);
+		if (getTrace().isEnabled())
+			getTrace().addHostEvent(histogram->getName(), start, end);
+	}
+};
+
+#endif
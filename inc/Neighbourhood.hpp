@@ -0,0 +1,52 @@
+#ifndef NEIGHBOURHOOD_HPP_
+#define NEIGHBOURHOOD_HPP_
+
+/**
+* Neighbourhoods as masks of the 3x3 stencil.
+* Bit 3*(dy+1)+(dx+1) is set for every neighbour at offset (dx,dy),
+* the centre bit 4 is never set.
+*/
+#define NEIGHBOURHOOD_MOORE        0x1EF	/* all 8 neighbours */
+#define NEIGHBOURHOOD_VON_NEUMANN  0x0AA	/* N, W, E, S */
+#define NEIGHBOURHOOD_HEXAGONAL    0x1AB	/* all but NE and SW */
+#define NEIGHBOURHOOD_CUSTOM       0		/* mask is only known at runtime */
+
+/**
+* Count the neighbours of a cell with a fully unrolled stencil.
+* For MASK != NEIGHBOURHOOD_CUSTOM every test is a compile-time constant.
+* @param cell functor returning 1 for a counted cell at (x,y), else 0
+* @param x x coordinate of cell
+* @param y y coordinate of cell
+* @param mask neighbourhood used for NEIGHBOURHOOD_CUSTOM
+* @return number of neighbours
+*/
+template <unsigned int MASK, class Cell>
+inline int countNeighbours(const Cell &cell, const int x, const int y,
+						   const unsigned int mask = MASK) {
+	const unsigned int m = (MASK != NEIGHBOURHOOD_CUSTOM) ? MASK : mask;
+	return ((m & 0x001) ? cell(x-1, y-1) : 0)
+		 + ((m & 0x002) ? cell(x,   y-1) : 0)
+		 + ((m & 0x004) ? cell(x+1, y-1) : 0)
+		 + ((m & 0x008) ? cell(x-1, y  ) : 0)
+		 + ((m & 0x020) ? cell(x+1, y  ) : 0)
+		 + ((m & 0x040) ? cell(x-1, y+1) : 0)
+		 + ((m & 0x080) ? cell(x,   y+1) : 0)
+		 + ((m & 0x100) ? cell(x+1, y+1) : 0);
+}
+
+/**
+* Parse a neighbourhood name or mask.
+* @param name moore, vonneumann, hex or a mask like 0x1EF
+* @param mask parsed neighbourhood
+* @return 0 on success and -1 on failure
+*/
+int parseNeighbourhood(const char *name, unsigned int *mask);
+
+/**
+* Get the suffix of a neighbourhood used in rule definitions.
+* @param mask neighbourhood
+* @return "" for Moore, "V" for von Neumann, "H" for hexagonal, else NULL
+*/
+const char * neighbourhoodSuffix(unsigned int mask);
+
+#endif
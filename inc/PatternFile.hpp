@@ -4,18 +4,29 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <cctype>
 #include <vector>
+#include <string>
 #include <iostream>
 
+#include "../inc/Neighbourhood.hpp"
+#include "../inc/BoardArena.hpp"		/* for patterns next to the boards */
+
 class PatternFile {
 private:
 	FILE                       *file;  /**< FILE for population */
 	char                   *fileName;  /**< filename for file */
 	unsigned char           *pattern;  /**< parsed pattern */
+	unsigned char     *patternStates;  /**< parsed pattern as one state per cell */
 	int               patternSize[2];  /**< width and height of specified pattern */
 	size_t          patternSizeBytes;  /**< size of pattern in bytes */
+	BoardArena                *arena;  /**< arena for pattern and patternStates, NULL for malloc */
+	bool              patternInArena;  /**< pattern and patternStates are regions of arena */
 	std::vector<int>      birthRules;  /**< list of number of neighbours for cell birth */
 	std::vector<int>   survivalRules;  /**< list of number of neighbours for cell survival */
+	int                       states;  /**< number of cell states, greater 2 for Generations rules */
+	unsigned int       neighbourhood;  /**< neighbourhood mask of the rule */
+	bool                     hasRule;  /**< true if a rule is specified in the file */
 	int                            c;  /**< current character being read */
 
 public:
@@ -23,13 +34,15 @@ public:
 	* Constructor.
 	* Initialize member variables
 	*/
-    PatternFile():fileName(NULL) {}
+    PatternFile():fileName(NULL),pattern(NULL),patternStates(NULL),arena(NULL),
+		patternInArena(false),states(2),neighbourhood(NEIGHBOURHOOD_MOORE),hasRule(false) {}
 	
     /** 
 	* Deconstructor.
 	*/
     ~PatternFile() {
 		free(fileName);
+		freePattern();
 	}
 	
 	/** 
@@ -37,6 +50,12 @@ public:
 	*/
 	int parse();
 	
+	/** 
+	* Read only the header of the file, for size and rule before the pattern is parsed.
+	* @return 0 on success, -1 without a valid header and -2 if the file cannot be opened
+	*/
+	int readHeader();
+	
 	/** 
 	* Set filename.
 	* @param _fileName path to fileName
@@ -46,6 +65,15 @@ public:
 		memcpy(fileName,_fileName,sizeof(char)*strlen(_fileName)+1);
 	}
 	
+	/**
+	* Set the arena for the parsed pattern.
+	* Patterns not fitting into it are allocated by malloc.
+	* @param _arena arena outliving the pattern, NULL for malloc only
+	*/
+	void setArena(BoardArena *_arena) {
+		arena = _arena;
+	}
+	
 	/**
 	* Get parsed pattern.
 	* @return pattern
@@ -54,6 +82,14 @@ public:
 		return pattern;
 	}
 	
+	/**
+	* Get parsed pattern as one state per cell.
+	* @return patternStates
+	*/
+	unsigned char * getStates() {
+		return patternStates;
+	}
+	
 	/**
 	* Get rules for birth of a dead cell.
 	* @return birthRules
@@ -70,6 +106,30 @@ public:
 		return survivalRules;
 	}
 	
+	/**
+	* Get number of cell states of the rule.
+	* @return states
+	*/
+	int getNumberOfStates() {
+		return states;
+	}
+	
+	/**
+	* Get neighbourhood of the rule.
+	* @return neighbourhood
+	*/
+	unsigned int getNeighbourhood() {
+		return neighbourhood;
+	}
+	
+	/**
+	* Check if a rule is specified in the file.
+	* @return hasRule
+	*/
+	bool isRuleSpecified() {
+		return hasRule;
+	}
+	
 	/**
 	* Get width of pattern.
 	* @return patternSize[0]
@@ -111,12 +171,32 @@ private:
 	*/
 	bool parseHeader();
 	
+	/** 
+	* Parse a rule definition as B/S, S/B or a Generations rule
+	* with a third field for the number of states, e.g. B2/S/C3 or /2/3,
+	* and an optional neighbourhood suffix H or V, e.g. B2/S34H
+	* @param _rule rule definition
+	* @return true on success, else false
+	*/
+	bool parseRule(const std::string &_rule);
+	
 	/**
 	* Parse the pattern
 	* @return 0 on success and -1 on failure
 	*/
 	int parsePattern();
 	
+	/**
+	* Allocate cleared pattern and patternStates for patternSize.
+	* @return 0 on success and -1 on failure
+	*/
+	int allocatePattern();
+	
+	/**
+	* Free pattern and patternStates unless they are regions of the arena.
+	*/
+	void freePattern();
+	
 	/**
 	* Set the state of a cell.
 	* @param x x coordinate of cell
@@ -124,10 +204,12 @@ private:
 	* @param state new state of cell
 	*/
 	void setState(const int x, const int y, const unsigned char state) {
-		pattern[4*x + (4*patternSize[0]*y)] = state;
-		pattern[(4*x+1) + (4*patternSize[0]*y)] = state;
-		pattern[(4*x+2) + (4*patternSize[0]*y)] = state;
+		unsigned char color = (state == 1) ? 255 : 0;
+		pattern[4*x + (4*patternSize[0]*y)] = color;
+		pattern[(4*x+1) + (4*patternSize[0]*y)] = color;
+		pattern[(4*x+2) + (4*patternSize[0]*y)] = color;
 		pattern[(4*x+3) + (4*patternSize[0]*y)] = 1;
+		patternStates[x + patternSize[0]*y] = state;
 	}
 };
 
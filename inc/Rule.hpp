@@ -0,0 +1,32 @@
+#ifndef RULE_HPP_
+#define RULE_HPP_
+
+/**
+* Rules as bitmasks in the layout of the rules array:
+* bit n is set for birth with n neighbours,
+* bit 9+n is set for survival with n neighbours.
+*/
+#define RULE_MASK(birth, survival) ((birth) | ((survival) << 9))
+#define RULE_CONWAY     RULE_MASK(0x008, 0x00C)	/* B3/S23 */
+#define RULE_HIGHLIFE   RULE_MASK(0x048, 0x00C)	/* B36/S23 */
+#define RULE_DAYNIGHT   RULE_MASK(0x1C8, 0x1D8)	/* B3678/S34678 */
+#define RULE_GENERIC    0xFFFFFFFFu				/* rule is only known at runtime */
+
+/**
+* Get the next state of a 2-state cell.
+* For RULE != RULE_GENERIC this is a shift-and-test
+* the compiler folds, else the rules array is used.
+* @param numberOfNeighbours number of live neighbours
+* @param alive 1 for a live cell, else 0
+* @param rules next state colors indexed by neighbours + 9*alive
+* @return next state color
+*/
+template <unsigned int RULE>
+inline unsigned char nextState(const int numberOfNeighbours, const int alive,
+							   const unsigned char *rules) {
+	if (RULE != RULE_GENERIC)
+		return ((RULE >> (numberOfNeighbours + 9*alive)) & 1) ? 255 : 0;
+	return rules[numberOfNeighbours + 9*alive];
+}
+
+#endif
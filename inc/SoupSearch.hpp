@@ -0,0 +1,154 @@
+#ifndef SOUPSEARCH_HPP_
+#define SOUPSEARCH_HPP_
+
+#include <cstdio>
+#include <iostream>
+#include <cstring>
+#include <cassert>					/* for assert() */
+#include <cstdlib>
+#include <algorithm>				/* for max() */
+#include <CL/cl.h>					/* OpenCL definitions */
+
+#include "../inc/KernelFile.hpp"	/* for reading OpenCL kernel files */
+#include "../inc/Neighbourhood.hpp"	/* for neighbourhood masks */
+#include "../inc/Census.hpp"		/* for census of stable soups */
+#include "../inc/Metrics.hpp"		/* for monotonic clock */
+
+/**
+* Definition of soups, must match kernels.cl
+*/
+#define SOUP_SIZE 16			/* width and height of a random soup */
+#define SOUP_BOARD 32			/* width and height of the torus around a soup, at most 32 */
+#define SOUP_STEPS 32			/* generations per kernel launch */
+#define SOUP_BATCH 16384		/* maximum number of soups per kernel launch */
+
+/**
+* States of a soup slot
+*/
+#define SOUP_RUNNING 0			/* soup is calculated */
+#define SOUP_STABLE 1			/* board of soup repeated itself */
+#define SOUP_TIMEOUT 2			/* soup reached the maximum number of generations */
+#define SOUP_EMPTY 3			/* slot is not used */
+
+/**
+* Batched soup search.
+* Many small random soups are packed into one device buffer and
+* advanced with a single NDRange. Every soup starts in the centre of
+* a larger torus, so its ash settles without wrapping into the soup.
+* Stabilised soups are replaced by the next soups of a seeded generator.
+*/
+class SoupSearch {
+private:
+	unsigned int         birthRule;  /**< bit n set: birth with n neighbours */
+	unsigned int      survivalRule;  /**< bit n set: survival with n neighbours */
+	unsigned int     neighbourhood;  /**< neighbourhood mask, see Neighbourhood.hpp */
+	unsigned long             seed;  /**< seed of the soup generator */
+	unsigned long         nextSoup;  /**< number of the next soup to spawn */
+	unsigned int    maxGenerations;  /**< soups are given up after this many generations */
+	unsigned int         batchSize;  /**< number of soup slots */
+	cl_uint                 *soups;  /**< rows of all boards, bit x is column x */
+	unsigned char            *done;  /**< state of every slot */
+	cl_uint           *generations;  /**< calculated generations of every slot */
+	unsigned long       *soupIndex;  /**< number of the soup in every slot */
+
+	unsigned long        completed;  /**< number of finished soups */
+	unsigned long           stable;  /**< number of stabilised soups */
+	Census                  census;  /**< objects in the ash of stabilised soups */
+
+	cl_context             context;  /**< CL context */
+	cl_device_id          *devices;  /**< CL device list */
+	cl_command_queue  commandQueue;  /**< CL command queue */
+	cl_program             program;  /**< CL program  */
+	cl_kernel               kernel;  /**< CL kernel */
+	cl_mem             deviceSoups;  /**< CL buffer for soups */
+	cl_mem       deviceCheckpoints;  /**< CL buffer for boards compared for cycles */
+	cl_mem              deviceDone;  /**< CL buffer for states of slots */
+	cl_mem       deviceGenerations;  /**< CL buffer for generations of slots */
+
+public:
+	/**
+	* Constructor.
+	* Initialize member variables
+	*/
+	SoupSearch():
+			birthRule(0x008),
+			survivalRule(0x00C),
+			neighbourhood(NEIGHBOURHOOD_MOORE),
+			seed(0),
+			nextSoup(0),
+			maxGenerations(6000),
+			batchSize(0),
+			soups(NULL),
+			done(NULL),
+			generations(NULL),
+			soupIndex(NULL),
+			completed(0),
+			stable(0),
+			context(NULL),
+			devices(NULL),
+			commandQueue(NULL),
+			program(NULL),
+			kernel(NULL),
+			deviceSoups(NULL),
+			deviceCheckpoints(NULL),
+			deviceDone(NULL),
+			deviceGenerations(NULL)
+		{}
+
+	/**
+	* Deconstructor.
+	* Cleanup host and device memory
+	*/
+	~SoupSearch() { freeMem(); }
+
+	/**
+	* Set the rule for all soups.
+	* @param _birthRule bit n set: birth with n neighbours
+	* @param _survivalRule bit n set: survival with n neighbours
+	* @param _neighbourhood neighbourhood mask
+	*/
+	void setRule(unsigned int _birthRule, unsigned int _survivalRule,
+				 unsigned int _neighbourhood) {
+		birthRule = _birthRule;
+		survivalRule = _survivalRule;
+		neighbourhood = _neighbourhood;
+		census.setRule(birthRule, survivalRule, neighbourhood);
+	}
+
+	/**
+	* Setup host/device memory and OpenCL.
+	* @param _batchSize number of soups per kernel launch
+	* @param _seed seed of the soup generator
+	* @return 0 on success and -1 on failure
+	*/
+	int setup(unsigned int _batchSize, unsigned long _seed);
+
+	/**
+	* Search soups and report throughput every second,
+	* the census of all stabilised soups is printed at the end.
+	* @param numberOfSoups number of soups to search
+	* @return 0 on success and -1 on failure
+	*/
+	int run(unsigned long numberOfSoups);
+
+	/**
+	* Free memory.
+	* @return 0 on success and -1 on failure
+	*/
+	int freeMem();
+
+private:
+	/**
+	* Setup OpenCL context, buffers and kernel.
+	* @return 0 on success and -1 on failure
+	*/
+	int setupDevice();
+
+	/**
+	* Fill a slot with the next soup of the generator.
+	* @param slot slot to fill
+	*/
+	void spawnSoup(unsigned int slot);
+};
+
+#endif
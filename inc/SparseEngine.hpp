@@ -0,0 +1,133 @@
+#ifndef SPARSEENGINE_HPP_
+#define SPARSEENGINE_HPP_
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <functional>
+
+#include "../inc/CPUEngine.hpp"
+#include "../inc/PatternFile.hpp"		/* for loading patterns without an image */
+#include "../inc/Topology.hpp"
+#include "../inc/BandPool.hpp"			/* for the workers of the radix sort */
+
+#define SPARSE_PARALLEL_MIN 65536		/* smallest list sorted by several threads */
+
+/**
+* CPU engine keeping only the live cells, as a sorted list of
+* coordinates packed into 64 bits as y << 32 | x.
+* Every live cell contributes its coordinates to each cell counting it,
+* after a radix sort the length of a run of equal coordinates is the
+* number of live neighbours of that cell. Merging the runs with the
+* live cells gives the next generation, so memory and time follow the
+* population and not the board size.
+* Boards far too large for an image are stepped by loadPattern(),
+* step(), getRegion() and countLiveCells() without a GameOfLife.
+*/
+class SparseEngine : public CPUEngine {
+private:
+	std::vector<unsigned long long>     live;  /**< live cells, sorted */
+	std::vector<unsigned long long>     next;  /**< live cells of next generation */
+	std::vector<unsigned long long>  counted;  /**< one entry per neighbour contribution */
+	std::vector<unsigned long long>  scratch;  /**< second buffer of the radix sort */
+	int                         boardSize[2];  /**< width and height of board */
+	int                             topology;  /**< TOPOLOGY_TORUS or TOPOLOGY_PLANE */
+	unsigned char                  rules[18];  /**< 1 for a live next state, indexed by neighbours + 9*state */
+	int                        offsets[8][2];  /**< x and y offsets of the neighbours */
+	int                      numberOfOffsets;  /**< number of neighbours */
+	int                              threads;  /**< threads of the radix sort */
+	BandPool                            pool;  /**< one worker per thread, started by setup() */
+
+public:
+	/**
+	* Constructor.
+	* Initialize member variables
+	*/
+	SparseEngine():
+			topology(TOPOLOGY_TORUS),
+			numberOfOffsets(0),
+			threads(1)
+		{
+			boardSize[0] = boardSize[1] = 0;
+			memset(rules, 0, sizeof(rules));
+			memset(offsets, 0, sizeof(offsets));
+	}
+
+	const char * getName() { return "sparse"; }
+	int setup(int width, int height, int topology);
+	int setRules(const unsigned char *rules, unsigned int neighbourhood);
+	void load(const unsigned char *image);
+	void nextGeneration();
+	void store(unsigned char *image);
+
+	/**
+	* Set the rule without a GameOfLife.
+	* @param birthRule bit n set for birth with n neighbours
+	* @param survivalRule bit n set for survival with n neighbours
+	* @param neighbourhood neighbourhood mask
+	* @return 0 on success and -1 for rules with birth on 0 neighbours
+	*/
+	int setRule(unsigned int birthRule, unsigned int survivalRule, unsigned int neighbourhood);
+
+	/**
+	* Add the live cells of a parsed pattern, the rule of
+	* the file replaces the current rule if it specifies one.
+	* @param pattern parsed pattern file
+	* @param x x coordinate of the top left cell of the pattern
+	* @param y y coordinate of the top left cell of the pattern
+	* @return 0 on success and -1 if the pattern is outside of the board
+	*         or its rule is not supported
+	*/
+	int loadPattern(PatternFile &pattern, int x, int y);
+
+	/**
+	* Calculate generations.
+	* @param n number of generations
+	*/
+	void step(unsigned long n);
+
+	/**
+	* Get the states of a rectangle of cells.
+	* @param x x coordinate of first cell
+	* @param y y coordinate of first cell
+	* @param width width of rectangle
+	* @param height height of rectangle
+	* @param states receives width*height states row by row, 0 dead and 1 alive
+	* @return 0 on success and -1 if the rectangle is outside of the board
+	*/
+	int getRegion(int x, int y, int width, int height, unsigned char *states);
+
+	/**
+	* Count the live cells.
+	* @return number of live cells
+	*/
+	long countLiveCells() { return (long)live.size(); }
+
+private:
+	/**
+	* Run a function on every part of a range, one worker of pool per part.
+	* @param parts 1 to run on the calling thread, else threads
+	* @param function called with the index of the part
+	*/
+	void forParts(int parts, const std::function<void(int)> &function);
+
+	/**
+	* Sort packed coordinates, least significant byte first.
+	* Passes over bytes equal in all keys are skipped, so the
+	* number of passes follows the board size.
+	* @param keys keys to sort, sorted on return
+	*/
+	void radixSort(std::vector<unsigned long long> &keys);
+
+	/**
+	* Pack coordinates of a cell.
+	* @param x x coordinate of cell
+	* @param y y coordinate of cell
+	* @return key sorting row by row
+	*/
+	static inline unsigned long long key(const int x, const int y) {
+		return (unsigned long long)y << 32 | (unsigned int)x;
+	}
+};
+
+#endif
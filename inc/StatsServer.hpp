@@ -0,0 +1,115 @@
+#ifndef STATSSERVER_HPP_
+#define STATSSERVER_HPP_
+
+#include <string>
+#include <thread>
+#include <atomic>
+
+#include "../inc/Metrics.hpp"		/* for latency histograms */
+
+#define STATS_WINDOW 10				/* seconds per window of recent latencies */
+#define STATS_HISTOGRAMS 6			/* number of reported histograms */
+#define STATS_ENGINE_NAME 16		/* bytes for the name of the engine */
+
+/**
+* Counters of a running simulation, copied as a whole.
+*/
+struct SimulationStats {
+	unsigned long       generation;  /**< number of calculated generations */
+	double    generationsPerSecond;  /**< rate over the last second */
+	long                 liveCells;  /**< population, -1 if not counted yet */
+	unsigned long liveCellsGeneration;  /**< generation liveCells was counted at */
+	int                    size[2];  /**< width and height of board */
+	char engine[STATS_ENGINE_NAME];  /**< opencl or name of CPU engine */
+	bool                    paused;  /**< calculation is stopped */
+};
+
+#define STATS_WORDS ((sizeof(SimulationStats) + 7) / 8)	/* words of the seqlock */
+
+/**
+* Answers requests for the counters of the simulation on a Unix domain socket.
+* The simulation publishes into a seqlock, so it never waits for a request:
+* the server retries reading while a publish is in progress.
+* A request is an optional line, "prometheus" or an HTTP GET of /metrics
+* selects the Prometheus text format, anything else JSON.
+*/
+class StatsServer {
+private:
+	std::string                  path;  /**< path of socket */
+	int                      socketFd;  /**< listening socket, -1 if stopped */
+	std::thread                server;  /**< thread answering requests */
+	std::atomic<bool>         running;  /**< server accepts requests */
+	std::atomic<unsigned int> sequence;  /**< seqlock sequence, odd while publishing */
+	std::atomic<unsigned long long> words[STATS_WORDS];  /**< published SimulationStats */
+	unsigned long long       rateTime;  /**< start of rate interval in ns, publisher only */
+	unsigned long      rateGeneration;  /**< generation at start of rate interval, publisher only */
+	double                       rate;  /**< generations per second, publisher only */
+	Histogram *histograms[STATS_HISTOGRAMS];  /**< reported latencies */
+	unsigned long long windowStart[STATS_HISTOGRAMS][METRICS_BUCKETS];  /**< buckets at start of previous window, server only */
+	unsigned long long windowEnd[STATS_HISTOGRAMS][METRICS_BUCKETS];  /**< buckets at start of current window, server only */
+	unsigned long long     windowTime;  /**< start of current window in ns, server only */
+	Counter                 *requests;  /**< answered requests */
+
+public:
+	/**
+	* Constructor.
+	* Initialize member variables
+	*/
+	StatsServer();
+
+	/**
+	* Listen on a socket and start answering requests.
+	* A socket left over at the path is replaced.
+	* @param _path path of socket
+	* @return 0 on success and -1 on failure
+	*/
+	int start(const char *_path);
+
+	/**
+	* Check if requests are answered.
+	* @return running
+	*/
+	bool isRunning() {
+		return running.load(std::memory_order_relaxed);
+	}
+
+	/**
+	* Publish the counters of the simulation without locking,
+	* only one thread may publish. The rate is calculated here.
+	* @param stats counters, generationsPerSecond is ignored
+	*/
+	void publish(SimulationStats stats);
+
+	/**
+	* Stop answering requests and remove the socket.
+	*/
+	void stop();
+
+private:
+	/**
+	* Read a consistent copy of the published counters.
+	* @param stats counters to fill
+	*/
+	void read(SimulationStats &stats);
+
+	/**
+	* Accept and answer requests until stopped.
+	*/
+	void serve();
+
+	/**
+	* Read the request of a client and answer it.
+	* @param client socket of client
+	*/
+	void answer(int client);
+
+	/**
+	* Format counters and recent latencies.
+	* @param stats counters
+	* @param prometheus Prometheus text format instead of JSON
+	* @return text
+	*/
+	std::string format(const SimulationStats &stats, bool prometheus);
+};
+
+#endif
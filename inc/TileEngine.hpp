@@ -0,0 +1,120 @@
+#ifndef TILEENGINE_HPP_
+#define TILEENGINE_HPP_
+
+#include <cstdlib>
+#include <cstring>
+
+#include "../inc/CPUEngine.hpp"
+#include "../inc/Neighbourhood.hpp"
+#include "../inc/Topology.hpp"
+
+#define TILE_SIZE 8					/* cells per side of a tile, one bit per cell */
+#define TILE_SQUARE 32				/* tiles per side of a square stored in Z-order */
+
+/**
+* CPU engine stepping 8x8 tiles of one bit per cell, cell (x,y) of a tile
+* is bit 8*y+x. Tiles are stored in Z-order (Morton order) inside squares
+* of 32x32 tiles and the squares row by row, so the neighbours of a tile
+* are mostly on the same page however wide the board is. With squares of
+* one tile the tiles are stored row by row instead, for comparison.
+* The board is surrounded by a ring of ghost tiles, the ghost cells next
+* to the board are copied in after every generation by the topology.
+* Images are only converted at load and store.
+*/
+class TileEngine : public CPUEngine {
+private:
+	unsigned long long          *tiles;  /**< tiles of current generation including ghost tiles */
+	unsigned long long           *next;  /**< tiles of next generation including ghost tiles */
+	size_t                 *tileIndexX;  /**< index part of every tile column, ghost columns included */
+	size_t                 *tileIndexY;  /**< index part of every tile row, ghost rows included */
+	size_t                  *ringGhost;  /**< bit of every ghost cell next to the board */
+	size_t                 *ringSource;  /**< bit of the board cell of every ghost cell, -1 for dead */
+	size_t                   tileCount;  /**< tiles of a generation including padding of the squares */
+	int                      ringCount;  /**< length of ringGhost and ringSource */
+	int                   boardSize[2];  /**< width and height of board in cells */
+	int                    tileSize[2];  /**< width and height of board in tiles without ghost tiles */
+	int                     squares[2];  /**< squares per row and column */
+	int                     squareSize;  /**< tiles per side of a square, 1 for row by row */
+	unsigned long long    lastMasks[2];  /**< board cells of the last tile column and row */
+	unsigned char            rules[18];  /**< 1 for a live next state, indexed by neighbours + 9*state */
+	unsigned int         neighbourhood;  /**< neighbourhood mask */
+
+public:
+	/**
+	* Constructor.
+	* Initialize member variables
+	* @param zOrder true for tiles in Z-order, false for tiles row by row
+	*/
+	TileEngine(bool zOrder = true):
+			tiles(NULL),
+			next(NULL),
+			tileIndexX(NULL),
+			tileIndexY(NULL),
+			ringGhost(NULL),
+			ringSource(NULL),
+			tileCount(0),
+			ringCount(0),
+			squareSize(zOrder ? TILE_SQUARE : 1),
+			neighbourhood(0)
+		{
+			boardSize[0] = boardSize[1] = 0;
+			tileSize[0] = tileSize[1] = 0;
+			squares[0] = squares[1] = 0;
+			lastMasks[0] = lastMasks[1] = 0;
+			memset(rules, 0, sizeof(rules));
+	}
+
+	/**
+	* Deconstructor.
+	*/
+	~TileEngine() { freeMem(); }
+
+	const char * getName() { return squareSize > 1 ? "tiles" : "rowtiles"; }
+	int setup(int width, int height, int topology);
+	int setRules(const unsigned char *rules, unsigned int neighbourhood);
+	void load(const unsigned char *image);
+	void nextGeneration();
+	void store(unsigned char *image);
+
+private:
+	/**
+	* Free memory.
+	*/
+	void freeMem();
+
+	/**
+	* Calculate next generation with a neighbourhood fixed at compile time.
+	*/
+	template <unsigned int MASK>
+	void nextGenerationMasked();
+
+	/**
+	* Copy the board cells next to the edges into the ghost cells.
+	*/
+	void fillRing();
+
+	/**
+	* Get index of a tile.
+	* @param tx x coordinate of tile, -1 for the ghost column
+	* @param ty y coordinate of tile, -1 for the ghost row
+	* @return index into tiles
+	*/
+	inline size_t index(const int tx, const int ty) const {
+		return tileIndexX[tx + 1] + tileIndexY[ty + 1];
+	}
+
+	/**
+	* Get bit of a cell.
+	* @param x x coordinate of cell, -1 for the ghost border
+	* @param y y coordinate of cell, -1 for the ghost border
+	* @return bit number, counted over all tiles
+	*/
+	inline size_t bit(const int x, const int y) const {
+		/* Floor division, ghost cells left of and above the board are in ghost tiles */
+		const int tx = (x + TILE_SIZE) / TILE_SIZE - 1;
+		const int ty = (y + TILE_SIZE) / TILE_SIZE - 1;
+		return 64*index(tx, ty) + TILE_SIZE*(y - TILE_SIZE*ty) + (x - TILE_SIZE*tx);
+	}
+};
+
+#endif
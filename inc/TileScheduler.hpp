@@ -0,0 +1,126 @@
+#ifndef TILESCHEDULER_HPP_
+#define TILESCHEDULER_HPP_
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <random>					/* for picking victims */
+#include <functional>
+
+#include "../inc/BandPool.hpp"
+#include "../inc/Metrics.hpp"		/* for utilisation of the workers */
+
+#define SCHEDULER_TILE 64			/* cells per side of a scheduled tile */
+
+/**
+* Work-stealing scheduler handing out the active tiles of a board
+* to the workers of a BandPool, one generation per run().
+* A tile is active if it or one of its 8 neighbour tiles changed in the
+* last generation. If the ghost border joins the edges, every edge tile is
+* active as soon as one of them changed. Inactive tiles are skipped: their
+* cells in the buffer of the next generation are already those of the
+* current generation, which needs two full generations after every load.
+* Every worker starts on a deque of the active tiles of its own band, takes
+* tiles from its bottom, and when it is empty steals from the top of the
+* deques of random victims until all deques are empty.
+* Per worker the time spent on tiles and the time waiting for the others
+* are recorded as "worker N busy" and "worker N idle" histograms, so
+* busy / (busy + idle) is its utilisation over the run.
+*/
+class TileScheduler {
+private:
+	/**
+	* Active tiles of a worker, taken by the owner from the back
+	* and by thieves from the front.
+	*/
+	struct WorkerDeque {
+		std::mutex             mutex;  /**< guards tiles */
+		std::deque<int>        tiles;  /**< indices of tiles still to step */
+		std::minstd_rand      random;  /**< picks the victims of the owner */
+	};
+
+	WorkerDeque                              *deques;  /**< one per worker */
+	int                                      workers;  /**< number of workers */
+	int                                 tileCount[2];  /**< tiles per row and column */
+	int                                 boardSize[2];  /**< width and height of board */
+	bool                                    wrapping;  /**< edge tiles are neighbours through the ghost border */
+	int                              fullGenerations;  /**< generations still stepping every tile */
+	std::vector<unsigned char>               changed;  /**< tile changed in the last generation */
+	std::vector<int>                            home;  /**< worker owning every row of tiles */
+	std::vector<unsigned long long>             busy;  /**< ns every worker spent on tiles in the last run */
+	std::vector<Histogram *>                busyTime;  /**< time on tiles per worker and generation */
+	std::vector<Histogram *>                idleTime;  /**< time waiting for other workers per worker and generation */
+	std::vector<Counter *>               tileCounter;  /**< tiles stepped per worker */
+	std::vector<Counter *>              stealCounter;  /**< tiles stolen per worker */
+	Counter                            *skippedTiles;  /**< inactive tiles not stepped */
+
+public:
+	/**
+	* Constructor.
+	* Initialize member variables
+	*/
+	TileScheduler():
+			deques(NULL),
+			workers(0),
+			wrapping(false),
+			fullGenerations(0),
+			skippedTiles(getMetrics().counter("skipped tiles"))
+		{
+			tileCount[0] = tileCount[1] = 0;
+			boardSize[0] = boardSize[1] = 0;
+	}
+
+	/**
+	* Deconstructor.
+	*/
+	~TileScheduler() { delete[] deques; }
+
+	/**
+	* Split a board into tiles for the workers of a pool,
+	* every row of tiles belongs to the band of its first row.
+	* @param width width of board
+	* @param height height of board
+	* @param wrapping true if the topology joins the edges
+	* @param pool workers with their bands, set up for height rows
+	* @return 0 on success and -1 on failure
+	*/
+	int setup(int width, int height, bool wrapping, BandPool &pool);
+
+	/**
+	* Step every tile in the next two generations,
+	* after the cells were loaded from an image.
+	*/
+	void invalidate() { fullGenerations = 2; }
+
+	/**
+	* Step the active tiles of one generation.
+	* Returns when all of them are done.
+	* @param pool workers set up by setup()
+	* @param tile called with the first and end column and row of a tile,
+	*        returns true if a cell of the tile changed
+	*/
+	void run(BandPool &pool, const std::function<bool(int, int, int, int)> &tile);
+
+private:
+	/**
+	* Fill the deques with the tiles active in this generation.
+	*/
+	void distribute();
+
+	/**
+	* Step tiles of the own deque, then stolen ones, until all deques are empty.
+	* @param worker index of worker
+	* @param tile called for every tile as in run()
+	*/
+	void serve(int worker, const std::function<bool(int, int, int, int)> &tile);
+
+	/**
+	* Take a tile from the top of another deque.
+	* @param worker index of the thief
+	* @param index receives the index of the stolen tile
+	* @return true if a tile was stolen, false if all other deques are empty
+	*/
+	bool steal(int worker, int &index);
+};
+
+#endif
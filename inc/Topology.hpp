@@ -0,0 +1,65 @@
+#ifndef TOPOLOGY_HPP_
+#define TOPOLOGY_HPP_
+
+/**
+* Topologies of the board, defined by the cells read across its edges.
+* Boards with a ghost border get these cells copied in by a border-fill
+* pass, so the stencil itself never checks bounds.
+*/
+#define TOPOLOGY_TORUS    0		/* opposite edges are joined */
+#define TOPOLOGY_PLANE    1		/* cells outside of the board are dead (clamp mode) */
+#define TOPOLOGY_KLEIN    2		/* torus, but top and bottom edge are joined mirrored */
+#define TOPOLOGY_CROSS    3		/* cross-surface, both pairs of edges are joined mirrored */
+
+/**
+* Find the board cell a cell outside of the board stands for.
+* Edges are crossed along x first, so a corner of the cross-surface
+* stands for the nearest board corner.
+* @param topology one of TOPOLOGY_*
+* @param width width of board
+* @param height height of board
+* @param x x coordinate, at most one board width outside
+* @param y y coordinate, at most one board height outside
+* @return true if (x,y) now is a board cell, false if the cell is dead
+*/
+inline bool ghostSource(const int topology, const int width, const int height,
+						int &x, int &y) {
+	if (x < 0 || x >= width) {
+		if (topology == TOPOLOGY_PLANE) return false;
+		x = (x + width) % width;
+		if (topology == TOPOLOGY_CROSS) y = height-1 - y;
+	}
+	if (y < 0 || y >= height) {
+		if (topology == TOPOLOGY_PLANE) return false;
+		y = (y + height) % height;
+		if (topology != TOPOLOGY_TORUS) x = width-1 - x;
+	}
+	return true;
+}
+
+/**
+* Fill the ghost border of 1 cell around a board of one byte per cell.
+* @param cells board cell (0,0), the border starts at cells[-pitch-1]
+* @param pitch bytes per row including the border
+* @param width width of board
+* @param height height of board
+* @param topology one of TOPOLOGY_*
+*/
+void fillGhostBorder(unsigned char *cells, int pitch, int width, int height, int topology);
+
+/**
+* Parse a topology name.
+* @param name torus, plane, klein or cross
+* @param topology parsed topology
+* @return 0 on success and -1 on failure
+*/
+int parseTopology(const char *name, int *topology);
+
+/**
+* Get the name of a topology.
+* @param topology one of TOPOLOGY_*
+* @return name as accepted by parseTopology()
+*/
+const char * topologyName(int topology);
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef TRACE_HPP_
+#define TRACE_HPP_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <CL/cl.h>					/* for events of device commands */
+
+#define TRACE_MAX_EVENTS 2000000	/* later events are dropped */
+#define TRACE_DEVICE_TID 1000		/* track of commands executing on the device */
+#define TRACE_QUEUE_TID 1001		/* track of commands waiting in the queue */
+
+/**
+* One slice of the trace, times in ns of the metrics clock.
+*/
+struct TraceEvent {
+	const char *name;   /**< name of phase or command, must outlive the trace */
+	int tid;            /**< track of the slice */
+	unsigned long long start;   /**< start of slice */
+	unsigned long long end;     /**< end of slice */
+	unsigned long long submit;  /**< submission of device commands, 0 for host phases */
+};
+
+/**
+* Timeline of host phases and device commands in the trace-event
+* JSON format of chrome://tracing and Perfetto.
+* Device timestamps are moved to the host clock by the host time at
+* which every command was enqueued. Events of device commands are
+* kept until they completed, so tracing never waits for the device.
+*/
+class Trace {
+private:
+	std::string                path;  /**< output file */
+	std::atomic<bool>       enabled;  /**< events are recorded */
+	std::mutex                mutex;  /**< guards everything below */
+	std::vector<TraceEvent>  events;  /**< recorded slices */
+	std::vector<cl_event>   pending;  /**< device commands that did not complete yet */
+	std::vector<const char *> pendingNames;    /**< names of pending commands */
+	std::vector<unsigned long long> pendingQueued;  /**< host enqueue times of pending commands */
+	std::vector<std::string> threadNames;  /**< name of every host track */
+	unsigned long           dropped;  /**< events over TRACE_MAX_EVENTS */
+	unsigned long long       origin;  /**< time of opening the trace */
+
+public:
+	/**
+	* Constructor.
+	* Initialize member variables
+	*/
+	Trace():
+			path(""),
+			enabled(false),
+			dropped(0),
+			origin(0)
+		{}
+
+	/**
+	* Start recording.
+	* @param _path file the trace is written to by close()
+	* @return 0 on success and -1 on failure
+	*/
+	int open(const char *_path);
+
+	/**
+	* Check if events are recorded.
+	* @return enabled
+	*/
+	bool isEnabled() {
+		return enabled.load(std::memory_order_relaxed);
+	}
+
+	/**
+	* Name the track of the calling thread.
+	* @param name name of thread
+	*/
+	void setThreadName(const char *name);
+
+	/**
+	* Record a phase of the calling thread.
+	* @param name name of phase
+	* @param start start in ns of the metrics clock
+	* @param end end in ns of the metrics clock
+	*/
+	void addHostEvent(const char *name, unsigned long long start, unsigned long long end);
+
+	/**
+	* Record a device command of a profiling command queue,
+	* the event is retained until the command completed.
+	* @param name name of command
+	* @param event event of command
+	* @param queued host time right before enqueueing the command
+	*/
+	void addDeviceCommand(const char *name, cl_event event, unsigned long long queued);
+
+	/**
+	* Stop recording and write the trace.
+	* @return 0 on success and -1 on failure
+	*/
+	int close();
+
+private:
+	/**
+	* Get the track of the calling thread.
+	* @return tid
+	*/
+	int getThreadTrack();
+
+	/**
+	* Move completed device commands to the events.
+	* @param wait wait for all pending commands
+	*/
+	void resolveCommands(bool wait);
+
+	/**
+	* Append an event if there is space left.
+	* @param event event
+	*/
+	void append(const TraceEvent &event);
+};
+
+/**
+* Get the trace of the process.
+* @return trace
+*/
+Trace & getTrace();
+
+#endif
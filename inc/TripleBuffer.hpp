@@ -0,0 +1,112 @@
+#ifndef TRIPLEBUFFER_HPP_
+#define TRIPLEBUFFER_HPP_
+
+#include <cstdlib>
+#include <cstring>
+#include <atomic>					/* for lock-free exchange of buffers */
+
+/**
+* Lock-free triple buffer for passing frames from one writer to one reader.
+* The writer fills the back buffer and publishes it as the middle buffer,
+* the reader takes the middle buffer as front buffer if it is newer.
+* Neither side ever waits for the other.
+*/
+class TripleBuffer {
+private:
+	/**
+	* Flag in middle marking a published frame the reader has not taken yet
+	*/
+	static const int FRESH = 4;
+
+	unsigned char      *buffers[3];  /**< frames */
+	size_t               sizeBytes;  /**< size of one frame in bytes */
+	int                       back;  /**< index of buffer owned by the writer */
+	int                      front;  /**< index of buffer owned by the reader */
+	std::atomic<int>        middle;  /**< index of buffer in between, with FRESH flag */
+
+public:
+	/**
+	* Constructor.
+	* Initialize member variables
+	*/
+	TripleBuffer():
+			sizeBytes(0),
+			back(0),
+			front(1),
+			middle(2)
+		{
+			buffers[0] = buffers[1] = buffers[2] = NULL;
+	}
+
+	/**
+	* Deconstructor.
+	*/
+	~TripleBuffer() { freeMem(); }
+
+	/**
+	* Allocate all three buffers and fill them with the first frame.
+	* @param _sizeBytes size of one frame in bytes
+	* @param frame first frame
+	* @return 0 on success and -1 on failure
+	*/
+	int setup(size_t _sizeBytes, const unsigned char *frame) {
+		freeMem();
+		sizeBytes = _sizeBytes;
+		for (int i = 0; i < 3; i++) {
+			buffers[i] = (unsigned char *)malloc(sizeBytes);
+			if (buffers[i] == NULL)
+				return -1;
+			memcpy(buffers[i], frame, sizeBytes);
+		}
+		back = 0;
+		front = 1;
+		middle.store(2);
+		return 0;
+	}
+
+	/**
+	* Free memory.
+	*/
+	void freeMem() {
+		for (int i = 0; i < 3; i++) {
+			free(buffers[i]);
+			buffers[i] = NULL;
+		}
+	}
+
+	/**
+	* Get buffer for the next frame, only used by the writer.
+	* @return back buffer
+	*/
+	unsigned char * getBackBuffer() {
+		return buffers[back];
+	}
+
+	/**
+	* Publish the back buffer as the newest frame, only used by the writer.
+	*/
+	void publish() {
+		back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & 3;
+	}
+
+	/**
+	* Take the newest frame if there is one, only used by the reader.
+	* @return true if the front buffer changed
+	*/
+	bool update() {
+		if (!(middle.load(std::memory_order_acquire) & FRESH))
+			return false;
+		front = middle.exchange(front, std::memory_order_acq_rel) & 3;
+		return true;
+	}
+
+	/**
+	* Get the newest frame taken by update, only used by the reader.
+	* @return front buffer
+	*/
+	const unsigned char * getFrontBuffer() {
+		return buffers[front];
+	}
+};
+
+#endif
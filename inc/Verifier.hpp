@@ -0,0 +1,124 @@
+#ifndef VERIFIER_HPP_
+#define VERIFIER_HPP_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "../inc/GameOfLife.hpp"
+
+#define VERIFY_MARGIN 32			/* free cells around a pattern on boards of default size */
+#define VERIFY_MIN_SIZE 64			/* smallest board of default size */
+
+/**
+* Differential verification of engines.
+* Two games with different engines run in lockstep on every pattern,
+* once on every topology. A 64 bit digest of
+* every generation is compared, and the first divergent generation
+* and cell are reported.
+*/
+class Verifier {
+private:
+	std::string      engines[2];  /**< engine of GameOfLife::setCPUEngine() or opencl */
+	std::string            rule;  /**< rule for patterns without rule, empty for 23/3 */
+	unsigned long   generations;  /**< generations per pattern and topology */
+	int                topology;  /**< only verified topology, -1 for all */
+	int                 size[2];  /**< board size, 0 for the size of the pattern plus a margin */
+	unsigned long          runs;  /**< verified patterns and topologies */
+	unsigned long      diverged;  /**< runs with different generations */
+	unsigned long       skipped;  /**< runs not supported by an engine */
+
+public:
+	/**
+	* Constructor.
+	* Initialize member variables
+	*/
+	Verifier():
+			rule(""),
+			generations(1000),
+			topology(-1),
+			runs(0),
+			diverged(0),
+			skipped(0)
+		{
+			size[0] = size[1] = 0;
+	}
+
+	/**
+	* Set the compared engines.
+	* @param list two of opencl and the CPU engines separated by a comma
+	* @return 0 on success and -1 for unknown engines
+	*/
+	int setEngines(const char *list);
+
+	/**
+	* Set the rule for patterns without a rule.
+	* @param _rule rule as for GameOfLife::setRule()
+	*/
+	void setRule(const char *_rule) {
+		rule = _rule;
+	}
+
+	/**
+	* Set the number of generations per pattern and topology.
+	* @param _generations generations
+	*/
+	void setGenerations(unsigned long _generations) {
+		generations = _generations;
+	}
+
+	/**
+	* Verify only one topology instead of all.
+	* @param _topology one of TOPOLOGY_*, see Topology.hpp
+	*/
+	void setTopology(int _topology) {
+		topology = _topology;
+	}
+
+	/**
+	* Set a fixed board size for all patterns.
+	* @param width width of board
+	* @param height height of board
+	*/
+	void setSize(int width, int height) {
+		size[0] = width;
+		size[1] = height;
+	}
+
+	/**
+	* Verify all patterns of a file or directory and print a report.
+	* @param path RLE file or directory searched recursively for *.rle
+	* @return 0 if all runs agree, -1 on divergence or failure
+	*/
+	int run(const char *path);
+
+private:
+	/**
+	* Collect pattern files.
+	* @param path RLE file or directory
+	* @param files list of files, appended in sorted order
+	*/
+	void findPatterns(const std::string &path, std::vector<std::string> &files);
+
+	/**
+	* Run both engines on one pattern on one topology.
+	* @param file RLE file
+	* @param _topology one of TOPOLOGY_*
+	* @return 0 if they agree, 1 if they diverged, -1 if they could not be set up
+	*/
+	int verifyPattern(const std::string &file, int _topology);
+
+	/**
+	* Set up a game for one engine.
+	* @param game game to set up
+	* @param engine opencl or a CPU engine
+	* @param file RLE file
+	* @param _topology one of TOPOLOGY_*
+	* @param boardSize width and height of board
+	* @return 0 on success and -1 on failure
+	*/
+	int setupGame(GameOfLife &game, const std::string &engine, const std::string &file,
+				  int _topology, const int boardSize[2]);
+};
+
+#endif
@@ -0,0 +1,175 @@
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#ifdef __linux__
+#include <dirent.h>					/* for reading NUMA nodes */
+#include <pthread.h>
+#include <sched.h>					/* for CPU affinity */
+#endif
+
+#include "../inc/BandPool.hpp"
+using namespace std;
+
+#ifdef __linux__
+/**
+* Parse a CPU list of sysfs like 0-3,8-11.
+* @param text CPU list
+* @param allowed CPUs this process may run on
+* @return allowed CPUs of the list
+*/
+static vector<int> parseCpuList(const char *text, const cpu_set_t &allowed) {
+	vector<int> cpus;
+	while (*text != '\0' && *text != '\n') {
+		char *end;
+		int first = (int)strtol(text, &end, 10);
+		if (end == text) break;
+		int last = first;
+		if (*end == '-') {
+			text = end + 1;
+			last = (int)strtol(text, &end, 10);
+		}
+		for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+			if (CPU_ISSET(cpu, &allowed)) cpus.push_back(cpu);
+		text = (*end == ',') ? end + 1 : end;
+	}
+	return cpus;
+}
+#endif
+
+void BandPool::findNodes(vector<vector<int> > &nodeCpus) {
+	nodeCpus.clear();
+#ifdef __linux__
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return;
+
+	/* Nodes in order of their number, without NUMA support there is no directory */
+	vector<int> ids;
+	DIR *directory = opendir("/sys/devices/system/node");
+	if (directory != NULL) {
+		struct dirent *entry;
+		while ((entry = readdir(directory)) != NULL) {
+			int id;
+			char rest;
+			if (sscanf(entry->d_name, "node%d%c", &id, &rest) == 1) ids.push_back(id);
+		}
+		closedir(directory);
+	}
+	sort(ids.begin(), ids.end());
+
+	for (unsigned int i = 0; i < ids.size(); i++) {
+		char path[64], line[4096];
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", ids[i]);
+		FILE *file = fopen(path, "r");
+		if (file == NULL) continue;
+		if (fgets(line, sizeof(line), file) != NULL) {
+			vector<int> cpus = parseCpuList(line, allowed);
+			if (!cpus.empty()) nodeCpus.push_back(cpus);
+		}
+		fclose(file);
+	}
+
+	/* One node of all allowed CPUs */
+	if (nodeCpus.empty()) {
+		vector<int> cpus;
+		for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+			if (CPU_ISSET(cpu, &allowed)) cpus.push_back(cpu);
+		if (!cpus.empty()) nodeCpus.push_back(cpus);
+	}
+#endif
+}
+
+int BandPool::setup(int rows, int threads) {
+	stop();
+	if (rows <= 0) return -1;
+	threads = max(1, min(threads, rows));
+
+	/* Workers of a node are consecutive, nodes get workers in proportion to their CPUs */
+	vector<vector<int> > nodeCpus;
+	findNodes(nodeCpus);
+	cpus.clear();
+	nodeCount = 1;
+	if (nodeCpus.empty()) {
+		cpus.assign(threads, -1);
+	} else {
+		size_t total = 0, before = 0;
+		for (unsigned int n = 0; n < nodeCpus.size(); n++)
+			total += nodeCpus[n].size();
+		nodeCount = 0;
+		for (unsigned int n = 0; n < nodeCpus.size(); n++) {
+			size_t share = threads*(before + nodeCpus[n].size())/total - threads*before/total;
+			before += nodeCpus[n].size();
+			for (size_t k = 0; k < share; k++)
+				cpus.push_back(nodeCpus[n][k % nodeCpus[n].size()]);
+			if (share > 0) nodeCount++;
+		}
+	}
+
+	bands.resize(threads + 1);
+	for (int i = 0; i <= threads; i++)
+		bands[i] = (int)((long long)rows*i/threads);
+
+	/* New workers start at round 0, a round of earlier workers must not look new to them */
+	work = NULL;
+	round = 0;
+	pending = 0;
+	if (threads > 1)
+		for (int i = 0; i < threads; i++)
+			workers.push_back(thread(&BandPool::serve, this, i));
+	return 0;
+}
+
+void BandPool::stop() {
+	{
+		lock_guard<std::mutex> lock(mutex);
+		closing = true;
+	}
+	started.notify_all();
+	for (unsigned int i = 0; i < workers.size(); i++)
+		workers[i].join();
+	workers.clear();
+	closing = false;
+}
+
+void BandPool::run(const function<void(int, int)> &band) {
+	runWorkers([&](int worker) { band(bands[worker], bands[worker + 1]); });
+}
+
+void BandPool::runWorkers(const function<void(int)> &worker) {
+	if (workers.empty()) {
+		if (bands.size() > 1) worker(0);
+		return;
+	}
+
+	unique_lock<std::mutex> lock(mutex);
+	work = &worker;
+	pending = (int)workers.size();
+	round++;
+	started.notify_all();
+	finished.wait(lock, [this] { return pending == 0; });
+}
+
+void BandPool::serve(int worker) {
+#ifdef __linux__
+	/* Failing to pin only loses the locality */
+	if (cpus[worker] >= 0) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpus[worker], &set);
+		pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	}
+#endif
+
+	unsigned long seen = 0;
+	unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		started.wait(lock, [this, seen] { return closing || round != seen; });
+		if (closing) return;
+		seen = round;
+		const function<void(int)> *current = work;
+		lock.unlock();
+		(*current)(worker);
+		lock.lock();
+		if (--pending == 0) finished.notify_one();
+	}
+}
@@ -0,0 +1,137 @@
+#include "../inc/BlockEngine.hpp"
+
+int BlockEngine::setup(int width, int height, int topology) {
+	boardSize[0] = width;
+	boardSize[1] = height;
+	blockSize[0] = (width + 1) / 2;
+	blockSize[1] = (height + 1) / 2;
+	blockPitch = blockSize[0] + 2;
+	clamp = (topology == TOPOLOGY_PLANE);
+
+	/* Mirrored edges would have to mirror the cells inside of blocks */
+	if (topology == TOPOLOGY_KLEIN || topology == TOPOLOGY_CROSS)
+		return -1;
+
+	/* A torus of blocks is only a torus of cells for even sizes */
+	if (!clamp && (width % 2 != 0 || height % 2 != 0))
+		return -1;
+
+	size_t blocksSizeBytes = blockPitch*(blockSize[1]+2)*sizeof(char);
+	free(blocks);
+	free(next);
+	blocks = (unsigned char *)calloc(blocksSizeBytes, 1);
+	next = (unsigned char *)calloc(blocksSizeBytes, 1);
+	if (blocks == NULL || next == NULL)
+		return -1;
+
+	if (table == NULL)
+		table = (unsigned char *)malloc(65536*sizeof(char));
+	if (table == NULL)
+		return -1;
+
+	return 0;
+}
+
+int BlockEngine::setRules(const unsigned char *rules, unsigned int neighbourhood) {
+	if (table == NULL) return 0;
+
+	/* Centre cells of the 4x4 neighbourhood in result bit order */
+	const int centre[4][2] = {{1,1}, {2,1}, {1,2}, {2,2}};
+
+	for (int index = 0; index < 65536; index++) {
+		unsigned char result = 0;
+		for (int cell = 0; cell < 4; cell++) {
+			int x = centre[cell][0];
+			int y = centre[cell][1];
+			int numberOfNeighbours = 0;
+			for (int i = -1; i <= 1; i++) {
+				for (int k = -1; k <= 1; k++) {
+					if (!((neighbourhood >> (3*(k+1) + (i+1))) & 1)) continue;
+					numberOfNeighbours += (index >> (4*(y+k) + (x+i))) & 1;
+				}
+			}
+			int state = (index >> (4*y + x)) & 1;
+			if (rules[numberOfNeighbours + 9*state] >> 7)
+				result |= 1 << cell;
+		}
+		table[index] = result;
+	}
+	return 0;
+}
+
+void BlockEngine::load(const unsigned char *image) {
+	for (int by = 0; by < blockSize[1]; by++) {
+		for (int bx = 0; bx < blockSize[0]; bx++) {
+			unsigned char value = 0;
+			for (int cell = 0; cell < 4; cell++) {
+				int x = 2*bx + (cell & 1);
+				int y = 2*by + (cell >> 1);
+				if (x < boardSize[0] && y < boardSize[1]
+					&& (image[4*x + (4*boardSize[0]*y)] >> 7))
+					value |= 1 << cell;
+			}
+			block(bx, by, blocks) = value;
+		}
+	}
+}
+
+void BlockEngine::store(unsigned char *image) {
+	for (int y = 0; y < boardSize[1]; y++) {
+		for (int x = 0; x < boardSize[0]; x++) {
+			int cell = (x & 1) + 2*(y & 1);
+			unsigned char color = ((block(x/2, y/2, blocks) >> cell) & 1) ? 255 : 0;
+			unsigned char *pixel = &image[4*x + (4*boardSize[0]*y)];
+			pixel[0] = color;
+			pixel[1] = color;
+			pixel[2] = color;
+			pixel[3] = 1;
+		}
+	}
+}
+
+void BlockEngine::wrapBorder() {
+	const int bw = blockSize[0];
+	const int bh = blockSize[1];
+
+	/* Left and right border */
+	for (int by = 0; by < bh; by++) {
+		block(-1, by, blocks) = block(bw-1, by, blocks);
+		block(bw, by, blocks) = block(0, by, blocks);
+	}
+	/* Top and bottom border including corners */
+	memcpy(&block(-1, -1, blocks), &block(-1, bh-1, blocks), blockPitch);
+	memcpy(&block(-1, bh, blocks), &block(-1, 0, blocks), blockPitch);
+}
+
+void BlockEngine::nextGeneration() {
+	if (!clamp) wrapBorder();
+
+	for (int by = 0; by < blockSize[1]; by++) {
+		const unsigned char *north = &block(0, by-1, blocks);
+		const unsigned char *row = &block(0, by, blocks);
+		const unsigned char *south = &block(0, by+1, blocks);
+		unsigned char *result = &block(0, by, next);
+
+		for (int bx = 0; bx < blockSize[0]; bx++) {
+			/* Assemble the 4x4 neighbourhood from the 3x3 surrounding blocks */
+			unsigned int index =
+				  ((north[bx-1] >> 3) & 1)        | (((north[bx] >> 2) & 3) << 1) | (((north[bx+1] >> 2) & 1) << 3)
+				| (((row[bx-1] >> 1) & 1) << 4)   | ((row[bx] & 3) << 5)          | ((row[bx+1] & 1) << 7)
+				| (((row[bx-1] >> 3) & 1) << 8)   | (((row[bx] >> 2) & 3) << 9)   | (((row[bx+1] >> 2) & 1) << 11)
+				| (((south[bx-1] >> 1) & 1) << 12) | ((south[bx] & 3) << 13)      | ((south[bx+1] & 1) << 15);
+			result[bx] = table[index];
+		}
+	}
+
+	/* Cells outside of a board with odd size stay dead */
+	if (boardSize[0] % 2 != 0)
+		for (int by = 0; by < blockSize[1]; by++)
+			block(blockSize[0]-1, by, next) &= 0x5;
+	if (boardSize[1] % 2 != 0)
+		for (int bx = 0; bx < blockSize[0]; bx++)
+			block(bx, blockSize[1]-1, next) &= 0x3;
+
+	unsigned char *tmp = blocks;
+	blocks = next;
+	next = tmp;
+}
@@ -0,0 +1,99 @@
+#include <cstdio>
+#include <stdint.h>
+#include <unistd.h>					/* for the page size */
+#include <algorithm>
+#include <sys/mman.h>				/* for mapping huge pages */
+
+#include "../inc/BoardArena.hpp"
+using namespace std;
+
+int BoardArena::reserve(size_t bytes) {
+	clear();
+	if (base != NULL && bytes <= capacity) return 0;
+	if (release() != 0) return -1;
+
+	void *mapping;
+
+#ifdef MAP_HUGETLB
+	/* Reserved huge pages, fails if the pool is too small */
+	const size_t hugePage = hugePageSize();
+	if (hugePage > 0) {
+		const size_t hugeSize = max(bytes + hugePage-1, hugePage) / hugePage * hugePage;
+		mapping = mmap(NULL, hugeSize, PROT_READ | PROT_WRITE,
+					MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (mapping != MAP_FAILED) {
+			base = (unsigned char *)mapping;
+			capacity = hugeSize;
+			hugePages = true;
+			pageSize = hugePage;
+			return 0;
+		}
+	}
+#endif
+
+	/* Normal pages, one huge page more to start the arena on a huge page boundary */
+	const size_t size = max(bytes + ARENA_PAGE-1, ARENA_PAGE) / ARENA_PAGE * ARENA_PAGE;
+	mapping = mmap(NULL, size + ARENA_PAGE, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mapping == MAP_FAILED) return -1;
+	unsigned char *start = (unsigned char *)mapping;
+	unsigned char *aligned = (unsigned char *)(((uintptr_t)start + ARENA_PAGE-1) & ~(uintptr_t)(ARENA_PAGE-1));
+	if (aligned > start) munmap(start, aligned - start);
+	if (aligned + size < start + size + ARENA_PAGE)
+		munmap(aligned + size, start + size + ARENA_PAGE - (aligned + size));
+
+#ifdef MADV_HUGEPAGE
+	/* Failing only loses transparent huge pages */
+	madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+	base = aligned;
+	capacity = size;
+	hugePages = false;
+	pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	return 0;
+}
+
+void * BoardArena::allocate(size_t bytes) {
+	if (base == NULL && reserve(bytes) != 0) return NULL;
+	if (align(bytes) > capacity - used) return NULL;
+
+	void *region = base + used;
+	used += align(bytes);
+	return region;
+}
+
+void BoardArena::discard(void *region, size_t bytes) {
+	if (base == NULL || pageSize == 0) return;
+
+	/* Only whole pages inside the region */
+	uintptr_t first = ((uintptr_t)region + pageSize-1) / pageSize * pageSize;
+	uintptr_t end = ((uintptr_t)region + bytes) / pageSize * pageSize;
+	if (end > first)
+		madvise((void *)first, end - first, MADV_DONTNEED);
+}
+
+int BoardArena::release() {
+	int status = 0;
+	if (base != NULL && munmap(base, capacity) != 0) {
+		fprintf(stderr, "Could not unmap arena of %lu bytes\n", (unsigned long)capacity);
+		status = -1;
+	}
+	base = NULL;
+	capacity = 0;
+	used = 0;
+	hugePages = false;
+	pageSize = 0;
+	return status;
+}
+
+size_t BoardArena::hugePageSize() {
+	FILE *meminfo = fopen("/proc/meminfo", "r");
+	if (meminfo == NULL) return 0;
+
+	char line[128];
+	unsigned long kilobytes = 0;
+	while (fgets(line, sizeof(line), meminfo) != NULL)
+		if (sscanf(line, "Hugepagesize: %lu kB", &kilobytes) == 1) break;
+	fclose(meminfo);
+	return (size_t)kilobytes << 10;
+}
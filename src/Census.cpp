@@ -0,0 +1,253 @@
+#include "../inc/Census.hpp"
+using namespace std;
+
+void Census::addTorus(const unsigned int *rows, int width, int height) {
+	vector<unsigned int> visited(height, 0);
+	vector<Cell> stack, cluster;
+	vector<vector<Cell> > parts;
+
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			if (!((rows[y] >> x) & 1) || ((visited[y] >> x) & 1)) continue;
+
+			/* Flood fill cells up to CENSUS_RADIUS apart, coordinates are unwrapped */
+			cluster.clear();
+			stack.push_back(Cell(x, y));
+			visited[y] |= 1u << x;
+			while (!stack.empty()) {
+				Cell cell = stack.back();
+				stack.pop_back();
+				cluster.push_back(cell);
+				for (int k = -CENSUS_RADIUS; k <= CENSUS_RADIUS; k++) {
+					for (int i = -CENSUS_RADIUS; i <= CENSUS_RADIUS; i++) {
+						int nx = cell.first + i, ny = cell.second + k;
+						int wx = ((nx % width) + width) % width;
+						int wy = ((ny % height) + height) % height;
+						if (((rows[wy] >> wx) & 1) && !((visited[wy] >> wx) & 1)) {
+							visited[wy] |= 1u << wx;
+							stack.push_back(Cell(nx, ny));
+						}
+					}
+				}
+			}
+
+			/* 8-connected parts are counted alone if each of them is periodic */
+			split(cluster, parts);
+			vector<string> partCodes;
+			bool periodic = true;
+			for (unsigned int p = 0; p < parts.size(); p++) {
+				partCodes.push_back(classify(parts[p]));
+				periodic = periodic && partCodes.back() != CENSUS_UNKNOWN;
+			}
+			if (!periodic && parts.size() > 1) {
+				string code = classify(cluster);
+				if (code != CENSUS_UNKNOWN) partCodes.assign(1, code);
+			}
+			for (unsigned int p = 0; p < partCodes.size(); p++) {
+				counts[partCodes[p]]++;
+				objects++;
+			}
+		}
+	}
+}
+
+void Census::split(const vector<Cell> &cells, vector<vector<Cell> > &parts) {
+	vector<Cell> sorted(cells), stack;
+	sort(sorted.begin(), sorted.end());
+	vector<bool> visited(sorted.size(), false);
+
+	parts.clear();
+	for (unsigned int c = 0; c < sorted.size(); c++) {
+		if (visited[c]) continue;
+		parts.push_back(vector<Cell>());
+		stack.push_back(sorted[c]);
+		visited[c] = true;
+		while (!stack.empty()) {
+			Cell cell = stack.back();
+			stack.pop_back();
+			parts.back().push_back(cell);
+			for (int k = -1; k <= 1; k++) {
+				for (int i = -1; i <= 1; i++) {
+					Cell neighbour(cell.first + i, cell.second + k);
+					vector<Cell>::iterator found = lower_bound(sorted.begin(), sorted.end(), neighbour);
+					if (found == sorted.end() || *found != neighbour || visited[found - sorted.begin()])
+						continue;
+					visited[found - sorted.begin()] = true;
+					stack.push_back(neighbour);
+				}
+			}
+		}
+	}
+}
+
+string Census::classify(vector<Cell> &cells) {
+	normalise(cells);
+	string cellsKey = key(cells);
+	map<string, string>::iterator known = codes.find(cellsKey);
+	if (known != codes.end())
+		return known->second;
+
+	/* Step object in isolation until a phase repeats itself */
+	vector<vector<Cell> > phases(1, cells);
+	vector<Cell> current = cells;
+	Cell offset(0, 0);
+	int period = 0;
+	for (int generation = 1; generation <= CENSUS_MAX_PERIOD && !current.empty(); generation++) {
+		step(current);
+		Cell moved = normalise(current);
+		offset.first += moved.first;
+		offset.second += moved.second;
+		if (current == cells) {
+			period = generation;
+			break;
+		}
+		phases.push_back(current);
+	}
+
+	string code(CENSUS_UNKNOWN);
+	if (period > 0) {
+		/* Smallest code of all phases and orientations */
+		string best;
+		for (unsigned int phase = 0; phase < phases.size(); phase++) {
+			for (int orientation = 0; orientation < 8; orientation++) {
+				vector<Cell> transformed(phases[phase]);
+				for (unsigned int c = 0; c < transformed.size(); c++) {
+					int x = transformed[c].first, y = transformed[c].second;
+					if (orientation & 1) x = -x;
+					if (orientation & 2) y = -y;
+					if (orientation & 4) swap(x, y);
+					transformed[c] = Cell(x, y);
+				}
+				normalise(transformed);
+				string candidate = wechsler(transformed);
+				if (best.empty() || candidate.size() < best.size()
+					|| (candidate.size() == best.size() && candidate < best))
+					best = candidate;
+			}
+		}
+
+		char prefix[32];
+		if (offset.first != 0 || offset.second != 0)
+			snprintf(prefix, sizeof(prefix), "xq%i_", period);
+		else if (period > 1)
+			snprintf(prefix, sizeof(prefix), "xp%i_", period);
+		else
+			snprintf(prefix, sizeof(prefix), "xs%i_", (int)cells.size());
+		code = prefix + best;
+	}
+
+	codes[cellsKey] = code;
+	return code;
+}
+
+void Census::step(vector<Cell> &cells) {
+	/* Every live cell adds itself to the count of the cells it is a neighbour of */
+	map<Cell, int> neighbours;
+	for (unsigned int c = 0; c < cells.size(); c++) {
+		for (int k = -1; k <= 1; k++) {
+			for (int i = -1; i <= 1; i++) {
+				if (!((neighbourhood >> (3*(k+1) + (i+1))) & 1)) continue;
+				neighbours[Cell(cells[c].first - i, cells[c].second - k)]++;
+			}
+		}
+	}
+
+	vector<Cell> next;
+	for (map<Cell, int>::iterator it = neighbours.begin(); it != neighbours.end(); it++) {
+		bool alive = binary_search(cells.begin(), cells.end(), it->first);
+		unsigned int rule = alive ? survivalRule : birthRule;
+		if ((rule >> it->second) & 1)
+			next.push_back(it->first);
+	}
+	/* Live cells without any neighbour are not in the map */
+	if (survivalRule & 1) {
+		for (unsigned int c = 0; c < cells.size(); c++)
+			if (neighbours.find(cells[c]) == neighbours.end())
+				next.push_back(cells[c]);
+	}
+	cells.swap(next);
+}
+
+Census::Cell Census::normalise(vector<Cell> &cells) {
+	if (cells.empty()) return Cell(0, 0);
+
+	int minX = cells[0].first, minY = cells[0].second;
+	for (unsigned int c = 1; c < cells.size(); c++) {
+		minX = min(minX, cells[c].first);
+		minY = min(minY, cells[c].second);
+	}
+	for (unsigned int c = 0; c < cells.size(); c++) {
+		cells[c].first -= minX;
+		cells[c].second -= minY;
+	}
+	sort(cells.begin(), cells.end());
+	return Cell(minX, minY);
+}
+
+string Census::wechsler(const vector<Cell> &cells) {
+	const char *digits = "0123456789abcdefghijklmnopqrstuv";
+
+	int width = 0, height = 0;
+	for (unsigned int c = 0; c < cells.size(); c++) {
+		width = max(width, cells[c].first + 1);
+		height = max(height, cells[c].second + 1);
+	}
+
+	/* Strips of 5 rows, every column of a strip is one digit */
+	string code;
+	for (int strip = 0; strip*5 < height; strip++) {
+		if (strip > 0) code += 'z';
+		vector<int> columns(width, 0);
+		for (unsigned int c = 0; c < cells.size(); c++)
+			if (cells[c].second / 5 == strip)
+				columns[cells[c].first] |= 1 << (cells[c].second % 5);
+
+		/* Runs of empty columns are compressed, trailing ones are dropped */
+		int zeros = 0;
+		for (int x = 0; x < width; x++) {
+			if (columns[x] == 0) {
+				zeros++;
+				continue;
+			}
+			while (zeros > 0) {
+				if (zeros == 1)      { code += '0'; zeros = 0; }
+				else if (zeros == 2) { code += 'w'; zeros = 0; }
+				else if (zeros == 3) { code += 'x'; zeros = 0; }
+				else {
+					int run = min(zeros, 39);
+					code += 'y';
+					code += digits[run - 4];
+					zeros -= run;
+				}
+			}
+			code += digits[columns[x]];
+		}
+	}
+	return code;
+}
+
+string Census::key(const vector<Cell> &cells) {
+	string cellsKey;
+	char cell[24];
+	for (unsigned int c = 0; c < cells.size(); c++) {
+		snprintf(cell, sizeof(cell), "%i,%i;", cells[c].first, cells[c].second);
+		cellsKey += cell;
+	}
+	return cellsKey;
+}
+
+/* Sort census entries by number of objects, then by code */
+static bool moreObjects(const pair<string, unsigned long> &a,
+						const pair<string, unsigned long> &b) {
+	if (a.second != b.second) return a.second > b.second;
+	return a.first < b.first;
+}
+
+void Census::print(FILE *file) {
+	vector<pair<string, unsigned long> > table(counts.begin(), counts.end());
+	sort(table.begin(), table.end(), moreObjects);
+
+	fprintf(file, "Census: %lu objects, %lu distinct\n", objects, (unsigned long)table.size());
+	for (unsigned int i = 0; i < table.size(); i++)
+		fprintf(file, "%-32s %lu\n", table[i].first.c_str(), table[i].second);
+}
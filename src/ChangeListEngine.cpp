@@ -0,0 +1,165 @@
+#include "../inc/ChangeListEngine.hpp"
+
+int ChangeListEngine::setup(int width, int height, int topology) {
+	freeMem();
+
+	boardSize[0] = width;
+	boardSize[1] = height;
+	pitch = width + 2*CHANGE_GUARD;
+	size_t total = (size_t)pitch*(height + 2*CHANGE_GUARD);
+	size_t boardCells = (size_t)width*height;
+	ringCount = 2*(width + 2) + 2*height;
+
+	cells = (unsigned char *)calloc(total, 1);
+	edges = (unsigned char *)calloc(total, 1);
+	marks = (unsigned long long *)malloc((total + 63) / 64 * sizeof(unsigned long long));
+	changed = (int *)malloc((boardCells + ringCount) * sizeof(int));
+	flipped = (int *)malloc((boardCells + ringCount) * sizeof(int));
+	candidates = (int *)malloc(boardCells * sizeof(int));
+	ringGhost = (int *)malloc(ringCount * sizeof(int));
+	ringSource = (int *)malloc(ringCount * sizeof(int));
+	if (cells == NULL || edges == NULL || marks == NULL || changed == NULL
+		|| flipped == NULL || candidates == NULL || ringGhost == NULL || ringSource == NULL)
+		return -1;
+
+	/* Cells outside of the board are never evaluated */
+	memset(marks, 0xFF, (total + 63) / 64 * sizeof(unsigned long long));
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			int i = index(x, y);
+			marks[i >> 6] &= ~(1ULL << (i & 63));
+		}
+	}
+
+	/* Board cell of every ghost cell, the topology is only needed here */
+	int r = 0;
+	for (int y = -1; y <= height; y++) {
+		for (int x = -1; x <= width; x++) {
+			if (y >= 0 && y < height && x == 0) x = width;
+			int sourceX = x, sourceY = y;
+			ringGhost[r] = index(x, y);
+			ringSource[r] = -1;
+			if (ghostSource(topology, width, height, sourceX, sourceY)) {
+				ringSource[r] = index(sourceX, sourceY);
+				edges[ringSource[r]] = 1;
+			}
+			r++;
+		}
+	}
+
+	updateOffsets();
+	return 0;
+}
+
+void ChangeListEngine::freeMem() {
+	free(cells);
+	free(edges);
+	free(marks);
+	free(changed);
+	free(flipped);
+	free(candidates);
+	free(ringGhost);
+	free(ringSource);
+	cells = edges = NULL;
+	marks = NULL;
+	changed = flipped = candidates = ringGhost = ringSource = NULL;
+	changedCount = 0;
+}
+
+int ChangeListEngine::setRules(const unsigned char *_rules, unsigned int _neighbourhood) {
+	for (int i = 0; i < 18; i++)
+		rules[i] = _rules[i] >> 7;
+	neighbourhood = _neighbourhood;
+	updateOffsets();
+	return 0;
+}
+
+void ChangeListEngine::updateOffsets() {
+	/* A cell counts the cells at its offsets, so it is seen from the opposite ones */
+	numberOfOffsets = 0;
+	reverse[0] = 0;
+	for (int k = -1; k <= 1; k++) {
+		for (int i = -1; i <= 1; i++) {
+			if (!((neighbourhood >> (3*(k+1) + (i+1))) & 1)) continue;
+			offsets[numberOfOffsets] = i + pitch*k;
+			reverse[numberOfOffsets + 1] = -(i + pitch*k);
+			numberOfOffsets++;
+		}
+	}
+}
+
+void ChangeListEngine::load(const unsigned char *image) {
+	memset(cells, 0, (size_t)pitch*(boardSize[1] + 2*CHANGE_GUARD));
+
+	/* Every board cell is evaluated in the first generation */
+	changedCount = 0;
+	for (int y = 0; y < boardSize[1]; y++) {
+		for (int x = 0; x < boardSize[0]; x++) {
+			cells[index(x, y)] = image[4*x + (4*boardSize[0]*y)] >> 7;
+			changed[changedCount++] = index(x, y);
+		}
+	}
+	for (int r = 0; r < ringCount; r++)
+		cells[ringGhost[r]] = ringSource[r] >= 0 ? cells[ringSource[r]] : 0;
+}
+
+void ChangeListEngine::updateBorder() {
+	for (int r = 0; r < ringCount; r++) {
+		unsigned char state = ringSource[r] >= 0 ? cells[ringSource[r]] : 0;
+		if (cells[ringGhost[r]] != state) {
+			cells[ringGhost[r]] = state;
+			changed[changedCount++] = ringGhost[r];
+		}
+	}
+}
+
+void ChangeListEngine::nextGeneration() {
+	/* Candidates are the changed cells and the cells counting them */
+	int candidateCount = 0;
+	for (int c = 0; c < changedCount; c++) {
+		for (int r = 0; r <= numberOfOffsets; r++) {
+			int i = changed[c] + reverse[r];
+			if (mark(i)) candidates[candidateCount++] = i;
+		}
+	}
+
+	/* Evaluate all candidates before any cell changes */
+	int flippedCount = 0;
+	for (int c = 0; c < candidateCount; c++) {
+		int i = candidates[c];
+		int numberOfNeighbours = 0;
+		for (int o = 0; o < numberOfOffsets; o++)
+			numberOfNeighbours += cells[i + offsets[o]];
+		if (rules[numberOfNeighbours + 9*cells[i]] != cells[i])
+			flipped[flippedCount++] = i;
+		marks[i >> 6] &= ~(1ULL << (i & 63));
+	}
+
+	bool edgeFlipped = false;
+	for (int c = 0; c < flippedCount; c++) {
+		cells[flipped[c]] ^= 1;
+		edgeFlipped |= edges[flipped[c]] != 0;
+	}
+
+	/* Flipped cells are the changed cells of the next generation */
+	int *tmp = changed;
+	changed = flipped;
+	flipped = tmp;
+	changedCount = flippedCount;
+	if (edgeFlipped) updateBorder();
+
+	evaluated->add(candidateCount);
+}
+
+void ChangeListEngine::store(unsigned char *image) {
+	for (int y = 0; y < boardSize[1]; y++) {
+		for (int x = 0; x < boardSize[0]; x++) {
+			unsigned char color = cells[index(x, y)] ? 255 : 0;
+			unsigned char *pixel = &image[4*x + (4*boardSize[0]*y)];
+			pixel[0] = color;
+			pixel[1] = color;
+			pixel[2] = color;
+			pixel[3] = 1;
+		}
+	}
+}
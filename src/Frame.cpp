@@ -0,0 +1,68 @@
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include "../inc/Frame.hpp"
+using namespace std;
+
+FrameView makeFrameView(int width, int height, const float visible[4],
+						const int pixels[2], int format, const int maxSize[2]) {
+	const int dim[2] = {width, height};
+	float cellsPerPixel = max((visible[2] - visible[0]) / max(pixels[0], 1),
+							  (visible[3] - visible[1]) / max(pixels[1], 1));
+
+	FrameView view;
+	view.level = 0;
+	while (view.level < 30 && (float)(2 << view.level) <= cellsPerPixel)
+		view.level++;
+
+	for (;; view.level++) {
+		view.format = view.level > 0 ? FRAME_R8 : format;
+		bool fits = true;
+		for (int axis = 0; axis < 2; axis++) {
+			int cells = texelCells(view, axis);
+			int texels = (dim[axis] + cells - 1) / cells;
+			int first = (int)floor(visible[axis] / cells);
+			int last = (int)ceil(visible[axis+2] / cells);
+			first = min(max(first, 0), texels - 1);
+			last = min(max(last, first + 1), texels);
+			view.origin[axis] = first;
+			view.size[axis] = last - first;
+			fits = fits && view.size[axis] <= maxSize[axis];
+		}
+		if (fits || view.level >= 30) return view;
+	}
+}
+
+void packFrame(const unsigned char *image, int width, int height,
+			   const FrameView &view, unsigned char *frame) {
+	memcpy(frame, &view, sizeof(FrameView));
+	unsigned char *texels = frame + sizeof(FrameView);
+	const int cellsX = texelCells(view, 0);
+	const int cellsY = texelCells(view, 1);
+
+	for (int ty = 0; ty < view.size[1]; ty++) {
+		for (int tx = 0; tx < view.size[0]; tx++) {
+			int x0 = (view.origin[0] + tx) * cellsX;
+			int y0 = (view.origin[1] + ty) * cellsY;
+			int x1 = min(x0 + cellsX, width);
+			int y1 = min(y0 + cellsY, height);
+			unsigned char *texel = &texels[tx + view.size[0]*ty];
+
+			if (view.format == FRAME_BITS) {
+				/* One bit per live cell */
+				*texel = 0;
+				for (int x = x0; x < x1; x++)
+					*texel |= (image[4*(x + width*y0)] >> 7) << (x - x0);
+			} else {
+				/* Average color of the cells, the live fraction with 2 states */
+				unsigned long long sum = 0;
+				for (int y = y0; y < y1; y++)
+					for (int x = x0; x < x1; x++)
+						sum += image[4*(x + width*y)];
+				unsigned int count = (x1 - x0) * (y1 - y0);
+				*texel = count ? sum / count : 0;
+			}
+		}
+	}
+}
@@ -0,0 +1,374 @@
+#include <cstring>
+#include <vector>
+
+#include "../inc/FrameExport.hpp"
+using namespace std;
+
+/**
+* CRC-32 as used by PNG chunks.
+* @param crc CRC of the preceding bytes, 0 for the first ones
+* @param data bytes
+* @param size number of bytes
+* @return CRC of all bytes
+*/
+static unsigned int crc32(unsigned int crc, const unsigned char *data, size_t size) {
+	static unsigned int table[256];
+	static bool tableReady = false;
+	if (!tableReady) {
+		for (unsigned int n = 0; n < 256; n++) {
+			unsigned int c = n;
+			for (int k = 0; k < 8; k++)
+				c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			table[n] = c;
+		}
+		tableReady = true;
+	}
+	crc = ~crc;
+	for (size_t i = 0; i < size; i++)
+		crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+/**
+* Bit stream of a deflate block, bits are filled from the least significant one.
+*/
+struct DeflateWriter {
+	vector<unsigned char> &out;
+	unsigned int bits;
+	int numberOfBits;
+
+	DeflateWriter(vector<unsigned char> &_out): out(_out), bits(0), numberOfBits(0) {}
+
+	/* Append value with the least significant bit first */
+	void put(unsigned int value, int length) {
+		bits |= value << numberOfBits;
+		numberOfBits += length;
+		while (numberOfBits >= 8) {
+			out.push_back(bits & 0xFF);
+			bits >>= 8;
+			numberOfBits -= 8;
+		}
+	}
+
+	/* Append Huffman code with the most significant bit first */
+	void putCode(unsigned int code, int length) {
+		unsigned int reversed = 0;
+		for (int i = 0; i < length; i++)
+			reversed |= ((code >> i) & 1) << (length - 1 - i);
+		put(reversed, length);
+	}
+
+	/* Append literal or length symbol with the fixed Huffman code */
+	void putSymbol(int symbol) {
+		if (symbol < 144)      putCode(0x30 + symbol, 8);
+		else if (symbol < 256) putCode(0x190 + symbol - 144, 9);
+		else if (symbol < 280) putCode(symbol - 256, 7);
+		else                   putCode(0xC0 + symbol - 280, 8);
+	}
+
+	/* Append a repetition of the previous byte */
+	void putRun(int length) {
+		static const int base[29] = {3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,
+									 35,43,51,59,67,83,99,115,131,163,195,227,258};
+		static const int extra[29] = {0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,
+									  3,3,3,3,4,4,4,4,5,5,5,5,0};
+		int code = 28;
+		while (base[code] > length) code--;
+		putSymbol(257 + code);
+		put(length - base[code], extra[code]);
+		putCode(0, 5);		/* distance 1 */
+	}
+
+	/* Write remaining bits */
+	void flush() {
+		if (numberOfBits > 0) out.push_back(bits & 0xFF);
+		bits = 0;
+		numberOfBits = 0;
+	}
+};
+
+/**
+* Compress bytes into a zlib stream.
+* Boards are mostly runs of equal bytes, so a single fixed Huffman
+* block with runs of the previous byte is enough and fast.
+* @param data bytes
+* @param size number of bytes
+* @param out zlib stream, appended
+*/
+static void deflateRuns(const unsigned char *data, size_t size, vector<unsigned char> &out) {
+	out.push_back(0x78);
+	out.push_back(0x01);
+
+	DeflateWriter writer(out);
+	writer.put(1, 1);		/* final block */
+	writer.put(1, 2);		/* fixed Huffman codes */
+	size_t i = 0;
+	while (i < size) {
+		size_t run = 0;
+		if (i > 0)
+			while (run < 258 && i + run < size && data[i + run] == data[i - 1])
+				run++;
+		if (run >= 3) {
+			writer.putRun(run);
+			i += run;
+		} else {
+			writer.putSymbol(data[i]);
+			i++;
+		}
+	}
+	writer.putSymbol(256);	/* end of block */
+	writer.flush();
+
+	/* Adler-32 of uncompressed bytes */
+	unsigned int a = 1, b = 0;
+	for (i = 0; i < size; i++) {
+		a = (a + data[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+	unsigned int adler = (b << 16) | a;
+	for (int shift = 24; shift >= 0; shift -= 8)
+		out.push_back((adler >> shift) & 0xFF);
+}
+
+/**
+* Append a PNG chunk.
+* @param out PNG file, appended
+* @param type chunk type
+* @param data chunk data
+*/
+static void appendChunk(vector<unsigned char> &out, const char *type,
+						const vector<unsigned char> &data) {
+	unsigned int length = data.size();
+	for (int shift = 24; shift >= 0; shift -= 8)
+		out.push_back((length >> shift) & 0xFF);
+	size_t start = out.size();
+	out.insert(out.end(), type, type + 4);
+	out.insert(out.end(), data.begin(), data.end());
+	unsigned int crc = crc32(0, &out[start], out.size() - start);
+	for (int shift = 24; shift >= 0; shift -= 8)
+		out.push_back((crc >> shift) & 0xFF);
+}
+
+/**
+* Count the generation conversions of a PNG path used as printf format.
+* Only %lu with an optional 0 flag and width, and %% are allowed.
+* @param path path of PNG files
+* @return number of conversions, -1 for any other conversion
+*/
+static int countGenerationConversions(const string &path) {
+	int conversions = 0;
+	for (size_t i = 0; i < path.size(); i++) {
+		if (path[i] != '%') continue;
+		if (++i < path.size() && path[i] == '%') continue;
+		while (i < path.size() && path[i] >= '0' && path[i] <= '9') i++;
+		if (path.compare(i, 2, "lu") != 0) return -1;
+		i++;
+		conversions++;
+	}
+	return conversions;
+}
+
+int FrameExport::setup(const char *_path, int level, const int crop[4], int width, int height) {
+	path = _path;
+
+	/* Format from extension */
+	size_t dot = path.rfind('.');
+	string extension = dot == string::npos ? "" : path.substr(dot);
+	if (extension == ".png")      format = EXPORT_PNG;
+	else if (extension == ".ppm") format = EXPORT_PPM;
+	else if (extension == ".y4m") format = EXPORT_Y4M;
+	else {
+		fprintf(stderr, "Unknown export format %s, use .png, .ppm or .y4m\n", _path);
+		return -1;
+	}
+
+	/* Part of the board, in texels of the level */
+	int cropped[4] = {0, 0, width, height};
+	if (crop[2] > 0 && crop[3] > 0) {
+		for (int i = 0; i < 4; i++) cropped[i] = crop[i];
+		if (cropped[0] < 0 || cropped[1] < 0
+			|| cropped[0] + cropped[2] > width || cropped[1] + cropped[3] > height) {
+			fprintf(stderr, "Export window is outside of the board (%ix%i)\n", width, height);
+			return -1;
+		}
+	}
+	view.format = FRAME_R8;
+	view.level = level;
+	for (int axis = 0; axis < 2; axis++) {
+		int cells = texelCells(view, axis);
+		view.origin[axis] = cropped[axis] / cells;
+		view.size[axis] = (cropped[axis] + cropped[axis+2] + cells - 1) / cells - view.origin[axis];
+	}
+	frameBytes = frameSizeBytes(view);
+
+	/* Open stream, a PNG file is opened per frame */
+	if (format == EXPORT_PNG) {
+		/* Path is the format of the file names, it must not take anything but the generation */
+		int conversions = countGenerationConversions(path);
+		if (conversions < 0 || conversions > 1) {
+			fprintf(stderr, "PNG path %s may only contain one %%lu for the generation\n", _path);
+			return -1;
+		}
+		if (conversions == 0)
+			path = path.substr(0, dot) + "%08lu.png";
+	} else if (path.substr(0, dot) == "-") {
+		stream = stdout;
+	} else {
+		stream = fopen(path.c_str(), "wb");
+		if (stream == NULL) {
+			fprintf(stderr, "Could not open %s\n", path.c_str());
+			return -1;
+		}
+	}
+	if (format == EXPORT_Y4M)
+		fprintf(stream, "YUV4MPEG2 W%i H%i F30:1 Ip A1:1 Cmono\n", view.size[0], view.size[1]);
+
+	for (int i = 0; i < EXPORT_QUEUE; i++) {
+		slots[i] = (unsigned char *)malloc(frameBytes);
+		if (slots[i] == NULL) return -1;
+	}
+
+	writer = std::thread(&FrameExport::writeFrames, this);
+	return 0;
+}
+
+int FrameExport::push(const unsigned char *frame, unsigned long generation) {
+	std::unique_lock<std::mutex> lock(mutex);
+	if (count == EXPORT_QUEUE && !failed) {
+		waits++;
+		while (count == EXPORT_QUEUE && !failed)
+			ready.wait(lock);
+	}
+	if (failed) return -1;
+
+	int slot = (first + count) % EXPORT_QUEUE;
+	memcpy(slots[slot], frame, frameBytes);
+	slotGeneration[slot] = generation;
+	count++;
+	lock.unlock();
+	ready.notify_all();
+	return 0;
+}
+
+int FrameExport::finish() {
+	if (writer.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			closing = true;
+		}
+		ready.notify_all();
+		writer.join();
+	}
+
+	if (stream == stdout) {
+		fflush(stream);
+	} else if (stream) {
+		if (fclose(stream) != 0) failed = true;
+	}
+	stream = NULL;
+
+	for (int i = 0; i < EXPORT_QUEUE; i++) {
+		free(slots[i]);
+		slots[i] = NULL;
+	}
+
+	return failed ? -1 : 0;
+}
+
+void FrameExport::writeFrames() {
+	getTrace().setThreadName("export writer");
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		while (count == 0 && !closing)
+			ready.wait(lock);
+		if (count == 0 || failed) break;
+
+		/* The oldest slot is not touched by push while it is queued */
+		int slot = first;
+		lock.unlock();
+		int status;
+		{
+			ScopedTimer timer(writeTime);
+			status = writeFrame(slots[slot] + sizeof(FrameView), slotGeneration[slot]);
+		}
+		lock.lock();
+
+		if (status != 0) failed = true;
+		else written++;
+		first = (first + 1) % EXPORT_QUEUE;
+		count--;
+		ready.notify_all();
+	}
+}
+
+int FrameExport::writeFrame(const unsigned char *texels, unsigned long generation) {
+	const int width = view.size[0];
+	const int height = view.size[1];
+
+	switch (format) {
+	case EXPORT_PNG:
+		return writePNG(texels, generation);
+	case EXPORT_PPM: {
+		/* Grey texels as RGB pixels */
+		vector<unsigned char> pixels(3*width);
+		fprintf(stream, "P6\n%i %i\n255\n", width, height);
+		for (int y = 0; y < height; y++) {
+			for (int x = 0; x < width; x++)
+				pixels[3*x] = pixels[3*x+1] = pixels[3*x+2] = texels[x + width*y];
+			if (fwrite(&pixels[0], 1, pixels.size(), stream) != pixels.size())
+				return -1;
+		}
+		return 0;
+	}
+	case EXPORT_Y4M:
+		/* Texels are the luma plane */
+		fprintf(stream, "FRAME\n");
+		if (fwrite(texels, 1, (size_t)width*height, stream) != (size_t)width*height)
+			return -1;
+		return 0;
+	}
+	return -1;
+}
+
+int FrameExport::writePNG(const unsigned char *texels, unsigned long generation) {
+	const int width = view.size[0];
+	const int height = view.size[1];
+
+	/* Scanlines with filter type 0 */
+	vector<unsigned char> scanlines;
+	scanlines.reserve((size_t)(width + 1) * height);
+	for (int y = 0; y < height; y++) {
+		scanlines.push_back(0);
+		scanlines.insert(scanlines.end(), texels + (size_t)width*y, texels + (size_t)width*(y+1));
+	}
+
+	static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+	vector<unsigned char> png(signature, signature + 8);
+
+	/* 8 bit greyscale */
+	vector<unsigned char> header;
+	for (int shift = 24; shift >= 0; shift -= 8) header.push_back((width >> shift) & 0xFF);
+	for (int shift = 24; shift >= 0; shift -= 8) header.push_back((height >> shift) & 0xFF);
+	header.push_back(8);
+	header.push_back(0);
+	header.push_back(0);
+	header.push_back(0);
+	header.push_back(0);
+	appendChunk(png, "IHDR", header);
+
+	vector<unsigned char> data;
+	deflateRuns(&scanlines[0], scanlines.size(), data);
+	appendChunk(png, "IDAT", data);
+	appendChunk(png, "IEND", vector<unsigned char>());
+
+	char name[1024];
+	snprintf(name, sizeof(name), path.c_str(), generation);
+	FILE *file = fopen(name, "wb");
+	if (file == NULL) {
+		fprintf(stderr, "Could not open %s\n", name);
+		return -1;
+	}
+	size_t status = fwrite(&png[0], 1, png.size(), file);
+	if (fclose(file) != 0 || status != png.size()) return -1;
+	return 0;
+}
@@ -1,53 +1,145 @@
 #include "../inc/GameOfLife.hpp"
+#include "../inc/BlockEngine.hpp"
+#include "../inc/ChangeListEngine.hpp"
+#include "../inc/SparseEngine.hpp"
+#include "../inc/TileEngine.hpp"
 using namespace std;
 
 int GameOfLife::setRule(char *_rule) {
+	/* Neighbourhood suffix */
+	unsigned int ruleNeighbourhood = neighbourhood;
+	size_t ruleLength = strlen(_rule);
+	if (ruleLength > 0 && strchr("HVM", _rule[ruleLength-1]) != NULL) {
+		char suffix[2] = {_rule[ruleLength-1], '\0'};
+		parseNeighbourhood(suffix, &ruleNeighbourhood);
+		ruleLength--;
+	}
+	
 	int counter = 0;
-	unsigned int delimiterPos = 0;
-	for (unsigned int i = 0; i < strlen(_rule); i++) {
+	unsigned int delimiterPos[2] = {0, 0};
+	for (unsigned int i = 0; i < ruleLength; i++) {
 		if (_rule[i] == '/') {
+			if (counter < 2) delimiterPos[counter] = i;
 			counter++;
-			delimiterPos = i;
+		} else if (_rule[i] < '0' || _rule[i] > '9') {
+			return -1;	/* Only digits allowed */
 		}
 	}
-	if (counter != 1) return -1;	/* Only 1 delimiter allowed */
+	if (counter < 1 || counter > 2) return -1;	/* Only 1 or 2 delimiters allowed */
 	
-	/* Allocate space for rules and set to default value 0 */
-	rulesSizeBytes = 18*sizeof(char);
-	rules = (unsigned char*)malloc(rulesSizeBytes);
-	memset(rules,0,18);
+	/* Split up rule in survival, birth and optional number of states */
+	std::string splitter(_rule, ruleLength);
+	unsigned int survival = 0, birth = 0;
+	for (unsigned int i = 0; i < delimiterPos[0]; i++) {
+		int number = splitter[i]-'0';
+		survival |= 1 << (number==9?0:number);
+	}
+	unsigned int birthEnd = (counter == 2) ? delimiterPos[1] : splitter.size();
+	for (unsigned int i = delimiterPos[0]+1; i < birthEnd; i++) {
+		int number = splitter[i]-'0';
+		birth |= 1 << (number==9?0:number);
+	}
+	int numberOfStates = 2;
+	if (counter == 2) {
+		numberOfStates = atoi(splitter.substr(delimiterPos[1]+1).c_str());
+		if (numberOfStates < 2 || numberOfStates > 256) return -1;
+	}
 	
-	/* Split up rule in survival and birth */
-	std::string splitter(_rule);
-	humanRules.push_back('S');
-	char numChar[(int)sizeof(int)];
-	if (delimiterPos > 0) {
-		/* there is a survival definition */
-		for (unsigned int i = 0; i < delimiterPos; i++) {
-			int number = atoi(splitter.substr(i,1).c_str());
-			rules[9+(number==9?0:number)] = 255;
-			snprintf(numChar,sizeof(int),"%i",number);
-			humanRules.push_back(numChar[0]);
+	survivalRule = survival;
+	birthRule = birth;
+	states = numberOfStates;
+	neighbourhood = ruleNeighbourhood;
+	updateRules();
+	
+	return 0;
+}
+
+int GameOfLife::setNeighbourhood(const char *name) {
+	if (parseNeighbourhood(name, &neighbourhood) != 0)
+		return -1;
+	updateRules();
+	return 0;
+}
+
+int GameOfLife::setCPUEngine(const char *name) {
+	CPUEngine *engine = NULL;
+	if (!strcmp(name, "block"))
+		engine = new BlockEngine();
+	else if (!strcmp(name, "changes"))
+		engine = new ChangeListEngine();
+	else if (!strcmp(name, "sparse"))
+		engine = new SparseEngine();
+	else if (!strcmp(name, "tiles"))
+		engine = new TileEngine();
+	else if (!strcmp(name, "rowtiles"))
+		engine = new TileEngine(false);
+	else if (strcmp(name, "pixel"))
+		return -1;
+	
+	delete cpuEngine;
+	cpuEngine = engine;
+	return 0;
+}
+
+void GameOfLife::updateRules() {
+	/*
+	 * Rules are indexed by number of neighbours + 9*state.
+	 * With 2 states a live cell has state ALIVE >> 7 and
+	 * the rules contain the colors of the next state.
+	 * With more states the rules contain the next state itself,
+	 * refractory states decay by the same table lookup.
+	 */
+	rulesSizeBytes = 9*states*sizeof(char);
+	if (rules == NULL) rules = (unsigned char *)arena.allocate(RULES_MAX_BYTES);
+	for (int n = 0; n < 9; n++) {
+		bool birth = (birthRule >> n) & 1;
+		bool survival = (survivalRule >> n) & 1;
+		if (isMultiState()) {
+			rules[n] = birth ? FIRING : 0;
+			rules[9+n] = survival ? FIRING : 2;
+			for (int state = 2; state < states; state++)
+				rules[9*state+n] = (state+1) % states;
+		} else {
+			rules[n] = birth ? ALIVE : DEAD;
+			rules[9+n] = survival ? ALIVE : DEAD;
 		}
 	}
+	
+	/* Human readable rule */
+	humanRules.clear();
+	humanRules.push_back('S');
+	for (int n = 0; n < 9; n++)
+		if ((survivalRule >> n) & 1) humanRules.push_back('0'+n);
 	humanRules.push_back('/');
 	humanRules.push_back('B');
-	if (delimiterPos < splitter.size()-1) {
-		/* there is a birth definition */
-		for (unsigned int i = delimiterPos+1; i < splitter.size(); i++) {
-			int number = atoi(splitter.substr(i,1).c_str());
-			rules[(number==9?0:number)] = 255;
-			snprintf(numChar,sizeof(int),"%i",number);
-			humanRules.push_back(numChar[0]);
-		}
+	for (int n = 0; n < 9; n++)
+		if ((birthRule >> n) & 1) humanRules.push_back('0'+n);
+	if (neighbourhoodSuffix(neighbourhood) != NULL) {
+		humanRules.append(neighbourhoodSuffix(neighbourhood));
+	} else {
+		char maskChar[16];
+		snprintf(maskChar,sizeof(maskChar),"N0x%03X",neighbourhood);
+		humanRules.append(maskChar);
+	}
+	if (isMultiState()) {
+		char numChar[16];
+		snprintf(numChar,sizeof(numChar),"/C%i",states);
+		humanRules.append(numChar);
 	}
 	
-	return 0;
+	/* Rebuild tables of CPU engine */
+	if (cpuEngine) cpuEngine->setRules(rules, neighbourhood);
 }
 
 int GameOfLife::setup() {
+	/* Device is found and the program built while the population is parsed and spawned */
+	startDevice();
+	int status = setupHost();
+	if (cpuOnly)
+		return status;
 	
-	if (setupHost() != 0)
+	joinDevice();
+	if (status != 0 || deviceStatus != 0)
 		return -1;
 	
 	if (setupDevice() != 0)
@@ -56,40 +148,145 @@ int GameOfLife::setup() {
 	return 0;
 }
 
+void GameOfLife::startDevice() {
+	if (cpuOnly || deviceThread.joinable() || context != NULL)
+		return;
+	
+	/* Rule of the pattern file is baked into the kernel, errors are reported by setupHost() */
+	if (spawnMode && patternFile.readHeader() == 0)
+		applyPatternRule();
+	
+	/* Neighbourhood is unrolled at compile time */
+	char neighbourhoodOption[32];
+	snprintf(neighbourhoodOption, sizeof(neighbourhoodOption),
+			 " -D NEIGHBOURHOOD=0x%03X", neighbourhood);
+	kernelBuildOptions.append(neighbourhoodOption);
+	
+	/* Rule is baked into the kernel as bitmasks */
+	char ruleOption[64];
+	snprintf(ruleOption, sizeof(ruleOption),
+			 " -D BIRTH_MASK=0x%03X -D SURVIVE_MASK=0x%03X", birthRule, survivalRule);
+	kernelBuildOptions.append(ruleOption);
+	
+	/* Cells per byte of packed boards are fixed at compile time */
+	if (isMultiState()) {
+		char cellBits[32];
+		snprintf(cellBits, sizeof(cellBits), " -D CELL_BITS=%i", GenerationsBoard::bitsPerCell(states));
+		kernelBuildOptions.append(cellBits);
+	}
+	
+	const string options = kernelBuildOptions;
+	deviceThread = thread([this, options] {
+		ScopedTimer timer(deviceStartTime);
+		deviceStatus = setupContext(options);
+	});
+}
+
+void GameOfLife::joinDevice() {
+	if (!deviceThread.joinable())
+		return;
+	ScopedTimer timer(deviceWaitTime);
+	deviceThread.join();
+}
+
 int GameOfLife::setupHost() {
+	/* Two-state buffers in one arena, with room behind them for a pattern up to the board size */
+	const size_t pixels = (size_t)imageSize[0]*imageSize[1];
+	size_t arenaBytes = BoardArena::align(RULES_MAX_BYTES) + 3*BoardArena::align(4*pixels)
+		+ 2*BoardArena::align((size_t)(imageSize[0]+2)*(imageSize[1]+2));
+	if (spawnMode) arenaBytes += BoardArena::align(4*pixels) + BoardArena::align(pixels);
+	if (arena.reserve(arenaBytes) != 0)
+		return -1;
+	rules = NULL;
+	updateRules();
+	
+	/* Read population from file, this may change the rule */
+	if (spawnMode && readPopulation() != 0) return -1;
+	
 	rowPitch = imageSize[0]*sizeof(char)*4;
 	imageSizeBytes = imageSize[1]*rowPitch;
-	origin[0]=0;
-	origin[1]=0;
+	/* Board starts behind the ghost border of device images */
+	origin[0]=1;
+	origin[1]=1;
 	origin[2]=0;
 	region[0]=imageSize[0];
 	region[1]=imageSize[1];
 	region[2]=1;
 	
-	startingImage = (unsigned char *)malloc(imageSizeBytes);
-	if (startingImage == NULL)
-		return -1;
-	
-	imageA = (unsigned char *)malloc(imageSizeBytes);
+	/* RGBA image for OpenGL output */
+	imageA = (unsigned char *)arena.allocate(imageSizeBytes);
 	if (imageA == NULL)
 		return -1;
 	
-	imageB = (unsigned char *)malloc(imageSizeBytes);
-	if (imageB == NULL)
-		return -1;
+	if (isMultiState()) {
+		/* Multi-state rules calculate on packed boards only */
+		if (board.setup(imageSize[0], imageSize[1], states, topology) != 0)
+			return -1;
+	} else {
+		startingImage = (unsigned char *)arena.allocate(imageSizeBytes);
+		if (startingImage == NULL)
+			return -1;
 		
-	/* Read population from file */
-	if (spawnMode && readPopulation() != 0) return -1;
+		imageB = (unsigned char *)arena.allocate(imageSizeBytes);
+		if (imageB == NULL)
+			return -1;
+		
+		/* Live cells of the pixel engine with a ghost border, cleared by firstTouch() */
+		ghostPitch = imageSize[0] + 2;
+		for (int i = 0; i < 2; i++) {
+			ghostCells[i] = (unsigned char *)arena.allocate((size_t)ghostPitch*(imageSize[1]+2));
+			if (ghostCells[i] == NULL)
+				return -1;
+		}
+	}
+	
+	/* Pages kept from an earlier setup are faulted in again by firstTouch() */
+	unsigned char *boardEnd = isMultiState() ? imageA + imageSizeBytes
+		: ghostCells[1] + (size_t)ghostPitch*(imageSize[1]+2);
+	arena.discard(imageA, boardEnd - imageA);
+	
+	/* Workers of the pixel engine place their bands before anything else writes them */
+	if (bands.setup(imageSize[1], (isMultiState() || cpuEngine) ? 1 : threads) != 0)
+		return -1;
+	firstTouch();
+	if (!isMultiState() && !cpuEngine
+		&& scheduler.setup(imageSize[0], imageSize[1], topology != TOPOLOGY_PLANE, bands) != 0)
+		return -1;
 	
 	/* Spawn initial population */
 	if (spawnPopulation() != 0) return -1;
 	
+	/* Setup alternative CPU engine */
+	if (cpuEngine) {
+		if (isMultiState()) {
+			cerr << "CPU engine " << cpuEngine->getName()
+				 << " does not support multi-state rules" << endl;
+			return -1;
+		}
+		if (cpuEngine->setup(imageSize[0], imageSize[1], topology) != 0) {
+			cerr << "CPU engine " << cpuEngine->getName()
+				 << " cannot be used for a board of " << imageSize[0]
+				 << "x" << imageSize[1] << " with topology " << topologyName(topology) << endl;
+			return -1;
+		}
+		if (cpuEngine->setRules(rules, neighbourhood) != 0) {
+			cerr << "CPU engine " << cpuEngine->getName()
+				 << " does not support rule " << humanRules << endl;
+			return -1;
+		}
+		cpuEngine->load(imageA);
+	} else if (!isMultiState()) {
+		loadGhostCells(imageA);
+	}
+	
 	return 0;
 }
 
 int GameOfLife::readPopulation() {
 	/* Parse file */
+	unsigned long long parseStart = metricsNow();
 	int status = patternFile.parse();
+	parseTime->record(metricsNow() - parseStart);
 	if (status != 0) {
 		switch (status) {
 			default: cerr << "Pattern file parse error\n" << endl; break;
@@ -100,31 +297,27 @@ int GameOfLife::readPopulation() {
 	}
 	
 	/* Overwrite rule if specified in file, else skip */
+	applyPatternRule();
+	
+	return 0;
+}
+
+void GameOfLife::applyPatternRule() {
+	if (!patternFile.isRuleSpecified())
+		return;
+	
 	vector<int> birthRules = patternFile.getBirthRules();
 	vector<int> survivalRules = patternFile.getSurvivalRules();
-	if (birthRules.size() > 0 && survivalRules.size() > 0) {
-		/* Reset rule definitions */
-		memset(rules,0,18);
-		humanRules.clear();
-		
-		/* Write new definitions */
-		char numChar[2];
-		humanRules.push_back('S');
-		for (unsigned int i = 0; i < survivalRules.size(); i++) {
-			rules[9+survivalRules.at(i)] = 255;
-			snprintf(numChar,2,"%i",survivalRules.at(i));
-			humanRules.push_back(numChar[0]);
-		}
-		humanRules.push_back('/');
-		humanRules.push_back('B');
-		for (unsigned int i = 0; i < birthRules.size(); i++) {
-			rules[birthRules.at(i)] = 255;
-			snprintf(numChar,2,"%i",birthRules.at(i));
-			humanRules.push_back(numChar[0]);
-		}
-	}
 	
-	return 0;
+	birthRule = 0;
+	survivalRule = 0;
+	for (unsigned int i = 0; i < survivalRules.size(); i++)
+		survivalRule |= 1 << survivalRules.at(i);
+	for (unsigned int i = 0; i < birthRules.size(); i++)
+		birthRule |= 1 << birthRules.at(i);
+	states = patternFile.getNumberOfStates();
+	neighbourhood = patternFile.getNeighbourhood();
+	updateRules();
 }
 
 int GameOfLife::spawnPopulation() {
@@ -136,19 +329,26 @@ int GameOfLife::spawnPopulation() {
 }
 
 int GameOfLife::spawnRandomPopulation() {
+	/* Generator of this game only, so games can be set up in parallel */
+	std::minstd_rand generator(seed != 0 ? seed : (unsigned int)time(NULL));
 	int random;
-	srand(time(NULL));
 	for (int x = 0; x < imageSize[0]; x++) {
 		for (int y = 0; y < imageSize[1]; y++) {
-			random = rand() % 100;
-			if ((float)random / 100.0f < population)
-				setState(x, y, ALIVE, startingImage);
+			random = generator() % 100;
+			bool alive = (float)random / 100.0f < population;
+			if (isMultiState())
+				board.setStartingState(x, y, alive ? FIRING : 0);
 			else
-				setState(x, y, DEAD, startingImage);
+				setState(x, y, alive ? ALIVE : DEAD, startingImage);
 		}
 	}
 	
-	memcpy(imageA, startingImage, imageSizeBytes);
+	if (isMultiState()) {
+		board.reset();
+		board.toImage(imageA);
+	} else {
+		memcpy(imageA, startingImage, imageSizeBytes);
+	}
 	
 	return 0;
 }
@@ -167,6 +367,22 @@ int GameOfLife::spawnStaticPopulation() {
 	/* Spawn pattern in the center of the image */
 	int topLeft[2] = {imageSize[0]/2-patternWidth/2,
 					  imageSize[1]/2-patternHeight/2};
+	
+	if (isMultiState()) {
+		/* Packed board is initialised with dead cells */
+		unsigned char *patternStates = patternFile.getStates();
+		for (int y = 0; y < patternHeight; y++) {
+			for (int x = 0; x < patternWidth; x++) {
+				unsigned char state = patternStates[x + patternWidth*y];
+				board.setStartingState(topLeft[0]+x, topLeft[1]+y,
+									   state < states ? state : 0);
+			}
+		}
+		board.reset();
+		board.toImage(imageA);
+		return 0;
+	}
+	
 	/* counter for copied pattern lines */
 	int copyLine = 0;
 	
@@ -180,7 +396,8 @@ int GameOfLife::spawnStaticPopulation() {
 				memcpy(&(startingImage[4*x + (4*imageSize[0]*y)]),
 				       &((patternFile.getPattern())[4*patternWidth*copyLine]),
 					   4*patternWidth*sizeof(char));
-				x += patternWidth;
+				/* Continue right after the pattern line */
+				x += patternWidth - 1;
 				copyLine++;
 			} else {
 				setState(x, y, DEAD, startingImage);
@@ -194,9 +411,8 @@ int GameOfLife::spawnStaticPopulation() {
 	return 0;
 }
 
-int GameOfLife::setupDevice(void) {
+int GameOfLife::setupContext(const string &options) {
 	cl_int status = CL_SUCCESS;
-	const char *kernelFile = "kernels.cl";
 	KernelFile kernels;
 	
 	/*
@@ -246,7 +462,7 @@ int GameOfLife::setupDevice(void) {
 	assert(status == CL_SUCCESS);
 	
 	devices = (cl_device_id *)malloc(deviceListSize);
-	assert(devices > 0);
+	assert(devices != NULL);
 	
 	/* Get the device list data */
 	status = clGetContextInfo(context, CL_CONTEXT_DEVICES, deviceListSize, devices, NULL);
@@ -269,29 +485,10 @@ int GameOfLife::setupDevice(void) {
 	assert(status == CL_SUCCESS);
 	
 	/**
-	* Allocate device memory
-	*/
-	cl_image_format format;
-	format.image_channel_order = CL_RGBA;
-	format.image_channel_data_type = CL_UNSIGNED_INT8;
-	// imageA (texture memory)
-	deviceImageA = clCreateImage2D(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
-		&format, imageSize[0], imageSize[1], rowPitch, imageA, &status);
-	assert(status == CL_SUCCESS);
-	// imageB (texture memory)
-	deviceImageB = clCreateImage2D(context, CL_MEM_READ_WRITE,
-		&format, imageSize[0], imageSize[1], 0, NULL, &status);
-	assert(status == CL_SUCCESS);
-	// rules (constant memory)
-	deviceRules = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
-			rulesSizeBytes, rules, &status);
-	assert(status == CL_SUCCESS);
-	
-	/**
-	* Load kernel file, build program and create kernel
+	* Load kernel file and build program
 	*/
 	/* Read in the OpenCL kernel from the source file */
-	if (!kernels.open(kernelFile)) {
+	if (!kernels.open(kernelFile.c_str())) {
 		cerr << "Could not load CL source code from file " << kernelFile << endl;
 		return -1;
 	}
@@ -301,7 +498,7 @@ int GameOfLife::setupDevice(void) {
 	program = clCreateProgramWithSource(context, 1, &source,sourceSize, &status);
 	
 	/* Create a OpenCL program executable for all the devices specified */
-	status = clBuildProgram(program, 1, devices, kernelBuildOptions.c_str(), NULL, NULL);
+	status = clBuildProgram(program, 1, devices, options.c_str(), NULL, NULL);
 	
 	if (status != CL_SUCCESS) {
 		/* if clBuildProgram failed get the build log for the first device */
@@ -323,14 +520,74 @@ int GameOfLife::setupDevice(void) {
 		return -1;
 	}
 	
+	return 0;
+}
+
+int GameOfLife::setupDevice(void) {
+	cl_int status = CL_SUCCESS;
+	
+	/**
+	* Allocate device memory
+	*/
+	cl_image_format format;
+	format.image_channel_order = CL_RGBA;
+	format.image_channel_data_type = CL_UNSIGNED_INT8;
+	if (isMultiState()) {
+		// packed boards (global memory)
+		deviceImageA = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+			board.getSizeBytes(), board.getCells(), &status);
+		assert(status == CL_SUCCESS);
+		deviceImageB = clCreateBuffer(context, CL_MEM_READ_WRITE,
+			board.getSizeBytes(), NULL, &status);
+		assert(status == CL_SUCCESS);
+	} else {
+		// imageA (texture memory) with ghost border, uploaded once the kernels exist
+		deviceImageA = clCreateImage2D(context, CL_MEM_READ_WRITE,
+			&format, imageSize[0]+2, imageSize[1]+2, 0, NULL, &status);
+		assert(status == CL_SUCCESS);
+		// imageB (texture memory) with ghost border
+		deviceImageB = clCreateImage2D(context, CL_MEM_READ_WRITE,
+			&format, imageSize[0]+2, imageSize[1]+2, 0, NULL, &status);
+		assert(status == CL_SUCCESS);
+	}
+	// staging buffers (pinned host memory)
+	stagingBytes = isMultiState() ? board.getSizeBytes() : imageSizeBytes;
+	for (int i = 0; i < STAGING_BUFFERS; i++) {
+		staging[i] = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
+			stagingBytes, NULL, &status);
+		assert(status == CL_SUCCESS);
+	}
+	// rules (constant memory)
+	deviceRules = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+			rulesSizeBytes, rules, &status);
+	assert(status == CL_SUCCESS);
+	
 	/* Get a kernel object handle for the specified kernel */
-	kernel = clCreateKernel(program, "nextGeneration", &status);
+	kernel = clCreateKernel(program,
+		isMultiState() ? "nextGenerationMultiState" : "nextGeneration", &status);
 	assert(status == CL_SUCCESS);
+	if (!isMultiState()) {
+		densityKernel = clCreateKernel(program, "densityLevel", &status);
+		assert(status == CL_SUCCESS);
+		ghostCopyKernel = clCreateKernel(program, "copyGhostBorder", &status);
+		assert(status == CL_SUCCESS);
+	}
 	
-	/* Set kernel arguments */
+	/* Set kernel arguments, the topology is only known at runtime */
+	cl_int topologyArg = topology;
 	status |= clSetKernelArg(kernel, 0, sizeof(cl_mem), (void *)&deviceImageA);
 	status |= clSetKernelArg(kernel, 1, sizeof(cl_mem), (void *)&deviceImageB);
 	status |= clSetKernelArg(kernel, 2, sizeof(cl_mem), (void *)&deviceRules);
+	if (isMultiState()) {
+		cl_int boardDim[2] = {imageSize[0], imageSize[1]};
+		cl_uint rowBytes = board.getRowBytes();
+		status |= clSetKernelArg(kernel, 3, 2*sizeof(cl_int), (void *)boardDim);
+		status |= clSetKernelArg(kernel, 4, sizeof(cl_uint), (void *)&rowBytes);
+		status |= clSetKernelArg(kernel, 5, sizeof(cl_int), (void *)&topologyArg);
+	} else {
+		status |= clSetKernelArg(kernel, 3, sizeof(cl_int), (void *)&topologyArg);
+		status |= clSetKernelArg(ghostCopyKernel, 2, sizeof(cl_int), (void *)&topologyArg);
+	}
 	assert(status == CL_SUCCESS);
 	
 	/* Set optimal values for local and global threads */
@@ -347,12 +604,20 @@ int GameOfLife::setupDevice(void) {
 	localThreads[1] = optWorkGroupSize[1];
 	assert(maxWorkGroupSize >= (localThreads[0] * localThreads[1]));
 	
-	int r1 = imageSize[0] % localThreads[0];
-	int r2 = imageSize[1] % localThreads[1];
-	globalThreads[0] = (r1 == 0) ? imageSize[0] : imageSize[0] + localThreads[0] - r1;
-	globalThreads[1] = (r2 == 0) ? imageSize[1] : imageSize[1] + localThreads[1] - r2;
+	/*
+	 * Multi-state kernel calculates one packed byte per work-item,
+	 * the image kernel one cell of the board or its ghost border
+	 */
+	int threadsX = isMultiState() ? (int)board.getRowBytes() : imageSize[0]+2;
+	int threadsY = isMultiState() ? imageSize[1] : imageSize[1]+2;
+	int r1 = threadsX % localThreads[0];
+	int r2 = threadsY % localThreads[1];
+	globalThreads[0] = (r1 == 0) ? threadsX : threadsX + localThreads[0] - r1;
+	globalThreads[1] = (r2 == 0) ? threadsY : threadsY + localThreads[1] - r2;
 	
 	char threads[32];
+	kernelInfo.append("topology: ");
+	kernelInfo.append(topologyName(topology));
 	kernelInfo.append(" | blocks: ");
 	snprintf(threads,countDigits(globalThreads[0]/localThreads[0])+1,"%i",(int)globalThreads[0]/(int)localThreads[0]);
 	kernelInfo.append(threads);
@@ -366,27 +631,334 @@ int GameOfLife::setupDevice(void) {
 	snprintf(threads,countDigits(localThreads[1])+1,"%i",(int)localThreads[1]);
 	kernelInfo.append(threads);
 	
+	/* Starting population with its ghost border */
+	if (!isMultiState()) uploadImage(imageA);
+	
+	return 0;
+}
+
+int GameOfLife::nextGeneration(unsigned char *frame) {
+	if (CPUMode) return nextGenerationCPU(frame);
+	else return nextGenerationOpenCL(frame);
+}
+
+int GameOfLife::getFrame(unsigned char *frame) {
+	ScopedTimer timer(readbackTime);
+	if (!CPUMode && !isMultiState() && frameView.level > 0) {
+		/* Only the texels of the frame are read from the device */
+		enqueueDensityFrame(switchImages ? deviceImageA : deviceImageB, frame, CL_TRUE, NULL);
+		return 0;
+	}
+	
+	if (!CPUMode) {
+		/* Read current generation from device */
+		unsigned char *mapped = mapStaging(switchImages ? deviceImageA : deviceImageB,
+										   CL_TRUE, NULL, NULL);
+		if (isMultiState()) {
+			memcpy(board.getCells(), mapped, board.getSizeBytes());
+			packHostFrame(frame);
+		} else {
+			packHostFrame(frame, mapped);
+		}
+		unmapStaging(mapped);
+		return 0;
+	}
+	packHostFrame(frame);
 	return 0;
 }
 
-int GameOfLife::nextGeneration(unsigned char *bufferImage) {
-	if (CPUMode) return nextGenerationCPU(bufferImage);
-	else return nextGenerationOpenCL(bufferImage);
+unsigned char * GameOfLife::mapStaging(cl_mem source, cl_bool blocking,
+									   cl_event *copyEvent, cl_event *mapEvent) {
+	cl_mem buffer = staging[nextStaging];
+	mappedStaging = nextStaging;
+	nextStaging = (nextStaging + 1) % STAGING_BUFFERS;
+	
+	cl_int status;
+	cl_event event;
+	unsigned long long queued = metricsNow();
+	if (isMultiState())
+		status = clEnqueueCopyBuffer(commandQueue, source, buffer,
+			0, 0, stagingBytes, 0, NULL, copyEvent ? copyEvent : traceEvent(event));
+	else
+		status = clEnqueueCopyImageToBuffer(commandQueue, source, buffer,
+			origin, region, 0, 0, NULL, copyEvent ? copyEvent : traceEvent(event));
+	assert(status == CL_SUCCESS);
+	if (copyEvent == NULL) traceCommand("copy to staging", event, queued);
+	
+	/* Mapping a pinned buffer does not copy again */
+	queued = metricsNow();
+	unsigned char *mapped = (unsigned char *)clEnqueueMapBuffer(commandQueue, buffer,
+		blocking, CL_MAP_READ, 0, stagingBytes, 0, NULL,
+		mapEvent ? mapEvent : traceEvent(event), &status);
+	assert(status == CL_SUCCESS);
+	if (mapEvent == NULL) traceCommand("map staging", event, queued);
+	return mapped;
+}
+
+void GameOfLife::unmapStaging(unsigned char *mapped) {
+	cl_int status = clEnqueueUnmapMemObject(commandQueue, staging[mappedStaging],
+		mapped, 0, NULL, NULL);
+	assert(status == CL_SUCCESS);
 }
 
-int GameOfLife::nextGenerationOpenCL(unsigned char *bufferImage) {
+void GameOfLife::writeStaging(const unsigned char *host, cl_mem destination) {
+	cl_mem buffer = staging[nextStaging];
+	nextStaging = (nextStaging + 1) % STAGING_BUFFERS;
+	
+	cl_int status;
+	unsigned char *mapped = (unsigned char *)clEnqueueMapBuffer(commandQueue, buffer,
+		CL_TRUE, CL_MAP_WRITE, 0, stagingBytes, 0, NULL, NULL, &status);
+	assert(status == CL_SUCCESS);
+	memcpy(mapped, host, stagingBytes);
+	status = clEnqueueUnmapMemObject(commandQueue, buffer, mapped, 0, NULL, NULL);
+	
+	/* Later kernels of the in-order queue wait for the copy */
+	cl_event event;
+	unsigned long long queued = metricsNow();
+	if (isMultiState())
+		status |= clEnqueueCopyBuffer(commandQueue, buffer, destination,
+			0, 0, stagingBytes, 0, NULL, traceEvent(event));
+	else
+		status |= clEnqueueCopyBufferToImage(commandQueue, buffer, destination,
+			0, origin, region, 0, NULL, traceEvent(event));
+	assert(status == CL_SUCCESS);
+	traceCommand("copy from staging", event, queued);
+}
+
+void GameOfLife::uploadImage(const unsigned char *image) {
+	cl_mem current = switchImages ? deviceImageA : deviceImageB;
+	cl_mem other = switchImages ? deviceImageB : deviceImageA;
+	
+	/* Board goes to the other image, copying it back fills the ghost border */
+	writeStaging(image, other);
+	cl_int status = clSetKernelArg(ghostCopyKernel, 0, sizeof(cl_mem), (void *)&other);
+	status |= clSetKernelArg(ghostCopyKernel, 1, sizeof(cl_mem), (void *)&current);
+	cl_event event;
+	unsigned long long queued = metricsNow();
+	status |= clEnqueueNDRangeKernel(commandQueue, ghostCopyKernel, 2, NULL,
+		globalThreads, localThreads, 0, NULL, traceEvent(event));
+	assert(status == CL_SUCCESS);
+	traceCommand("ghost border", event, queued);
+}
+
+/**
+* Count live and firing cells, the only ones with full colour.
+* @param image RGBA image
+* @param sizeBytes size of image in bytes
+* @return number of cells
+*/
+static long countAlive(const unsigned char *image, size_t sizeBytes) {
+	long count = 0;
+	for (size_t i = 0; i < sizeBytes; i += 4)
+		count += image[i] == ALIVE;
+	return count;
+}
+
+int GameOfLife::step(unsigned long n) {
+	if (CPUMode) {
+		for (unsigned long i = 0; i < n; i++)
+			calculateGenerationCPU();
+		return 0;
+	}
+	
+	/* Kernels of a batch run back to back, the in-order queue keeps them apart */
+	cl_event events[STEP_BATCH];
+	unsigned long long queued[STEP_BATCH];
+	while (n > 0) {
+		int batch = (int)min(n, (unsigned long)STEP_BATCH);
+		for (int i = 0; i < batch; i++) {
+			queued[i] = metricsNow();
+			cl_int status = clEnqueueNDRangeKernel(commandQueue, kernel, 2, NULL,
+				globalThreads, localThreads, 0, NULL, &events[i]);
+			assert(status == CL_SUCCESS);
+			exchangeDeviceImages();
+			switchImages = !switchImages;
+		}
+		clWaitForEvents(1, &events[batch-1]);
+		
+		/* Record kernel execution time of every generation */
+		for (int i = 0; i < batch; i++) {
+			cl_ulong start, end;
+			cl_int status = clGetEventProfilingInfo(events[i],
+				CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL);
+			status |= clGetEventProfilingInfo(events[i],
+				CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+			assert(status == CL_SUCCESS);
+			generationTime->record(end - start);
+			getTrace().addDeviceCommand("generation", events[i], queued[i]);
+			clReleaseEvent(events[i]);
+		}
+		
+		generations += batch;
+		generationCounter->add(batch);
+		n -= batch;
+	}
+	return 0;
+}
+
+void GameOfLife::exchangeDeviceImages() {
+	cl_int status = clSetKernelArg(kernel,
+				0, sizeof(cl_mem),
+				switchImages ? (void *)&deviceImageB : (void *)&deviceImageA );
+	status |= clSetKernelArg(kernel,
+				1, sizeof(cl_mem),
+				switchImages ? (void *)&deviceImageA : (void *)&deviceImageB );
+	assert(status == CL_SUCCESS);
+}
+
+int GameOfLife::getRegion(int x, int y, int width, int height, unsigned char *states) {
+	if (x < 0 || y < 0 || width <= 0 || height <= 0
+		|| x + width > imageSize[0] || y + height > imageSize[1])
+		return -1;
+	
+	ScopedTimer timer(readbackTime);
+	cl_int status = CL_SUCCESS;
+	cl_event event;
+	unsigned long long queued = metricsNow();
+	if (isMultiState()) {
+		/* Rows of the rectangle into the same rows of the host board */
+		if (!CPUMode) {
+			size_t offset = y * board.getRowBytes();
+			status = clEnqueueReadBuffer(commandQueue,
+				switchImages ? deviceImageA : deviceImageB, CL_TRUE,
+				offset, height * board.getRowBytes(), board.getCells() + offset,
+				0, NULL, traceEvent(event));
+			assert(status == CL_SUCCESS);
+			traceCommand("read board", event, queued);
+		}
+		for (int j = 0; j < height; j++)
+			for (int i = 0; i < width; i++)
+				states[i + width*j] = board.getCellState(x + i, y + j);
+		return 0;
+	}
+	
+	const unsigned char *image = imageA;
+	if (!CPUMode) {
+		/* Rectangle into the same pixels of imageA */
+		size_t regionOrigin[3] = {origin[0] + x, origin[1] + y, 0};
+		size_t regionSize[3] = {(size_t)width, (size_t)height, 1};
+		status = clEnqueueReadImage(commandQueue,
+			switchImages ? deviceImageA : deviceImageB, CL_TRUE,
+			regionOrigin, regionSize, rowPitch, 0, imageA + 4*x + rowPitch*y,
+			0, NULL, traceEvent(event));
+		assert(status == CL_SUCCESS);
+		traceCommand("read image", event, queued);
+	} else if (cpuEngine) {
+		cpuEngine->store(imageA);
+	} else {
+		image = switchImages ? imageA : imageB;
+	}
+	for (int j = 0; j < height; j++)
+		for (int i = 0; i < width; i++)
+			states[i + width*j] = getState(x + i, y + j, image) == ALIVE;
+	return 0;
+}
+
+long GameOfLife::countLiveCells() {
+	if (liveCells < 0 || liveCellsGeneration != generations) {
+		liveCells = countAlive(readHostImage(), imageSizeBytes);
+		liveCellsGeneration = generations;
+	}
+	return liveCells;
+}
+
+const unsigned char * GameOfLife::readHostImage() {
+	ScopedTimer timer(readbackTime);
+	if (!CPUMode) {
+		unsigned char *mapped = mapStaging(switchImages ? deviceImageA : deviceImageB,
+										   CL_TRUE, NULL, NULL);
+		memcpy(isMultiState() ? board.getCells() : imageA, mapped, stagingBytes);
+		unmapStaging(mapped);
+	}
+	
+	if (isMultiState()) {
+		board.toImage(imageA);
+	} else if (CPUMode && cpuEngine) {
+		cpuEngine->store(imageA);
+	} else if (CPUMode) {
+		return switchImages ? imageA : imageB;
+	}
+	return imageA;
+}
+
+void GameOfLife::packHostFrame(unsigned char *frame, const unsigned char *image) {
+	ScopedTimer timer(packTime);
+	if (image == NULL) {
+		image = imageA;
+		if (isMultiState()) {
+			board.toImage(imageA);
+		} else if (CPUMode && cpuEngine) {
+			cpuEngine->store(imageA);
+		} else if (CPUMode) {
+			image = switchImages ? imageA : imageB;
+		}
+	}
+	packFrame(image, imageSize[0], imageSize[1], frameView, frame);
+	
+	if (countingLiveCells) {
+		liveCells = countAlive(image, imageSizeBytes);
+		liveCellsGeneration = generations;
+	}
+}
+
+void GameOfLife::enqueueDensityFrame(cl_mem image, unsigned char *frame,
+									 cl_bool blocking, cl_event *event) {
+	cl_int status = CL_SUCCESS;
+	size_t texelBytes = frameSizeBytes(frameView) - sizeof(FrameView);
+	memcpy(frame, &frameView, sizeof(FrameView));
+	
+	/* Grow device buffer for texels */
+	if (texelBytes > deviceFrameBytes) {
+		if (deviceFrame) clReleaseMemObject(deviceFrame);
+		deviceFrame = clCreateBuffer(context, CL_MEM_WRITE_ONLY, texelBytes, NULL, &status);
+		assert(status == CL_SUCCESS);
+		deviceFrameBytes = texelBytes;
+	}
+	
+	cl_int level = frameView.level;
+	cl_int texelOrigin[2] = {frameView.origin[0], frameView.origin[1]};
+	cl_int texelSize[2] = {frameView.size[0], frameView.size[1]};
+	status |= clSetKernelArg(densityKernel, 0, sizeof(cl_mem), (void *)&image);
+	status |= clSetKernelArg(densityKernel, 1, sizeof(cl_mem), (void *)&deviceFrame);
+	status |= clSetKernelArg(densityKernel, 2, sizeof(cl_int), (void *)&level);
+	status |= clSetKernelArg(densityKernel, 3, 2*sizeof(cl_int), (void *)texelOrigin);
+	status |= clSetKernelArg(densityKernel, 4, 2*sizeof(cl_int), (void *)texelSize);
+	assert(status == CL_SUCCESS);
+	
+	size_t texels[2] = {(size_t)frameView.size[0], (size_t)frameView.size[1]};
+	cl_event densityEvent, readEvent;
+	unsigned long long queued = metricsNow();
+	status = clEnqueueNDRangeKernel(commandQueue, densityKernel, 2, NULL,
+		texels, NULL, 0, NULL, traceEvent(densityEvent));
+	traceCommand("density", densityEvent, queued);
+	
+	/* Reads with an event of the caller are traced by the caller */
+	queued = metricsNow();
+	status |= clEnqueueReadBuffer(commandQueue, deviceFrame, blocking,
+		0, texelBytes, frame + sizeof(FrameView), 0, NULL,
+		event ? event : traceEvent(readEvent));
+	assert(status == CL_SUCCESS);
+	if (event == NULL) traceCommand("read density", readEvent, queued);
+}
+
+int GameOfLife::nextGenerationOpenCL(unsigned char *frame) {
 	cl_int status = CL_SUCCESS;
 	cl_event kernelEvent = NULL;
-	cl_event copyEvent = NULL;
+	cl_event copyEvent = NULL;		/* frame can be read on the host */
+	cl_event stagingEvent = NULL;	/* copy into a staging buffer */
+	unsigned char *mapped = NULL;
 	cl_int copyFinished;
+	unsigned long long kernelQueued, copyQueued = 0;
 	generationsPerCopyEvent = 0;
 	
 	/* 
 	 * Calculate next generations until copying the first
-	 * generation from device to host has finished
+	 * generation from device to host has finished,
+	 * or copy exactly the last of a fixed number of generations
 	 */
 	do {
 		/* Enqueue a kernel run call and wait for kernel to finish */
+		kernelQueued = metricsNow();
 		status = clEnqueueNDRangeKernel(commandQueue, kernel, 2, NULL,
 			globalThreads, localThreads, NULL, NULL, &kernelEvent);
 		clWaitForEvents(1, &kernelEvent);
@@ -396,109 +968,164 @@ int GameOfLife::nextGenerationOpenCL(unsigned char *bufferImage) {
 		/* Update generation counter */
 		generations++;
 		generationsPerCopyEvent++;
+		generationCounter->add();
 		
-		/* Calculate kernel execution time */
-		if (copyEvent == NULL) {
-			cl_ulong start, end;
-			
-			status |= clGetEventProfilingInfo(kernelEvent,
-				CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL);
-			
-			status |= clGetEventProfilingInfo(kernelEvent,
-				CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
-			assert(status == CL_SUCCESS);
-			
-			executionTime = (end - start) * 1.0e-6f;
-		}
+		/* Record kernel execution time of every generation */
+		cl_ulong start, end;
+		status |= clGetEventProfilingInfo(kernelEvent,
+			CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL);
+		status |= clGetEventProfilingInfo(kernelEvent,
+			CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+		assert(status == CL_SUCCESS);
+		generationTime->record(end - start);
+		getTrace().addDeviceCommand("generation", kernelEvent, kernelQueued);
 		clReleaseEvent(kernelEvent);
 		
 		/* Exchange images for current and next generation */
-		status |= clSetKernelArg(kernel,
-					0, sizeof(cl_mem),
-					switchImages ? (void *)&deviceImageB : (void *)&deviceImageA );
-		status |= clSetKernelArg(kernel,
-					1, sizeof(cl_mem),
-					switchImages ? (void *)&deviceImageA : (void *)&deviceImageB );
-		assert(status == CL_SUCCESS);
+		exchangeDeviceImages();
 		
 		/*
 		 * Update image on host for OpenGL output
 		 * This starts the copy event
 		 */
-		if (copyEvent == NULL) {
-			status |= clEnqueueReadImage(commandQueue,
-				switchImages ? deviceImageB : deviceImageA, readSync,
-				origin, region, rowPitch, 0, bufferImage,
-				NULL, NULL, &copyEvent);
-			assert(status == CL_SUCCESS);
+		if (copyEvent == NULL
+			&& (generationsPerFrame == 0 || generationsPerCopyEvent == generationsPerFrame)) {
+			copyQueued = metricsNow();
+			if (!isMultiState() && frameView.level > 0)
+				/* Zoomed out: only read the level of the density pyramid */
+				enqueueDensityFrame(switchImages ? deviceImageB : deviceImageA,
+					frame, readSync, &copyEvent);
+			else
+				/* Board to pinned memory, the next kernels overlap the copy */
+				mapped = mapStaging(switchImages ? deviceImageB : deviceImageA,
+					readSync, &stagingEvent, &copyEvent);
 		}
 		switchImages = !switchImages;
 		
 		/* Get status of copy event */
-		status = clGetEventInfo(
-			copyEvent, CL_EVENT_COMMAND_EXECUTION_STATUS,
-			sizeof(cl_int), &copyFinished,
-			NULL);
-		assert(status == CL_SUCCESS);
+		copyFinished = CL_QUEUED;
+		if (copyEvent != NULL) {
+			if (generationsPerFrame > 0) clWaitForEvents(1, &copyEvent);
+			status = clGetEventInfo(
+				copyEvent, CL_EVENT_COMMAND_EXECUTION_STATUS,
+				sizeof(cl_int), &copyFinished,
+				NULL);
+			assert(status == CL_SUCCESS);
+		}
 		
 	} while (copyFinished != CL_COMPLETE);
+	
+	/* Record time the device needed for the copy */
+	cl_ulong copyStart, copyEnd;
+	status = clGetEventProfilingInfo(stagingEvent ? stagingEvent : copyEvent,
+		CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &copyStart, NULL);
+	status |= clGetEventProfilingInfo(copyEvent,
+		CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &copyEnd, NULL);
+	assert(status == CL_SUCCESS);
+	readbackTime->record(copyEnd - copyStart);
+	if (stagingEvent) {
+		getTrace().addDeviceCommand("copy to staging", stagingEvent, copyQueued);
+		clReleaseEvent(stagingEvent);
+	}
+	getTrace().addDeviceCommand(mapped ? "map staging" : "read density", copyEvent, copyQueued);
 	clReleaseEvent(copyEvent);
 	
+	/* Pack cells read at full resolution into the frame */
+	if (isMultiState()) {
+		memcpy(board.getCells(), mapped, board.getSizeBytes());
+		packHostFrame(frame);
+	} else if (mapped) {
+		packHostFrame(frame, mapped);
+	}
+	if (mapped) unmapStaging(mapped);
+	
 	/* Single generation mode */
 	if (singleGen) switchPause();
 
 	return 0;
 }
 
-int GameOfLife::nextGenerationCPU(unsigned char *bufferImage) {
-	/* Start timer */
-	#ifdef WIN32
-		LARGE_INTEGER frequency;	/* ticks per second */
-		LARGE_INTEGER start;
-		LARGE_INTEGER end;
-		
-		QueryPerformanceFrequency(&frequency);
-		QueryPerformanceCounter(&start);
-	#else
-		timeval start;
-		timeval end;
+/**
+* Cell of a board with ghost border counted as neighbour,
+* cells next to the board are read from the border without bounds check.
+*/
+struct GhostCell {
+	const unsigned char *cells;
+	int pitch;
+	int operator()(const int x, const int y) const {
+		return cells[x + pitch*y];
+	}
+};
+
+void GameOfLife::loadGhostCells(const unsigned char *image) {
+	unsigned char *cells = ghostCells[0] + ghostPitch + 1;
+	for (int y = 0; y < imageSize[1]; y++)
+		for (int x = 0; x < imageSize[0]; x++)
+			cells[x + ghostPitch*y] = getState(x, y, image) >> 7;
+	fillGhostBorder(cells, ghostPitch, imageSize[0], imageSize[1], topology);
+	scheduler.invalidate();
+}
+
+void GameOfLife::firstTouch() {
+	bands.run([this](int begin, int end) {
+		const size_t first = rowPitch*begin, bytes = rowPitch*(end - begin);
+		memset(imageA + first, 0, bytes);
+		if (startingImage) memset(startingImage + first, 0, bytes);
+		if (imageB) memset(imageB + first, 0, bytes);
 		
-		gettimeofday(&start, NULL);
-	#endif
-	
-	unsigned char state;
-	int numberOfNeighbours, i;
+		/* Rows of the ghost border belong to the first and the last band */
+		const int top = (begin == 0) ? 0 : begin + 1;
+		const int bottom = (end == imageSize[1]) ? end + 2 : end + 1;
+		for (int i = 0; i < 2; i++)
+			if (ghostCells[i])
+				memset(ghostCells[i] + (size_t)ghostPitch*top, 0, (size_t)ghostPitch*(bottom - top));
+	});
+}
+
+template <unsigned int MASK, unsigned int RULE>
+void GameOfLife::nextGenerationPixels() {
+	unsigned char *next = switchImages?imageB:imageA;
+	GhostCell cell = {ghostCells[0] + ghostPitch + 1, ghostPitch};
+	unsigned char *nextCells = ghostCells[1] + ghostPitch + 1;
 	
-	/* Calculate next generation for each pixel */
-	for (int x = 0; x < imageSize[0]; x++) {
-		for (int y = 0; y < imageSize[1]; y++) {
-			numberOfNeighbours =
-				getNumberOfNeighbours(x, y, switchImages?imageA:imageB);
-			state = getState(x, y, switchImages?imageA:imageB);
-			
-			i = numberOfNeighbours + 9*(state >> 7);
-			setState(x, y, rules[i], switchImages?imageB:imageA);
+	/* Every cell has all neighbours inside the padded board, tiles of the own band come first */
+	scheduler.run(bands, [&](int left, int top, int right, int bottom) {
+		/* Locals, as stores to the image may alias every member */
+		const GhostCell source = cell;
+		unsigned char *const image = next, *const target = nextCells;
+		const unsigned char *const table = rules;
+		const int pitch = ghostPitch;
+		const size_t imagePitch = rowPitch;
+		const unsigned int mask = neighbourhood;
+		unsigned char changed = 0;
+		for (int y = top; y < bottom; y++) {
+			for (int x = left; x < right; x++) {
+				const unsigned char alive = source(x, y);
+				int numberOfNeighbours = countNeighbours<MASK>(source, x, y, mask);
+				unsigned char state = nextState<RULE>(numberOfNeighbours, alive, table);
+				unsigned char *pixel = image + 4*x + imagePitch*y;
+				pixel[0] = pixel[1] = pixel[2] = state;
+				pixel[3] = 1;
+				target[x + pitch*y] = state >> 7;
+				changed |= (state >> 7) ^ alive;
+			}
 		}
-	}
-	
-	/* Stop timer and calculate execution time for one generation */
-	#ifdef WIN32
-		QueryPerformanceCounter(&end);
-		executionTime = endCount.QuadPart * (1000.0f / frequency.QuadPart)
-						- startCount.QuadPart * (1000.0f / frequency.QuadPart);
-	#else
-		gettimeofday(&end, NULL);
-		executionTime = (float)(end.tv_sec - start.tv_sec) * 1000.0f
-						+ (float)(end.tv_usec - start.tv_usec) / 1000.0f;
-	#endif
-	
-	/* Update generation counter */
-	generations++;
+		return changed != 0;
+	});
 	
-	/* Update image for OpenGL output directly on the mapped buffer */
-	memcpy(bufferImage, switchImages?imageB:imageA, imageSizeBytes);
+	/* Border-fill pass implements the topology */
+	fillGhostBorder(nextCells, ghostPitch, imageSize[0], imageSize[1], topology);
+	swap(ghostCells[0], ghostCells[1]);
+}
+
+int GameOfLife::nextGenerationCPU(unsigned char *frame) {
+	/* Calculate a fixed number of generations or a single one */
+	int steps = max(generationsPerFrame, 1);
+	for (int step = 0; step < steps; step++)
+		calculateGenerationCPU();
 	
-	switchImages = !switchImages;
+	/* Update frame for OpenGL output */
+	packHostFrame(frame);
 	
 	/* Single generation mode */
 	if (singleGen) switchPause();
@@ -506,50 +1133,98 @@ int GameOfLife::nextGenerationCPU(unsigned char *bufferImage) {
 	return 0;
 }
 
-int GameOfLife::getNumberOfNeighbours(const int x, const int y, const unsigned char *image) {
-	int counter = 0;
-	int neighbourCoord[2];
-	
-	for (int i = -1; i <= 1; i++) {
-		for (int k = -1; k <= 1; k++) {
-			neighbourCoord[0] = x + i;
-			neighbourCoord[1] = y + k;
-			if (!((i == 0) && (k == 0))
-				&& (neighbourCoord[0] < imageSize[0])
-				&& (neighbourCoord[1] < imageSize[1])
-				&& (x + i > 0) && (y + k > 0))
-				{
-				if (getState(neighbourCoord[0], neighbourCoord[1], image) == ALIVE)
-					counter++;
+void GameOfLife::calculateGenerationCPU() {
+	/* Start timer */
+	ScopedTimer timer(generationTime);
+	
+	if (isMultiState()) {
+		/* Calculate next generation on the packed board */
+		board.nextGeneration(rules, neighbourhood);
+	} else if (cpuEngine) {
+		/* Calculate next generation with alternative engine */
+		cpuEngine->nextGeneration();
+	} else {
+		/* Calculate next generation for each pixel */
+		unsigned int rule = RULE_MASK(birthRule, survivalRule);
+		if (neighbourhood == NEIGHBOURHOOD_MOORE && rule == RULE_CONWAY) {
+			nextGenerationPixels<NEIGHBOURHOOD_MOORE, RULE_CONWAY>();
+		} else if (neighbourhood == NEIGHBOURHOOD_MOORE && rule == RULE_HIGHLIFE) {
+			nextGenerationPixels<NEIGHBOURHOOD_MOORE, RULE_HIGHLIFE>();
+		} else if (neighbourhood == NEIGHBOURHOOD_MOORE && rule == RULE_DAYNIGHT) {
+			nextGenerationPixels<NEIGHBOURHOOD_MOORE, RULE_DAYNIGHT>();
+		} else {
+			switch (neighbourhood) {
+			case NEIGHBOURHOOD_MOORE:
+				nextGenerationPixels<NEIGHBOURHOOD_MOORE, RULE_GENERIC>();
+				break;
+			case NEIGHBOURHOOD_VON_NEUMANN:
+				nextGenerationPixels<NEIGHBOURHOOD_VON_NEUMANN, RULE_GENERIC>();
+				break;
+			case NEIGHBOURHOOD_HEXAGONAL:
+				nextGenerationPixels<NEIGHBOURHOOD_HEXAGONAL, RULE_GENERIC>();
+				break;
+			default:
+				nextGenerationPixels<NEIGHBOURHOOD_CUSTOM, RULE_GENERIC>();
+				break;
 			}
 		}
 	}
 	
-	return counter;
+	/* Update generation counter */
+	generations++;
+	generationCounter->add();
+	
+	/* Next generation of the pixel engine becomes the current one */
+	if (!isMultiState() && !cpuEngine)
+		switchImages = !switchImages;
 }
 
-int GameOfLife::resetGame(unsigned char *bufferImage) {
+int GameOfLife::resetGame(unsigned char *frame) {
+	if (isMultiState()) {
+		board.reset();
+		generations = 0;
+		generationsPerCopyEvent = 0;
+		liveCells = -1;
+		switchImages = true;
+		packHostFrame(frame);
+		if (cpuOnly) return 0;
+		
+		cl_event event;
+		unsigned long long queued = metricsNow();
+		cl_int status = clEnqueueWriteBuffer(commandQueue,
+							deviceImageA, CL_TRUE, 0, board.getSizeBytes(),
+							board.getCells(), 0, NULL, traceEvent(event));
+		traceCommand("write board", event, queued);
+		status |= clSetKernelArg(kernel, 0, sizeof(cl_mem),(void *)&deviceImageA);
+		status |= clSetKernelArg(kernel, 1, sizeof(cl_mem),(void *)&deviceImageB);
+		assert(status == CL_SUCCESS);
+		return 0;
+	}
+	
 	/* Reset host */
 	memcpy(imageA, startingImage, imageSizeBytes);
+	if (cpuEngine) cpuEngine->load(startingImage);
+	else loadGhostCells(startingImage);
 	generations = 0;
 	generationsPerCopyEvent = 0;
-	executionTime = 0.0f;
+	liveCells = -1;
 	/* Reset device */
-	cl_int status = clEnqueueWriteImage(commandQueue,
-						deviceImageA, CL_TRUE, origin, region, rowPitch, 0,
-						startingImage, NULL, NULL, NULL);
-	status |= clSetKernelArg(kernel, 0, sizeof(cl_mem),(void *)&deviceImageA);
-	status |= clSetKernelArg(kernel, 1, sizeof(cl_mem),(void *)&deviceImageB);
-	assert(status == CL_SUCCESS);
-	
-	/* Update OpenGL buffer image */
-	memcpy(bufferImage, startingImage, imageSizeBytes);
-	
 	switchImages = true;
-	return 0;
+	if (!cpuOnly) {
+		uploadImage(startingImage);
+		cl_int status = clSetKernelArg(kernel, 0, sizeof(cl_mem),(void *)&deviceImageA);
+		status |= clSetKernelArg(kernel, 1, sizeof(cl_mem),(void *)&deviceImageB);
+		assert(status == CL_SUCCESS);
+	}
+	
+	/* Update frame for OpenGL output */
+	return getFrame(frame);
 }
 
 int GameOfLife::freeMem() {
+	/* Device setup may still run if the host failed */
+	joinDevice();
+	
 	/* Releases OpenCL resources */
 	cl_int status = CL_SUCCESS;
 	if (kernel) {
@@ -572,6 +1247,25 @@ int GameOfLife::freeMem() {
 		status = clReleaseMemObject(deviceRules);
 		assert(status == CL_SUCCESS);
 	}
+	if (densityKernel) {
+		status = clReleaseKernel(densityKernel);
+		assert(status == CL_SUCCESS);
+	}
+	if (ghostCopyKernel) {
+		status = clReleaseKernel(ghostCopyKernel);
+		assert(status == CL_SUCCESS);
+	}
+	if (deviceFrame) {
+		status = clReleaseMemObject(deviceFrame);
+		assert(status == CL_SUCCESS);
+	}
+	for (int i = 0; i < STAGING_BUFFERS; i++) {
+		if (staging[i]) {
+			status = clReleaseMemObject(staging[i]);
+			assert(status == CL_SUCCESS);
+			staging[i] = NULL;
+		}
+	}
 	if (commandQueue) {
 		status = clReleaseCommandQueue(commandQueue);
 		assert(status == CL_SUCCESS);
@@ -580,27 +1274,27 @@ int GameOfLife::freeMem() {
 		status = clReleaseContext(context);
 		assert(status == CL_SUCCESS);
 	}
+	kernel = densityKernel = ghostCopyKernel = NULL;
+	program = NULL;
+	deviceImageA = deviceImageB = deviceRules = deviceFrame = NULL;
+	commandQueue = NULL;
+	context = NULL;
 	
-	/* Release host resources */
-	if (startingImage) {
-		free(startingImage);
-		startingImage = 0;
-	}
-	if (imageA) {
-		free(imageA);
-		imageA = 0;
-	}
-	if (imageB) {
-		free(imageB);
-		imageB = 0;
-	}
+	/* Release host resources, the arena keeps its mapping for another setup */
+	startingImage = 0;
+	imageA = 0;
+	imageB = 0;
+	ghostCells[0] = ghostCells[1] = NULL;
+	rules = 0;
+	arena.clear();
 	if (devices) {
 		free(devices);
 		devices = 0;
 	}
-	if (rules) {
-		free(rules);
-		rules = 0;
+	board.freeMem();
+	if (cpuEngine) {
+		delete cpuEngine;
+		cpuEngine = 0;
 	}
 	
 	return 0;
@@ -0,0 +1,101 @@
+#include "../inc/GenerationsBoard.hpp"
+
+int GenerationsBoard::setup(int width, int height, int _states, int _topology) {
+	freeMem();
+
+	boardSize[0] = width;
+	boardSize[1] = height;
+	states = _states;
+	topology = _topology;
+	cellBits = bitsPerCell(states);
+
+	/* Every row starts on a byte boundary */
+	rowBytes = (width*cellBits + 7) / 8;
+	sizeBytes = rowBytes*height;
+
+	cells = (unsigned char *)calloc(sizeBytes, 1);
+	if (cells == NULL)
+		return -1;
+
+	next = (unsigned char *)calloc(sizeBytes, 1);
+	if (next == NULL)
+		return -1;
+
+	starting = (unsigned char *)calloc(sizeBytes, 1);
+	if (starting == NULL)
+		return -1;
+
+	return 0;
+}
+
+int GenerationsBoard::freeMem() {
+	if (cells) {
+		free(cells);
+		cells = 0;
+	}
+	if (next) {
+		free(next);
+		next = 0;
+	}
+	if (starting) {
+		free(starting);
+		starting = 0;
+	}
+
+	return 0;
+}
+
+int GenerationsBoard::FiringCell::operator()(int x, int y) const {
+	const int width = board->boardSize[0];
+	const int height = board->boardSize[1];
+	if (!ghostSource(board->topology, width, height, x, y)) return 0;
+	return board->getState(x, y, board->cells) == FIRING;
+}
+
+template <unsigned int MASK>
+void GenerationsBoard::nextGenerationMasked(const unsigned char *transition, unsigned int mask) {
+	/* Only firing cells are counted as neighbours */
+	FiringCell cell = {this};
+
+	for (int y = 0; y < boardSize[1]; y++) {
+		for (int x = 0; x < boardSize[0]; x++) {
+			int numberOfNeighbours = countNeighbours<MASK>(cell, x, y, mask);
+			unsigned char state = getState(x, y, cells);
+			setState(x, y, transition[numberOfNeighbours + 9*state], next);
+		}
+	}
+}
+
+void GenerationsBoard::nextGeneration(const unsigned char *transition, unsigned int neighbourhood) {
+	switch (neighbourhood) {
+	case NEIGHBOURHOOD_MOORE:
+		nextGenerationMasked<NEIGHBOURHOOD_MOORE>(transition, neighbourhood);
+		break;
+	case NEIGHBOURHOOD_VON_NEUMANN:
+		nextGenerationMasked<NEIGHBOURHOOD_VON_NEUMANN>(transition, neighbourhood);
+		break;
+	case NEIGHBOURHOOD_HEXAGONAL:
+		nextGenerationMasked<NEIGHBOURHOOD_HEXAGONAL>(transition, neighbourhood);
+		break;
+	default:
+		nextGenerationMasked<NEIGHBOURHOOD_CUSTOM>(transition, neighbourhood);
+		break;
+	}
+
+	unsigned char *tmp = cells;
+	cells = next;
+	next = tmp;
+}
+
+void GenerationsBoard::toImage(unsigned char *image) const {
+	for (int y = 0; y < boardSize[1]; y++) {
+		for (int x = 0; x < boardSize[0]; x++) {
+			unsigned char color = stateColor(getState(x, y, cells), states);
+			unsigned char *pixel = &image[4*x + (4*boardSize[0]*y)];
+			pixel[0] = color;
+			pixel[1] = color;
+			pixel[2] = color;
+			pixel[3] = 1;
+		}
+	}
+}
@@ -0,0 +1,81 @@
+#include <algorithm>
+
+#include "../inc/Metrics.hpp"
+using namespace std;
+
+void Histogram::record(unsigned long long nanoseconds) {
+	int bucket = 0;
+	while (bucket < METRICS_BUCKETS - 1 && (nanoseconds >> bucket) != 0)
+		bucket++;
+	buckets[bucket].fetch_add(1, memory_order_relaxed);
+	count.fetch_add(1, memory_order_relaxed);
+	sum.fetch_add(nanoseconds, memory_order_relaxed);
+	last.store(nanoseconds, memory_order_relaxed);
+
+	unsigned long long longest = max.load(memory_order_relaxed);
+	while (nanoseconds > longest
+		   && !max.compare_exchange_weak(longest, nanoseconds, memory_order_relaxed)) {}
+}
+
+double Histogram::getQuantile(double q) {
+	unsigned long long counts[METRICS_BUCKETS];
+	getBuckets(counts);
+	return bucketQuantile(counts, q, getMax());
+}
+
+void Histogram::getBuckets(unsigned long long *counts) {
+	for (int bucket = 0; bucket < METRICS_BUCKETS; bucket++)
+		counts[bucket] = buckets[bucket].load(memory_order_relaxed);
+}
+
+double bucketQuantile(const unsigned long long *counts, double q, double max) {
+	unsigned long long n = 0;
+	for (int bucket = 0; bucket < METRICS_BUCKETS; bucket++)
+		n += counts[bucket];
+	if (n == 0) return 0.0;
+
+	unsigned long long rank = (unsigned long long)(q * n);
+	unsigned long long seen = 0;
+	for (int bucket = 0; bucket < METRICS_BUCKETS; bucket++) {
+		seen += counts[bucket];
+		if (seen > rank)
+			return std::min((double)(1ULL << bucket) * 1.0e-6, max);
+	}
+	return max;
+}
+
+Counter * Metrics::counter(const string &name) {
+	lock_guard<std::mutex> lock(mutex);
+	Counter *&counter = counters[name];
+	if (counter == NULL) counter = new Counter();
+	return counter;
+}
+
+Histogram * Metrics::histogram(const string &name) {
+	lock_guard<std::mutex> lock(mutex);
+	Histogram *&histogram = histograms[name];
+	if (histogram == NULL) histogram = new Histogram(name);
+	return histogram;
+}
+
+void Metrics::print(FILE *file) {
+	lock_guard<std::mutex> lock(mutex);
+
+	fprintf(file, "%-20s %10s %12s %10s %10s %10s %10s\n",
+			"metric", "count", "total ms", "mean ms", "p50 ms", "p99 ms", "max ms");
+	for (map<string, Histogram *>::iterator it = histograms.begin(); it != histograms.end(); it++) {
+		Histogram *histogram = it->second;
+		fprintf(file, "%-20s %10llu %12.3f %10.4f %10.4f %10.4f %10.4f\n",
+				it->first.c_str(), histogram->getCount(), histogram->getTotal(),
+				histogram->getMean(), histogram->getQuantile(0.5),
+				histogram->getQuantile(0.99), histogram->getMax());
+	}
+	for (map<string, Counter *>::iterator it = counters.begin(); it != counters.end(); it++)
+		fprintf(file, "%-20s %10llu\n", it->first.c_str(), it->second->get());
+}
+
+Metrics & getMetrics() {
+	/* Never destroyed, so metrics can still be printed by exit handlers */
+	static Metrics *metrics = new Metrics();
+	return *metrics;
+}
@@ -0,0 +1,32 @@
+#include <cstdlib>
+#include <cstring>
+
+#include "../inc/Neighbourhood.hpp"
+
+int parseNeighbourhood(const char *name, unsigned int *mask) {
+	if (!strcmp(name, "moore") || !strcmp(name, "M")) {
+		*mask = NEIGHBOURHOOD_MOORE;
+	} else if (!strcmp(name, "vonneumann") || !strcmp(name, "V")) {
+		*mask = NEIGHBOURHOOD_VON_NEUMANN;
+	} else if (!strcmp(name, "hex") || !strcmp(name, "H")) {
+		*mask = NEIGHBOURHOOD_HEXAGONAL;
+	} else {
+		/* Custom 3x3 mask, the centre cell is no neighbour */
+		char *end;
+		unsigned long value = strtoul(name, &end, 0);
+		if (*name == '\0' || *end != '\0' || value == 0 || value > 0x1FF)
+			return -1;
+		*mask = (unsigned int)value & ~0x010u;
+		if (*mask == 0) return -1;
+	}
+	return 0;
+}
+
+const char * neighbourhoodSuffix(unsigned int mask) {
+	switch (mask) {
+		case NEIGHBOURHOOD_MOORE: return "";
+		case NEIGHBOURHOOD_VON_NEUMANN: return "V";
+		case NEIGHBOURHOOD_HEXAGONAL: return "H";
+		default: return NULL;
+	}
+}
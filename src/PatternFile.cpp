@@ -20,8 +20,7 @@ int PatternFile::parse() {
 	if (!header) { fclose(file); return -1; }
 	
 	/* Allocate space for pattern according to specified width and height of pattern */
-	patternSizeBytes = 4*patternSize[0]*patternSize[1]*sizeof(char);
-	pattern = (unsigned char *)malloc(patternSizeBytes);
+	if (allocatePattern() != 0) { fclose(file); return -1; }
 	
 	/* Parse pattern */
 	if (parsePattern() != 0) { fclose(file); return -1; }
@@ -30,6 +29,54 @@ int PatternFile::parse() {
 	return 0;
 }
 
+int PatternFile::readHeader() {
+	/* Open pattern file */
+	if ((file = fopen(fileName, "r")) == NULL)
+		return -2;
+	
+	/* Skip leading comment lines and whitespaces, then parse header line */
+	if (skipComments() != 0 || skipWhiteSpace() != 0 || !parseHeader()) {
+		fclose(file);
+		return -1;
+	}
+	
+	fclose(file);
+	return 0;
+}
+
+int PatternFile::allocatePattern() {
+	freePattern();
+	patternSizeBytes = 4*patternSize[0]*patternSize[1]*sizeof(char);
+	const size_t statesBytes = patternSize[0]*patternSize[1]*sizeof(char);
+	
+	if (arena) {
+		pattern = (unsigned char *)arena->allocate(patternSizeBytes);
+		patternStates = pattern ? (unsigned char *)arena->allocate(statesBytes) : NULL;
+		if (pattern && patternStates) {
+			memset(pattern, 0, patternSizeBytes);
+			memset(patternStates, 0, statesBytes);
+			patternInArena = true;
+			return 0;
+		}
+	}
+	
+	/* Without an arena or too big for it */
+	pattern = (unsigned char *)calloc(patternSizeBytes, 1);
+	patternStates = (unsigned char *)calloc(statesBytes, 1);
+	patternInArena = false;
+	return (pattern == NULL || patternStates == NULL) ? -1 : 0;
+}
+
+void PatternFile::freePattern() {
+	if (!patternInArena) {
+		free(pattern);
+		free(patternStates);
+	}
+	pattern = NULL;
+	patternStates = NULL;
+	patternInArena = false;
+}
+
 int PatternFile::skipComments() {
 	for (;;) {
 		c = getc(file);
@@ -123,43 +170,70 @@ bool PatternFile::parseHeader() {
 	if (c != '=') return false;
 	if (skipWhiteSpace() != 0) return false;
 	
-	if (c != 'B') return false;
-	/* Get rules for birth of a dead cell */
-	while ((c = getc(file)) != '/') {
-		switch (c) {
-		default:
-			if (c >= '0' && c <= '8') {
-				birthRules.push_back((int)c-(int)'0');
-				break;
-			} else {		/* other characters are not allowed */
-				return -1;
-			}
-		case ' ':			/* whitespaces are not allowed */
-		case '\t':
-		case 13:
-		case 10:
-		case EOF:			/* end of file is not allowed */
-			return true;
-		}
+	/* Read rule definition up to the next whitespace */
+	std::string rule;
+	while (c != ' ' && c != '\t' && c != 13 && c != 10 && c != EOF) {
+		rule.push_back((char)c);
+		c = getc(file);
 	}
 	
-	if (skipWhiteSpace() != 0) return -1;
-	if (c != 'S') return true;
-	/* Get rules for survival of a live cell */
-	while ((c = getc(file)) != ' ' && c != '\t' && c != 13 && c != 10) {
-		switch (c) {
-		default:
-			if (c >= '0' && c <= '8') {
-				survivalRules.push_back((int)c-(int)'0');
-				break;
-			} else {		/* other characters are not allowed */
-				return -1;
+	return parseRule(rule);
+}
+
+bool PatternFile::parseRule(const std::string &_rule) {
+	if (_rule.empty()) return false;
+	
+	/* Neighbourhood suffix */
+	std::string rule(_rule);
+	neighbourhood = NEIGHBOURHOOD_MOORE;
+	char suffix[2] = {rule[rule.size()-1], '\0'};
+	if (strchr("HVM", suffix[0]) != NULL) {
+		parseNeighbourhood(suffix, &neighbourhood);
+		rule.erase(rule.size()-1);
+	}
+	
+	/* Split up rule in its fields */
+	std::vector<std::string> fields(1);
+	for (unsigned int i = 0; i < rule.size(); i++) {
+		if (rule[i] == '/') fields.push_back("");
+		else fields.back().push_back(rule[i]);
+	}
+	if (fields.size() < 2 || fields.size() > 3) return false;
+	
+	/* B/S/C notation has a letter in front of every field, else S/B/C is used */
+	bool lettered = !rule.empty() && strchr("BbSs", rule[0]) != NULL;
+	
+	birthRules.clear();
+	survivalRules.clear();
+	states = 2;
+	for (unsigned int i = 0; i < fields.size(); i++) {
+		std::string digits = fields[i];
+		char tag = "SBC"[i];
+		if (lettered) {
+			if (digits.empty()) return false;
+			tag = toupper(digits[0]);
+			digits.erase(0, 1);
+		}
+		
+		switch (tag) {
+		case 'C':			/* number of states for Generations rules */
+			states = atoi(digits.c_str());
+			if (states < 2 || states > 256) return false;
+			break;
+		case 'B':			/* number of neighbours for cell birth */
+		case 'S':			/* number of neighbours for cell survival */
+			for (unsigned int k = 0; k < digits.size(); k++) {
+				if (digits[k] < '0' || digits[k] > '8') return false;
+				if (tag == 'B') birthRules.push_back(digits[k]-'0');
+				else survivalRules.push_back(digits[k]-'0');
 			}
-		case EOF:			/* end of file is not allowed */
-			return true;
+			break;
+		default:			/* other characters are not allowed */
+			return false;
 		}
 	}
 	
+	hasRule = true;
 	return true;
 }
 
@@ -169,7 +243,8 @@ int PatternFile::parsePattern() {
 	bool isCell = false;
 	int x = 0;
 	int y = 0;
-	unsigned char color;
+	int state = 0;
+	int next;
 	
 	for (;;) {
 		if (skipWhiteSpace() != 0) return -1;
@@ -180,6 +255,11 @@ int PatternFile::parsePattern() {
 				number = (isNumber ? 10*number : 0) + (c-'0');
 				isNumber = true;
 				continue;
+			} else if (c >= 'A' && c <= 'X') {
+				/* states 1 to 24 of multi-state files */
+				isCell = true;
+				state = c-'A'+1;
+				break;
 			} else {
 				return -1;
 			}
@@ -194,26 +274,49 @@ int PatternFile::parsePattern() {
 			if (y == (patternSize[1]-1)) {
 				/* Fill the rest of the line with dead cells */
 				for (int i = x; i < patternSize[0]; i++) {
-					setState(x,y,0);
+					setState(i,y,0);
 				}
 				return 0;
 			} else
 				return -1;
 		case 'b':			/* dead cell */
+		case '.':
 			isCell = true;
-			color = 0;
+			state = 0;
 			break;
 		case 'o':			/* live cell */
-		case 'x':
-		case 'y':
 		case 'z':
 			isCell = true;
-			color = 255;
+			state = 1;
+			break;
+		case 'p':			/* prefix for states above 24 of multi-state files */
+		case 'q':
+		case 'r':
+		case 's':
+		case 't':
+		case 'u':
+		case 'v':
+		case 'w':
+		case 'x':
+		case 'y':
+			next = getc(file);
+			if (next >= 'A' && next <= 'X') {
+				isCell = true;
+				state = 24*(c-'o') + (next-'A'+1);
+				if (state > 255) return -1;
+			} else if (c == 'x' || c == 'y') {
+				/* without a following state x and y are live cells */
+				ungetc(next, file);
+				isCell = true;
+				state = 1;
+			} else {
+				return -1;
+			}
 			break;
 		case '$':			/* new line */
 			/* Fill the rest of the line with dead cells */
-			for (int i = x; i < patternSize[0]; i++) {
-				setState(x,y,0);
+			for (int i = x; i < patternSize[0] && y < patternSize[1]; i++) {
+				setState(i,y,0);
 			}
 			x = 0;
 			/* Make new line(s) */
@@ -227,7 +330,8 @@ int PatternFile::parsePattern() {
 		if (isCell) {
 			/* Make number of c cells */
 			for (; number > 0; x++, number--) {
-				setState(x,y,color);
+				if (x < patternSize[0] && y < patternSize[1])
+					setState(x,y,state);
 			}
 			isNumber = false;
 			isCell = false;
@@ -0,0 +1,315 @@
+#include "../inc/SoupSearch.hpp"
+using namespace std;
+
+/**
+* SplitMix64 step, used to derive soups from seed and soup number.
+* @param state state of the generator, advanced by this call
+* @return 64 random bits
+*/
+static inline unsigned long long splitMix64(unsigned long long &state) {
+	unsigned long long z = (state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+/* Get current time in seconds */
+static inline double getSeconds() {
+	return metricsNow() * 1.0e-9;
+}
+
+int SoupSearch::setup(unsigned int _batchSize, unsigned long _seed) {
+	batchSize = _batchSize;
+	seed = _seed;
+	nextSoup = 0;
+
+	soups = (cl_uint *)malloc(batchSize*SOUP_BOARD*sizeof(cl_uint));
+	done = (unsigned char *)malloc(batchSize*sizeof(char));
+	generations = (cl_uint *)malloc(batchSize*sizeof(cl_uint));
+	soupIndex = (unsigned long *)malloc(batchSize*sizeof(unsigned long));
+	if (soups == NULL || done == NULL || generations == NULL || soupIndex == NULL)
+		return -1;
+
+	for (unsigned int slot = 0; slot < batchSize; slot++)
+		spawnSoup(slot);
+
+	return setupDevice();
+}
+
+void SoupSearch::spawnSoup(unsigned int slot) {
+	/* Every soup only depends on seed and soup number */
+	unsigned long long state = seed ^ (0xD1B54A32D192ED03ULL * (nextSoup + 1));
+	unsigned long long bits = 0;
+	const int margin = (SOUP_BOARD - SOUP_SIZE) / 2;
+	cl_uint *rows = &soups[slot*SOUP_BOARD];
+	memset(rows, 0, SOUP_BOARD*sizeof(cl_uint));
+	for (int y = 0; y < SOUP_SIZE; y++) {
+		if (y % (64 / SOUP_SIZE) == 0) bits = splitMix64(state);
+		rows[margin + y] = (cl_uint)(bits & ((1ULL << SOUP_SIZE) - 1)) << margin;
+		bits >>= SOUP_SIZE;
+	}
+	done[slot] = SOUP_RUNNING;
+	generations[slot] = 0;
+	soupIndex[slot] = nextSoup++;
+}
+
+int SoupSearch::setupDevice() {
+	cl_int status = CL_SUCCESS;
+	const char *kernelFile = "kernels.cl";
+	KernelFile kernels;
+
+	/*
+	 * From the available platforms use preferably AMD or NVIDIA
+	 */
+	cl_uint numberOfPlatforms;
+	cl_platform_id platform = NULL;
+	status = clGetPlatformIDs(0, NULL, &numberOfPlatforms);
+	assert(status == CL_SUCCESS);
+
+	if(numberOfPlatforms > 0) {
+		cl_platform_id* platforms = new cl_platform_id[numberOfPlatforms];
+		status = clGetPlatformIDs(numberOfPlatforms, platforms, NULL);
+		assert(status == CL_SUCCESS);
+
+		for(unsigned int i=0; i < numberOfPlatforms; i++) {
+			char vendor[100];
+			status = clGetPlatformInfo(platforms[i], CL_PLATFORM_VENDOR,
+						sizeof(vendor), vendor, NULL);
+			platform = platforms[i];
+			if(!strcmp(vendor, "Advanced Micro Devices, Inc.")
+				|| !strcmp(vendor, "NVIDIA Corporation")) {
+				break;
+			}
+		}
+
+		delete[] platforms;
+	}
+
+	cl_context_properties cps[3] = { CL_CONTEXT_PLATFORM,
+									(cl_context_properties)platform, 0 };
+	cl_context_properties* cprops = (NULL == platform) ? NULL : cps;
+
+	context = clCreateContextFromType(cprops, CL_DEVICE_TYPE_GPU, NULL, NULL, &status);
+	assert(status == CL_SUCCESS);
+
+	/* Get the device list */
+	size_t deviceListSize;
+	status = clGetContextInfo(context, CL_CONTEXT_DEVICES, 0, NULL, &deviceListSize);
+	assert(status == CL_SUCCESS);
+	devices = (cl_device_id *)malloc(deviceListSize);
+	assert(devices != NULL);
+	status = clGetContextInfo(context, CL_CONTEXT_DEVICES, deviceListSize, devices, NULL);
+	assert(status == CL_SUCCESS);
+
+	commandQueue = clCreateCommandQueue(context, devices[0], 0, &status);
+	assert(status == CL_SUCCESS);
+
+	/**
+	* Allocate device memory
+	*/
+	deviceSoups = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+			batchSize*SOUP_BOARD*sizeof(cl_uint), soups, &status);
+	assert(status == CL_SUCCESS);
+	// checkpoints are taken by the kernel at generation 0
+	deviceCheckpoints = clCreateBuffer(context, CL_MEM_READ_WRITE,
+			batchSize*SOUP_BOARD*sizeof(cl_uint), NULL, &status);
+	assert(status == CL_SUCCESS);
+	deviceDone = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+			batchSize*sizeof(char), done, &status);
+	assert(status == CL_SUCCESS);
+	deviceGenerations = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+			batchSize*sizeof(cl_uint), generations, &status);
+	assert(status == CL_SUCCESS);
+
+	/* Rule, neighbourhood and soup size are fixed at compile time */
+	char buildOptions[160];
+	snprintf(buildOptions, sizeof(buildOptions),
+			 "-D NEIGHBOURHOOD=0x%03X -D BIRTH_MASK=0x%03X -D SURVIVE_MASK=0x%03X"
+			 " -D SOUP_BOARD=%i -D SOUP_STEPS=%i",
+			 neighbourhood, birthRule, survivalRule, SOUP_BOARD, SOUP_STEPS);
+
+	/**
+	* Load kernel file, build program and create kernel
+	*/
+	if (!kernels.open(kernelFile)) {
+		cerr << "Could not load CL source code from file " << kernelFile << endl;
+		return -1;
+	}
+	const char* source = kernels.source().c_str();
+	size_t sourceSize[] = {strlen(source)};
+
+	program = clCreateProgramWithSource(context, 1, &source, sourceSize, &status);
+	status = clBuildProgram(program, 1, devices, buildOptions, NULL, NULL);
+	if (status != CL_SUCCESS) {
+		size_t buildLogSize;
+		clGetProgramBuildInfo(program, devices[0],
+				CL_PROGRAM_BUILD_LOG, 0, NULL, &buildLogSize);
+		char *buildLog = new char[buildLogSize+1];
+		clGetProgramBuildInfo(program, devices[0],
+				CL_PROGRAM_BUILD_LOG, buildLogSize, buildLog, NULL);
+		buildLog[buildLogSize] = '\0';
+
+		cerr << "\nBUILD LOG:\n" << buildLog << endl;
+
+		delete[] buildLog;
+		return -1;
+	}
+
+	kernel = clCreateKernel(program, "nextGenerationSoups", &status);
+	assert(status == CL_SUCCESS);
+
+	cl_uint numberOfSoups = batchSize;
+	status |= clSetKernelArg(kernel, 0, sizeof(cl_mem), (void *)&deviceSoups);
+	status |= clSetKernelArg(kernel, 1, sizeof(cl_mem), (void *)&deviceCheckpoints);
+	status |= clSetKernelArg(kernel, 2, sizeof(cl_mem), (void *)&deviceDone);
+	status |= clSetKernelArg(kernel, 3, sizeof(cl_mem), (void *)&deviceGenerations);
+	status |= clSetKernelArg(kernel, 4, sizeof(cl_uint), (void *)&numberOfSoups);
+	status |= clSetKernelArg(kernel, 5, sizeof(cl_uint), (void *)&maxGenerations);
+	assert(status == CL_SUCCESS);
+
+	return 0;
+}
+
+int SoupSearch::run(unsigned long numberOfSoups) {
+	cl_int status;
+	size_t globalThreads[1] = {batchSize};
+	unsigned int running = batchSize;
+
+	/* Slots beyond the requested number of soups stay empty */
+	for (unsigned int slot = 0; slot < batchSize; slot++) {
+		if (soupIndex[slot] >= numberOfSoups) {
+			done[slot] = SOUP_EMPTY;
+			running--;
+		}
+	}
+	status = clEnqueueWriteBuffer(commandQueue, deviceDone, CL_TRUE, 0,
+			batchSize*sizeof(char), done, 0, NULL, NULL);
+	assert(status == CL_SUCCESS);
+
+	double start = getSeconds();
+	double lastReport = start;
+
+	while (running > 0) {
+		/* Advance all soups by up to SOUP_STEPS generations */
+		status = clEnqueueNDRangeKernel(commandQueue, kernel, 1, NULL,
+				globalThreads, NULL, 0, NULL, NULL);
+		assert(status == CL_SUCCESS);
+		status = clEnqueueReadBuffer(commandQueue, deviceDone, CL_TRUE, 0,
+				batchSize*sizeof(char), done, 0, NULL, NULL);
+		assert(status == CL_SUCCESS);
+
+		bool finished = false;
+		for (unsigned int slot = 0; slot < batchSize && !finished; slot++)
+			finished = (done[slot] == SOUP_STABLE || done[slot] == SOUP_TIMEOUT);
+
+		if (finished) {
+			/* Refill finished slots on the host and upload the whole batch */
+			status = clEnqueueReadBuffer(commandQueue, deviceSoups, CL_TRUE, 0,
+					batchSize*SOUP_BOARD*sizeof(cl_uint), soups, 0, NULL, NULL);
+			assert(status == CL_SUCCESS);
+			status = clEnqueueReadBuffer(commandQueue, deviceGenerations, CL_TRUE, 0,
+					batchSize*sizeof(cl_uint), generations, 0, NULL, NULL);
+			assert(status == CL_SUCCESS);
+
+			for (unsigned int slot = 0; slot < batchSize; slot++) {
+				if (done[slot] != SOUP_STABLE && done[slot] != SOUP_TIMEOUT)
+					continue;
+				completed++;
+				if (done[slot] == SOUP_STABLE) {
+					stable++;
+					census.addTorus(&soups[slot*SOUP_BOARD], SOUP_BOARD, SOUP_BOARD);
+				}
+
+				if (nextSoup < numberOfSoups) {
+					spawnSoup(slot);
+				} else {
+					done[slot] = SOUP_EMPTY;
+					running--;
+				}
+			}
+
+			status = clEnqueueWriteBuffer(commandQueue, deviceSoups, CL_FALSE, 0,
+					batchSize*SOUP_BOARD*sizeof(cl_uint), soups, 0, NULL, NULL);
+			assert(status == CL_SUCCESS);
+			status = clEnqueueWriteBuffer(commandQueue, deviceGenerations, CL_FALSE, 0,
+					batchSize*sizeof(cl_uint), generations, 0, NULL, NULL);
+			assert(status == CL_SUCCESS);
+			status = clEnqueueWriteBuffer(commandQueue, deviceDone, CL_TRUE, 0,
+					batchSize*sizeof(char), done, 0, NULL, NULL);
+			assert(status == CL_SUCCESS);
+		}
+
+		/* Report throughput every second */
+		double now = getSeconds();
+		if (now - lastReport >= 1.0 || running == 0) {
+			printf("soups: %lu | stable: %lu | unstable: %lu | %.0f soups/s\n",
+				   completed, stable, completed - stable,
+				   completed / max(now - start, 1e-9));
+			lastReport = now;
+		}
+	}
+
+	census.print(stdout);
+
+	return 0;
+}
+
+int SoupSearch::freeMem() {
+	cl_int status;
+
+	/* Release OpenCL resources */
+	if (kernel) {
+		status = clReleaseKernel(kernel);
+		assert(status == CL_SUCCESS);
+		kernel = NULL;
+	}
+	if (program) {
+		status = clReleaseProgram(program);
+		assert(status == CL_SUCCESS);
+		program = NULL;
+	}
+	if (deviceSoups) {
+		status = clReleaseMemObject(deviceSoups);
+		assert(status == CL_SUCCESS);
+		deviceSoups = NULL;
+	}
+	if (deviceCheckpoints) {
+		status = clReleaseMemObject(deviceCheckpoints);
+		assert(status == CL_SUCCESS);
+		deviceCheckpoints = NULL;
+	}
+	if (deviceDone) {
+		status = clReleaseMemObject(deviceDone);
+		assert(status == CL_SUCCESS);
+		deviceDone = NULL;
+	}
+	if (deviceGenerations) {
+		status = clReleaseMemObject(deviceGenerations);
+		assert(status == CL_SUCCESS);
+		deviceGenerations = NULL;
+	}
+	if (commandQueue) {
+		status = clReleaseCommandQueue(commandQueue);
+		assert(status == CL_SUCCESS);
+		commandQueue = NULL;
+	}
+	if (context) {
+		status = clReleaseContext(context);
+		assert(status == CL_SUCCESS);
+		context = NULL;
+	}
+
+	/* Release host resources */
+	free(soups);
+	free(done);
+	free(generations);
+	free(soupIndex);
+	free(devices);
+	soups = NULL;
+	done = NULL;
+	generations = NULL;
+	soupIndex = NULL;
+	devices = NULL;
+
+	return 0;
+}
@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <thread>
+
+#include "../inc/SparseEngine.hpp"
+using namespace std;
+
+void SparseEngine::forParts(int parts, const function<void(int)> &function) {
+	if (parts == 1) function(0);
+	else pool.runWorkers(function);
+}
+
+int SparseEngine::setup(int width, int height, int _topology) {
+	/* Cells counting a cell are found by wrapping or dropping coordinates only */
+	if (_topology != TOPOLOGY_TORUS && _topology != TOPOLOGY_PLANE) return -1;
+	if (width <= 0 || height <= 0) return -1;
+
+	boardSize[0] = width;
+	boardSize[1] = height;
+	topology = _topology;
+	/* Workers are kept for all generations, a band of one row each */
+	if (pool.setup(max(1, (int)thread::hardware_concurrency()),
+				   (int)thread::hardware_concurrency()) != 0)
+		return -1;
+	threads = pool.getBands();
+	live.clear();
+	return 0;
+}
+
+int SparseEngine::setRules(const unsigned char *_rules, unsigned int neighbourhood) {
+	/* Birth on 0 neighbours fills the empty board, which has no sparse form */
+	if (_rules[0] >> 7) return -1;
+
+	for (int i = 0; i < 18; i++)
+		rules[i] = _rules[i] >> 7;
+	numberOfOffsets = 0;
+	for (int k = -1; k <= 1; k++) {
+		for (int i = -1; i <= 1; i++) {
+			if (!((neighbourhood >> (3*(k+1) + (i+1))) & 1)) continue;
+			offsets[numberOfOffsets][0] = i;
+			offsets[numberOfOffsets][1] = k;
+			numberOfOffsets++;
+		}
+	}
+	return 0;
+}
+
+int SparseEngine::setRule(unsigned int birthRule, unsigned int survivalRule, unsigned int neighbourhood) {
+	unsigned char table[18];
+	for (int n = 0; n < 9; n++) {
+		table[n] = ((birthRule >> n) & 1) ? 255 : 0;
+		table[9+n] = ((survivalRule >> n) & 1) ? 255 : 0;
+	}
+	return setRules(table, neighbourhood);
+}
+
+void SparseEngine::load(const unsigned char *image) {
+	/* Row by row, so the list is sorted already */
+	live.clear();
+	for (int y = 0; y < boardSize[1]; y++)
+		for (int x = 0; x < boardSize[0]; x++)
+			if (image[4*x + (4*boardSize[0]*y)] >> 7)
+				live.push_back(key(x, y));
+}
+
+int SparseEngine::loadPattern(PatternFile &pattern, int x, int y) {
+	const int width = pattern.getWidth(), height = pattern.getHeight();
+	if (x < 0 || y < 0 || width > boardSize[0] - x || height > boardSize[1] - y)
+		return -1;
+
+	if (pattern.isRuleSpecified()) {
+		if (pattern.getNumberOfStates() > 2) return -1;
+		vector<int> birthRules = pattern.getBirthRules();
+		vector<int> survivalRules = pattern.getSurvivalRules();
+		unsigned int birthRule = 0, survivalRule = 0;
+		for (unsigned int i = 0; i < birthRules.size(); i++)
+			birthRule |= 1 << birthRules.at(i);
+		for (unsigned int i = 0; i < survivalRules.size(); i++)
+			survivalRule |= 1 << survivalRules.at(i);
+		if (setRule(birthRule, survivalRule, pattern.getNeighbourhood()) != 0)
+			return -1;
+	}
+
+	unsigned char *states = pattern.getStates();
+	for (int py = 0; py < height; py++)
+		for (int px = 0; px < width; px++)
+			if (states[px + width*py])
+				live.push_back(key(x + px, y + py));
+
+	/* Patterns may overlap cells loaded before */
+	radixSort(live);
+	live.erase(unique(live.begin(), live.end()), live.end());
+	return 0;
+}
+
+void SparseEngine::nextGeneration() {
+	const size_t population = live.size();
+	const unsigned long long outside = key(0, boardSize[1]);	/* sorts after all board cells */
+
+	/* Every live cell contributes to the cells counting it */
+	counted.resize(population * numberOfOffsets);
+	const int parts = counted.size() < SPARSE_PARALLEL_MIN ? 1 : threads;
+	forParts(parts, [&](int part) {
+		const size_t end = population*(part+1)/parts;
+		size_t c = population*part/parts * numberOfOffsets;
+		for (size_t i = population*part/parts; i < end; i++) {
+			const int x = (int)(live[i] & 0xFFFFFFFF), y = (int)(live[i] >> 32);
+			for (int o = 0; o < numberOfOffsets; o++) {
+				/* A cell counts the cell at its offset, so it is counted from the opposite one */
+				int countingX = x - offsets[o][0], countingY = y - offsets[o][1];
+				if (countingX < 0 || countingX >= boardSize[0] || countingY < 0 || countingY >= boardSize[1]) {
+					if (topology == TOPOLOGY_PLANE) {
+						counted[c++] = outside;
+						continue;
+					}
+					countingX = (countingX + boardSize[0]) % boardSize[0];
+					countingY = (countingY + boardSize[1]) % boardSize[1];
+				}
+				counted[c++] = key(countingX, countingY);
+			}
+		}
+	});
+	radixSort(counted);
+
+	/* Merge runs of equal cells with the live cells */
+	size_t contributions = counted.size();
+	while (contributions > 0 && counted[contributions-1] == outside)
+		contributions--;
+	next.clear();
+	size_t i = 0, c = 0;
+	while (i < population || c < contributions) {
+		const unsigned long long cell = (c == contributions || (i < population && live[i] < counted[c]))
+			? live[i] : counted[c];
+		int alive = 0;
+		if (i < population && live[i] == cell) {
+			alive = 1;
+			i++;
+		}
+		int neighbours = 0;
+		while (c < contributions && counted[c] == cell) {
+			neighbours++;
+			c++;
+		}
+		if (rules[neighbours + 9*alive])
+			next.push_back(cell);
+	}
+	live.swap(next);
+}
+
+void SparseEngine::step(unsigned long n) {
+	for (unsigned long generation = 0; generation < n; generation++)
+		nextGeneration();
+}
+
+void SparseEngine::radixSort(vector<unsigned long long> &keys) {
+	const size_t n = keys.size();
+	if (n < 2) return;
+	const int parts = n < SPARSE_PARALLEL_MIN ? 1 : threads;
+	scratch.resize(n);
+
+	/* Bits differing in any key, bytes without them need no pass */
+	vector<unsigned long long> differing(parts, 0);
+	forParts(parts, [&](int part) {
+		for (size_t i = n*part/parts; i < n*(part+1)/parts; i++)
+			differing[part] |= keys[i] ^ keys[0];
+	});
+	for (int part = 1; part < parts; part++)
+		differing[0] |= differing[part];
+
+	vector<size_t> counts(256*parts);
+	unsigned long long *source = &keys[0], *target = &scratch[0];
+	for (int shift = 0; shift < 64; shift += 8) {
+		if (((differing[0] >> shift) & 0xFF) == 0) continue;
+
+		/* Histogram of every part */
+		fill(counts.begin(), counts.end(), 0);
+		forParts(parts, [&](int part) {
+			size_t *count = &counts[256*part];
+			for (size_t i = n*part/parts; i < n*(part+1)/parts; i++)
+				count[(source[i] >> shift) & 0xFF]++;
+		});
+
+		/* Parts of a digit are placed in order, so every pass is stable */
+		size_t position = 0;
+		for (int digit = 0; digit < 256; digit++) {
+			for (int part = 0; part < parts; part++) {
+				size_t count = counts[256*part + digit];
+				counts[256*part + digit] = position;
+				position += count;
+			}
+		}
+		forParts(parts, [&](int part) {
+			size_t *positions = &counts[256*part];
+			for (size_t i = n*part/parts; i < n*(part+1)/parts; i++)
+				target[positions[(source[i] >> shift) & 0xFF]++] = source[i];
+		});
+		swap(source, target);
+	}
+	if (source != &keys[0]) keys.swap(scratch);
+}
+
+int SparseEngine::getRegion(int x, int y, int width, int height, unsigned char *states) {
+	if (x < 0 || y < 0 || width < 0 || height < 0
+		|| width > boardSize[0] - x || height > boardSize[1] - y)
+		return -1;
+
+	memset(states, 0, (size_t)width*height);
+	for (int row = 0; row < height; row++) {
+		const unsigned long long end = key(x + width, y + row);
+		vector<unsigned long long>::iterator cell =
+			lower_bound(live.begin(), live.end(), key(x, y + row));
+		for (; cell != live.end() && *cell < end; ++cell)
+			states[(int)(*cell & 0xFFFFFFFF) - x + (size_t)width*row] = 1;
+	}
+	return 0;
+}
+
+void SparseEngine::store(unsigned char *image) {
+	for (size_t i = 0; i < (size_t)boardSize[0]*boardSize[1]; i++) {
+		unsigned char *pixel = &image[4*i];
+		pixel[0] = pixel[1] = pixel[2] = 0;
+		pixel[3] = 1;
+	}
+	for (size_t i = 0; i < live.size(); i++) {
+		const int x = (int)(live[i] & 0xFFFFFFFF), y = (int)(live[i] >> 32);
+		unsigned char *pixel = &image[4*x + (4*(size_t)boardSize[0]*y)];
+		pixel[0] = pixel[1] = pixel[2] = 255;
+	}
+}
@@ -0,0 +1,271 @@
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "../inc/StatsServer.hpp"
+#include "../inc/Trace.hpp"			/* for naming the server thread */
+using namespace std;
+
+/* Histograms in the answers, names of the metrics registry */
+static const char *histogramNames[STATS_HISTOGRAMS] = {
+	"step", "generation", "readback", "pack frame", "display", "export write"
+};
+
+StatsServer::StatsServer():
+		path(""),
+		socketFd(-1),
+		running(false),
+		sequence(0),
+		rateTime(0),
+		rateGeneration(0),
+		rate(0.0),
+		windowTime(0),
+		requests(getMetrics().counter("stats requests"))
+	{
+	for (unsigned int i = 0; i < STATS_WORDS; i++)
+		words[i].store(0);
+	for (int h = 0; h < STATS_HISTOGRAMS; h++) {
+		histograms[h] = getMetrics().histogram(histogramNames[h]);
+		memset(windowStart[h], 0, sizeof(windowStart[h]));
+		memset(windowEnd[h], 0, sizeof(windowEnd[h]));
+	}
+
+	SimulationStats stats;
+	memset(&stats, 0, sizeof(stats));
+	stats.liveCells = -1;
+	publish(stats);
+}
+
+int StatsServer::start(const char *_path) {
+	path = _path;
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(address.sun_path)) {
+		fprintf(stderr, "Stats socket path %s is too long\n", _path);
+		return -1;
+	}
+	strcpy(address.sun_path, path.c_str());
+
+	/* Replace a socket of an earlier run, but never other files */
+	struct stat info;
+	if (lstat(_path, &info) == 0) {
+		if (!S_ISSOCK(info.st_mode)) {
+			fprintf(stderr, "%s exists and is not a socket\n", _path);
+			return -1;
+		}
+		unlink(_path);
+	}
+
+	socketFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (socketFd < 0
+		|| bind(socketFd, (struct sockaddr *)&address, sizeof(address)) != 0
+		|| listen(socketFd, 16) != 0) {
+		fprintf(stderr, "Could not listen on %s: %s\n", _path, strerror(errno));
+		if (socketFd >= 0) close(socketFd);
+		socketFd = -1;
+		return -1;
+	}
+
+	windowTime = metricsNow();
+	running.store(true);
+	server = std::thread(&StatsServer::serve, this);
+	return 0;
+}
+
+void StatsServer::publish(SimulationStats stats) {
+	/* Rate over intervals of at least a second, restarted by resets */
+	unsigned long long now = metricsNow();
+	if (stats.generation < rateGeneration || rateTime == 0) {
+		rateTime = now;
+		rateGeneration = stats.generation;
+		rate = 0.0;
+	} else if (now - rateTime >= 1000000000ULL) {
+		rate = (stats.generation - rateGeneration) * 1.0e9 / (now - rateTime);
+		rateTime = now;
+		rateGeneration = stats.generation;
+	}
+	stats.generationsPerSecond = rate;
+
+	unsigned long long copy[STATS_WORDS];
+	memset(copy, 0, sizeof(copy));
+	memcpy(copy, &stats, sizeof(stats));
+
+	/* Odd sequence while the words are written */
+	unsigned int begin = sequence.load(memory_order_relaxed);
+	sequence.store(begin + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	for (unsigned int i = 0; i < STATS_WORDS; i++)
+		words[i].store(copy[i], memory_order_relaxed);
+	sequence.store(begin + 2, memory_order_release);
+}
+
+void StatsServer::read(SimulationStats &stats) {
+	unsigned long long copy[STATS_WORDS];
+	unsigned int begin, end;
+	do {
+		begin = sequence.load(memory_order_acquire);
+		for (unsigned int i = 0; i < STATS_WORDS; i++)
+			copy[i] = words[i].load(memory_order_relaxed);
+		atomic_thread_fence(memory_order_acquire);
+		end = sequence.load(memory_order_relaxed);
+	} while ((begin & 1) || begin != end);
+	memcpy(&stats, copy, sizeof(stats));
+}
+
+void StatsServer::stop() {
+	if (!running.exchange(false)) return;
+	server.join();
+	close(socketFd);
+	socketFd = -1;
+	unlink(path.c_str());
+}
+
+void StatsServer::serve() {
+	getTrace().setThreadName("stats server");
+	struct pollfd listening = {socketFd, POLLIN, 0};
+	while (isRunning()) {
+		/* Wake up regularly to notice stop() and to move the latency window */
+		int ready = poll(&listening, 1, 200);
+
+		unsigned long long now = metricsNow();
+		if (now - windowTime >= STATS_WINDOW * 1000000000ULL) {
+			for (int h = 0; h < STATS_HISTOGRAMS; h++) {
+				memcpy(windowStart[h], windowEnd[h], sizeof(windowEnd[h]));
+				histograms[h]->getBuckets(windowEnd[h]);
+			}
+			windowTime = now;
+		}
+
+		if (ready <= 0) continue;
+		int client = accept(socketFd, NULL, NULL);
+		if (client < 0) continue;
+		answer(client);
+		close(client);
+		requests->add();
+	}
+}
+
+void StatsServer::answer(int client) {
+	/* A slow client must not stall the server */
+	struct timeval timeout = {1, 0};
+	setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+	/* The request is optional, clients that only read get JSON */
+	char request[256] = "";
+	struct pollfd readable = {client, POLLIN, 0};
+	if (poll(&readable, 1, 100) > 0) {
+		ssize_t length = recv(client, request, sizeof(request) - 1, 0);
+		request[length > 0 ? length : 0] = '\0';
+	}
+	bool http = strncmp(request, "GET ", 4) == 0;
+	bool prometheus = http ? strncmp(request + 4, "/metrics", 8) == 0
+						   : strstr(request, "prometheus") != NULL;
+
+	SimulationStats stats;
+	read(stats);
+	string body = format(stats, prometheus);
+
+	string answer;
+	if (http) {
+		char header[128];
+		snprintf(header, sizeof(header),
+				 "HTTP/1.0 200 OK\r\nContent-Type: %s\r\nContent-Length: %lu\r\n\r\n",
+				 prometheus ? "text/plain; version=0.0.4" : "application/json",
+				 (unsigned long)body.size());
+		answer = header;
+	}
+	answer += body;
+
+	size_t sent = 0;
+	while (sent < answer.size()) {
+		ssize_t length = send(client, answer.data() + sent, answer.size() - sent, MSG_NOSIGNAL);
+		if (length <= 0) break;
+		sent += length;
+	}
+}
+
+string StatsServer::format(const SimulationStats &stats, bool prometheus) {
+	string text;
+	char line[1024];
+
+	if (prometheus) {
+		snprintf(line, sizeof(line),
+				 "# TYPE gameoflife_generation counter\ngameoflife_generation %lu\n"
+				 "# TYPE gameoflife_generations_per_second gauge\ngameoflife_generations_per_second %.3f\n",
+				 stats.generation, stats.generationsPerSecond);
+		text += line;
+		if (stats.liveCells >= 0) {
+			snprintf(line, sizeof(line),
+					 "# TYPE gameoflife_population gauge\ngameoflife_population %ld\n"
+					 "# TYPE gameoflife_population_generation gauge\ngameoflife_population_generation %lu\n",
+					 stats.liveCells, stats.liveCellsGeneration);
+			text += line;
+		}
+		snprintf(line, sizeof(line),
+				 "# TYPE gameoflife_board_cells gauge\n"
+				 "gameoflife_board_cells{axis=\"width\"} %i\ngameoflife_board_cells{axis=\"height\"} %i\n"
+				 "# TYPE gameoflife_info gauge\ngameoflife_info{engine=\"%s\",paused=\"%s\"} 1\n"
+				 "# TYPE gameoflife_latency_seconds summary\n",
+				 stats.size[0], stats.size[1], stats.engine, stats.paused ? "true" : "false");
+		text += line;
+	} else {
+		snprintf(line, sizeof(line),
+				 "{\"generation\":%lu,\"generations_per_second\":%.3f,",
+				 stats.generation, stats.generationsPerSecond);
+		text += line;
+		if (stats.liveCells >= 0)
+			snprintf(line, sizeof(line), "\"population\":%ld,\"population_generation\":%lu,",
+					 stats.liveCells, stats.liveCellsGeneration);
+		else
+			snprintf(line, sizeof(line), "\"population\":null,\"population_generation\":null,");
+		text += line;
+		snprintf(line, sizeof(line),
+				 "\"engine\":\"%s\",\"paused\":%s,\"width\":%i,\"height\":%i,"
+				 "\"latency_window_s\":%i,\"latency_ms\":{",
+				 stats.engine, stats.paused ? "true" : "false", stats.size[0], stats.size[1],
+				 2*STATS_WINDOW);
+		text += line;
+	}
+
+	/* Quantiles of the last one to two windows, count and sum since start */
+	bool first = true;
+	for (int h = 0; h < STATS_HISTOGRAMS; h++) {
+		Histogram *histogram = histograms[h];
+		if (histogram->getCount() == 0) continue;
+
+		unsigned long long counts[METRICS_BUCKETS];
+		histogram->getBuckets(counts);
+		for (int b = 0; b < METRICS_BUCKETS; b++)
+			counts[b] -= min(counts[b], windowStart[h][b]);
+		double p50 = bucketQuantile(counts, 0.5, histogram->getMax());
+		double p90 = bucketQuantile(counts, 0.9, histogram->getMax());
+		double p99 = bucketQuantile(counts, 0.99, histogram->getMax());
+
+		if (prometheus) {
+			const char *name = histogram->getName();
+			snprintf(line, sizeof(line),
+					 "gameoflife_latency_seconds{phase=\"%s\",quantile=\"0.5\"} %.9f\n"
+					 "gameoflife_latency_seconds{phase=\"%s\",quantile=\"0.9\"} %.9f\n"
+					 "gameoflife_latency_seconds{phase=\"%s\",quantile=\"0.99\"} %.9f\n"
+					 "gameoflife_latency_seconds_sum{phase=\"%s\"} %.9f\n"
+					 "gameoflife_latency_seconds_count{phase=\"%s\"} %llu\n",
+					 name, p50 * 1.0e-3, name, p90 * 1.0e-3, name, p99 * 1.0e-3,
+					 name, histogram->getTotal() * 1.0e-3, name, histogram->getCount());
+		} else {
+			snprintf(line, sizeof(line),
+					 "%s\"%s\":{\"count\":%llu,\"p50\":%.4f,\"p90\":%.4f,\"p99\":%.4f,\"max\":%.4f}",
+					 first ? "" : ",", histogram->getName(), histogram->getCount(),
+					 p50, p90, p99, histogram->getMax());
+		}
+		text += line;
+		first = false;
+	}
+	if (!prometheus) text += "}}\n";
+	return text;
+}
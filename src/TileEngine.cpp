@@ -0,0 +1,247 @@
+#include "../inc/TileEngine.hpp"
+
+#define COLUMN_0 0x0101010101010101ULL	/* column 0 of every row of a tile */
+#define COLUMN_7 0x8080808080808080ULL	/* column 7 of every row of a tile */
+
+/**
+* Spread the bits of a number to the even bits.
+* @param value number below TILE_SQUARE
+* @return value with a zero bit after every bit
+*/
+static inline unsigned int spread(unsigned int value) {
+	value = (value | (value << 4)) & 0x0F0F;
+	value = (value | (value << 2)) & 0x3333;
+	value = (value | (value << 1)) & 0x5555;
+	return value;
+}
+
+/**
+* Collect the even bits of a number, inverse of spread().
+* @param value Z-order index within a square
+* @return number below TILE_SQUARE
+*/
+static inline unsigned int compact(unsigned int value) {
+	value &= 0x5555;
+	value = (value | (value >> 1)) & 0x3333;
+	value = (value | (value >> 2)) & 0x0F0F;
+	value = (value | (value >> 4)) & 0x00FF;
+	return value;
+}
+
+/* Cells of a tile seen from its neighbour cells, the missing column or row from the next tile */
+static inline unsigned long long fromWest(unsigned long long centre, unsigned long long west) {
+	return ((centre << 1) & ~COLUMN_0) | ((west >> 7) & COLUMN_0);
+}
+static inline unsigned long long fromEast(unsigned long long centre, unsigned long long east) {
+	return ((centre >> 1) & ~COLUMN_7) | ((east << 7) & COLUMN_7);
+}
+static inline unsigned long long fromNorth(unsigned long long centre, unsigned long long north) {
+	return (centre << 8) | (north >> 56);
+}
+static inline unsigned long long fromSouth(unsigned long long centre, unsigned long long south) {
+	return (centre >> 8) | (south << 56);
+}
+
+/**
+* Add one neighbour to the bit-sliced counts of all cells of a tile.
+* @param count bit b of the number of neighbours of every cell in count[b]
+* @param neighbours 1 for every cell with this neighbour alive
+*/
+static inline void addNeighbours(unsigned long long count[4], unsigned long long neighbours) {
+	for (int b = 0; b < 4; b++) {
+		const unsigned long long carry = count[b] & neighbours;
+		count[b] ^= neighbours;
+		neighbours = carry;
+	}
+}
+
+int TileEngine::setup(int width, int height, int topology) {
+	freeMem();
+
+	boardSize[0] = width;
+	boardSize[1] = height;
+	tileSize[0] = (width + TILE_SIZE-1) / TILE_SIZE;
+	tileSize[1] = (height + TILE_SIZE-1) / TILE_SIZE;
+	const int gridSize[2] = {tileSize[0] + 2, tileSize[1] + 2};
+	squares[0] = (gridSize[0] + squareSize-1) / squareSize;
+	squares[1] = (gridSize[1] + squareSize-1) / squareSize;
+	tileCount = (size_t)squares[0]*squares[1]*squareSize*squareSize;
+
+	tiles = (unsigned long long *)calloc(tileCount, sizeof(unsigned long long));
+	next = (unsigned long long *)calloc(tileCount, sizeof(unsigned long long));
+	tileIndexX = (size_t *)malloc(gridSize[0] * sizeof(size_t));
+	tileIndexY = (size_t *)malloc(gridSize[1] * sizeof(size_t));
+	ringGhost = (size_t *)malloc((2*(width + 2) + 2*height) * sizeof(size_t));
+	ringSource = (size_t *)malloc((2*(width + 2) + 2*height) * sizeof(size_t));
+	if (tiles == NULL || next == NULL || tileIndexX == NULL || tileIndexY == NULL
+		|| ringGhost == NULL || ringSource == NULL)
+		return -1;
+
+	/* Z-order inside of a square, squares row by row */
+	const size_t squareTiles = squareSize*squareSize;
+	for (int gx = 0; gx < gridSize[0]; gx++)
+		tileIndexX[gx] = spread(gx % squareSize) + (gx / squareSize)*squareTiles;
+	for (int gy = 0; gy < gridSize[1]; gy++)
+		tileIndexY[gy] = (spread(gy % squareSize) << 1) + (gy / squareSize)*squares[0]*squareTiles;
+
+	/* Board cells of the last tile column and row */
+	const int lastColumn = (width - 1) % TILE_SIZE, lastRow = (height - 1) % TILE_SIZE;
+	lastMasks[0] = ((2ULL << lastColumn) - 1) * COLUMN_0;
+	lastMasks[1] = lastRow == TILE_SIZE-1 ? ~0ULL : (1ULL << (TILE_SIZE*(lastRow + 1))) - 1;
+
+	/* Ghost cells standing for a board cell, dead ones are never set */
+	ringCount = 0;
+	for (int y = -1; y <= height; y++) {
+		for (int x = -1; x <= width; x++) {
+			if (y >= 0 && y < height && x == 0) x = width;
+			int sourceX = x, sourceY = y;
+			if (!ghostSource(topology, width, height, sourceX, sourceY)) continue;
+			ringGhost[ringCount] = bit(x, y);
+			ringSource[ringCount] = bit(sourceX, sourceY);
+			ringCount++;
+		}
+	}
+
+	return 0;
+}
+
+void TileEngine::freeMem() {
+	free(tiles);
+	free(next);
+	free(tileIndexX);
+	free(tileIndexY);
+	free(ringGhost);
+	free(ringSource);
+	tiles = next = NULL;
+	tileIndexX = tileIndexY = ringGhost = ringSource = NULL;
+	ringCount = 0;
+}
+
+int TileEngine::setRules(const unsigned char *_rules, unsigned int _neighbourhood) {
+	for (int i = 0; i < 18; i++)
+		rules[i] = _rules[i] >> 7;
+	neighbourhood = _neighbourhood;
+	return 0;
+}
+
+void TileEngine::load(const unsigned char *image) {
+	memset(tiles, 0, tileCount * sizeof(unsigned long long));
+	memset(next, 0, tileCount * sizeof(unsigned long long));
+	for (int y = 0; y < boardSize[1]; y++) {
+		for (int x = 0; x < boardSize[0]; x++) {
+			size_t b = bit(x, y);
+			if (image[4*x + (4*boardSize[0]*y)] >> 7)
+				tiles[b >> 6] |= 1ULL << (b & 63);
+		}
+	}
+	fillRing();
+}
+
+void TileEngine::store(unsigned char *image) {
+	for (int y = 0; y < boardSize[1]; y++) {
+		for (int x = 0; x < boardSize[0]; x++) {
+			size_t b = bit(x, y);
+			unsigned char color = ((tiles[b >> 6] >> (b & 63)) & 1) ? 255 : 0;
+			unsigned char *pixel = &image[4*x + (4*boardSize[0]*y)];
+			pixel[0] = color;
+			pixel[1] = color;
+			pixel[2] = color;
+			pixel[3] = 1;
+		}
+	}
+}
+
+void TileEngine::fillRing() {
+	for (int r = 0; r < ringCount; r++) {
+		const size_t ghost = ringGhost[r], source = ringSource[r];
+		const unsigned long long mask = 1ULL << (ghost & 63);
+		if ((tiles[source >> 6] >> (source & 63)) & 1)
+			tiles[ghost >> 6] |= mask;
+		else
+			tiles[ghost >> 6] &= ~mask;
+	}
+}
+
+void TileEngine::nextGeneration() {
+	switch (neighbourhood) {
+	case NEIGHBOURHOOD_MOORE:
+		nextGenerationMasked<NEIGHBOURHOOD_MOORE>();
+		break;
+	case NEIGHBOURHOOD_VON_NEUMANN:
+		nextGenerationMasked<NEIGHBOURHOOD_VON_NEUMANN>();
+		break;
+	case NEIGHBOURHOOD_HEXAGONAL:
+		nextGenerationMasked<NEIGHBOURHOOD_HEXAGONAL>();
+		break;
+	default:
+		nextGenerationMasked<NEIGHBOURHOOD_CUSTOM>();
+		break;
+	}
+
+	unsigned long long *tmp = tiles;
+	tiles = next;
+	next = tmp;
+	fillRing();
+}
+
+template <unsigned int MASK>
+void TileEngine::nextGenerationMasked() {
+	const unsigned int m = (MASK != NEIGHBOURHOOD_CUSTOM) ? MASK : neighbourhood;
+	const size_t squareTiles = squareSize*squareSize;
+
+	/* Walk the tiles in the order they are stored */
+	for (int sy = 0; sy < squares[1]; sy++) {
+		for (int sx = 0; sx < squares[0]; sx++) {
+			const size_t square = ((size_t)sy*squares[0] + sx) * squareTiles;
+			for (unsigned int z = 0; z < squareTiles; z++) {
+				const int tx = sx*squareSize + (int)compact(z) - 1;
+				const int ty = sy*squareSize + (int)compact(z >> 1) - 1;
+				if (tx < 0 || tx >= tileSize[0] || ty < 0 || ty >= tileSize[1]) continue;
+
+				const size_t west = tileIndexX[tx], east = tileIndexX[tx + 2];
+				const size_t north = tileIndexY[ty], south = tileIndexY[ty + 2];
+				const size_t column = tileIndexX[tx + 1], row = tileIndexY[ty + 1];
+				const unsigned long long nw = tiles[west + north], n = tiles[column + north], ne = tiles[east + north];
+				const unsigned long long w = tiles[west + row], centre = tiles[square + z], e = tiles[east + row];
+				const unsigned long long sw = tiles[west + south], s = tiles[column + south], se = tiles[east + south];
+
+				/* Dead tiles stay dead without birth on 0 neighbours */
+				if (!rules[0] && !(nw | n | ne | w | centre | e | sw | s | se)) {
+					next[square + z] = 0;
+					continue;
+				}
+
+				/* Rows above and below, shifted so each cell sees its neighbours */
+				const unsigned long long up = fromNorth(centre, n), down = fromSouth(centre, s);
+				const unsigned long long upWest = fromNorth(w, nw), upEast = fromNorth(e, ne);
+				const unsigned long long downWest = fromSouth(w, sw), downEast = fromSouth(e, se);
+
+				/* Bit-sliced count of the neighbours of all 64 cells */
+				unsigned long long count[4] = {0, 0, 0, 0};
+				if (m & 0x001) addNeighbours(count, fromWest(up, upWest));
+				if (m & 0x002) addNeighbours(count, up);
+				if (m & 0x004) addNeighbours(count, fromEast(up, upEast));
+				if (m & 0x008) addNeighbours(count, fromWest(centre, w));
+				if (m & 0x020) addNeighbours(count, fromEast(centre, e));
+				if (m & 0x040) addNeighbours(count, fromWest(down, downWest));
+				if (m & 0x080) addNeighbours(count, down);
+				if (m & 0x100) addNeighbours(count, fromEast(down, downEast));
+
+				/* Next state by the rules for every number of neighbours */
+				unsigned long long result = 0;
+				for (int neighbours = 0; neighbours < 9; neighbours++) {
+					if (!rules[neighbours] && !rules[9+neighbours]) continue;
+					unsigned long long equal = ~0ULL;
+					for (int b = 0; b < 4; b++)
+						equal &= ((neighbours >> b) & 1) ? count[b] : ~count[b];
+					result |= equal & ((rules[neighbours] ? ~centre : 0) | (rules[9+neighbours] ? centre : 0));
+				}
+
+				/* Cells outside of a board with a size not divisible by 8 stay dead */
+				if (tx == tileSize[0]-1) result &= lastMasks[0];
+				if (ty == tileSize[1]-1) result &= lastMasks[1];
+				next[square + z] = result;
+			}
+		}
+	}
+}
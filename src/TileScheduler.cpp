@@ -0,0 +1,143 @@
+#include <cstdio>
+#include <algorithm>
+
+#include "../inc/TileScheduler.hpp"
+using namespace std;
+
+int TileScheduler::setup(int width, int height, bool _wrapping, BandPool &pool) {
+	if (width <= 0 || height <= 0 || pool.getBands() < 1) return -1;
+
+	boardSize[0] = width;
+	boardSize[1] = height;
+	tileCount[0] = (width + SCHEDULER_TILE-1) / SCHEDULER_TILE;
+	tileCount[1] = (height + SCHEDULER_TILE-1) / SCHEDULER_TILE;
+	wrapping = _wrapping;
+	changed.assign((size_t)tileCount[0]*tileCount[1], 0);
+	invalidate();
+
+	/* A row of tiles starts in exactly one band */
+	workers = pool.getBands();
+	home.resize(tileCount[1]);
+	for (int ty = 0, band = 0; ty < tileCount[1]; ty++) {
+		while (pool.getBandStart(band + 1) <= ty*SCHEDULER_TILE) band++;
+		home[ty] = band;
+	}
+
+	delete[] deques;
+	deques = new WorkerDeque[workers];
+	busy.assign(workers, 0);
+	for (int w = (int)busyTime.size(); w < workers; w++) {
+		char name[32];
+		snprintf(name, sizeof(name), "worker %d busy", w);
+		busyTime.push_back(getMetrics().histogram(name));
+		snprintf(name, sizeof(name), "worker %d idle", w);
+		idleTime.push_back(getMetrics().histogram(name));
+		snprintf(name, sizeof(name), "worker %d tiles", w);
+		tileCounter.push_back(getMetrics().counter(name));
+		snprintf(name, sizeof(name), "worker %d steals", w);
+		stealCounter.push_back(getMetrics().counter(name));
+	}
+	for (int w = 0; w < workers; w++)
+		deques[w].random.seed(w + 1);
+	return 0;
+}
+
+void TileScheduler::distribute() {
+	const int columns = tileCount[0], rows = tileCount[1];
+
+	/* Changes on one edge reach the others through the ghost border */
+	bool edgeChanged = false;
+	if (wrapping) {
+		for (int tx = 0; tx < columns && !edgeChanged; tx++)
+			edgeChanged = changed[tx] || changed[tx + (size_t)columns*(rows-1)];
+		for (int ty = 0; ty < rows && !edgeChanged; ty++)
+			edgeChanged = changed[(size_t)columns*ty] || changed[columns-1 + (size_t)columns*ty];
+	}
+
+	unsigned long long skipped = 0;
+	for (int ty = 0; ty < rows; ty++) {
+		WorkerDeque &deque = deques[home[ty]];
+		for (int tx = 0; tx < columns; tx++) {
+			bool active = fullGenerations > 0
+				|| (edgeChanged && (tx == 0 || tx == columns-1 || ty == 0 || ty == rows-1));
+			for (int k = max(ty-1, 0); k <= min(ty+1, rows-1) && !active; k++)
+				for (int i = max(tx-1, 0); i <= min(tx+1, columns-1) && !active; i++)
+					active = changed[i + (size_t)columns*k];
+			if (active) deque.tiles.push_back(tx + columns*ty);
+			else skipped++;
+		}
+	}
+	skippedTiles->add(skipped);
+
+	/* Flags of the active tiles are written again by their workers */
+	for (int w = 0; w < workers; w++)
+		for (size_t t = 0; t < deques[w].tiles.size(); t++)
+			changed[deques[w].tiles[t]] = 0;
+	if (fullGenerations > 0) fullGenerations--;
+}
+
+void TileScheduler::run(BandPool &pool, const function<bool(int, int, int, int)> &tile) {
+	distribute();
+
+	unsigned long long start = metricsNow();
+	pool.runWorkers([&](int worker) { serve(worker, tile); });
+	unsigned long long elapsed = metricsNow() - start;
+
+	for (int w = 0; w < workers; w++) {
+		busyTime[w]->record(busy[w]);
+		idleTime[w]->record(elapsed > busy[w] ? elapsed - busy[w] : 0);
+	}
+}
+
+void TileScheduler::serve(int worker, const function<bool(int, int, int, int)> &tile) {
+	WorkerDeque &own = deques[worker];
+	unsigned long long tiles = 0, steals = 0;
+	unsigned long long start = metricsNow();
+
+	/* Step a tile and keep whether it changed for the next distribution */
+	auto step = [&](int index) {
+		const int x = SCHEDULER_TILE*(index % tileCount[0]), y = SCHEDULER_TILE*(index / tileCount[0]);
+		changed[index] = tile(x, y, min(x + SCHEDULER_TILE, boardSize[0]), min(y + SCHEDULER_TILE, boardSize[1]));
+		tiles++;
+	};
+
+	while (true) {
+		int index;
+		{
+			lock_guard<std::mutex> lock(own.mutex);
+			if (own.tiles.empty()) break;
+			index = own.tiles.back();
+			own.tiles.pop_back();
+		}
+		step(index);
+	}
+
+	/* Nothing is added during a run, so empty deques stay empty */
+	int index;
+	while (steal(worker, index)) {
+		step(index);
+		steals++;
+	}
+
+	busy[worker] = metricsNow() - start;
+	tileCounter[worker]->add(tiles);
+	if (steals) stealCounter[worker]->add(steals);
+}
+
+bool TileScheduler::steal(int worker, int &index) {
+	if (workers < 2) return false;
+
+	/* Start at a random victim and try all others once */
+	const int first = (int)(deques[worker].random() % (workers - 1));
+	for (int v = 0; v < workers - 1; v++) {
+		int victim = (first + v) % (workers - 1);
+		if (victim >= worker) victim++;
+		WorkerDeque &deque = deques[victim];
+		lock_guard<std::mutex> lock(deque.mutex);
+		if (deque.tiles.empty()) continue;
+		index = deque.tiles.front();
+		deque.tiles.pop_front();
+		return true;
+	}
+	return false;
+}
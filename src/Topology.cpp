@@ -0,0 +1,49 @@
+#include <cstring>
+
+#include "../inc/Topology.hpp"
+
+/* Names indexed by topology */
+static const char *topologyNames[] = {"torus", "plane", "klein", "cross"};
+
+void fillGhostBorder(unsigned char *cells, int pitch, int width, int height, int topology) {
+	/* Dead border of the plane */
+	if (topology == TOPOLOGY_PLANE) {
+		memset(cells - pitch - 1, 0, width + 2);
+		memset(cells + pitch*height - 1, 0, width + 2);
+		for (int y = 0; y < height; y++)
+			cells[pitch*y - 1] = cells[pitch*y + width] = 0;
+		return;
+	}
+
+	/* Left and right column, then top and bottom row including corners */
+	for (int y = 0; y < height; y++) {
+		const int ghostX[2] = {-1, width};
+		for (int i = 0; i < 2; i++) {
+			int x = ghostX[i], sourceY = y;
+			ghostSource(topology, width, height, x, sourceY);
+			cells[ghostX[i] + pitch*y] = cells[x + pitch*sourceY];
+		}
+	}
+	for (int x = -1; x <= width; x++) {
+		const int ghostY[2] = {-1, height};
+		for (int i = 0; i < 2; i++) {
+			int sourceX = x, y = ghostY[i];
+			ghostSource(topology, width, height, sourceX, y);
+			cells[x + pitch*ghostY[i]] = cells[sourceX + pitch*y];
+		}
+	}
+}
+
+int parseTopology(const char *name, int *topology) {
+	for (int i = 0; i < 4; i++) {
+		if (!strcmp(name, topologyNames[i])) {
+			*topology = i;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+const char * topologyName(int topology) {
+	return topologyNames[topology];
+}
@@ -0,0 +1,144 @@
+#include "../inc/Trace.hpp"
+#include "../inc/Metrics.hpp"		/* for metrics clock */
+using namespace std;
+
+int Trace::open(const char *_path) {
+	lock_guard<std::mutex> lock(mutex);
+	path = _path;
+
+	/* Fail early instead of losing the trace at exit */
+	FILE *file = fopen(path.c_str(), "w");
+	if (file == NULL) {
+		fprintf(stderr, "Could not open trace file %s\n", _path);
+		return -1;
+	}
+	fclose(file);
+
+	origin = metricsNow();
+	enabled.store(true);
+	return 0;
+}
+
+int Trace::getThreadTrack() {
+	static thread_local int track = -1;
+	if (track < 0) {
+		track = threadNames.size();
+		threadNames.push_back("thread");
+	}
+	return track;
+}
+
+void Trace::setThreadName(const char *name) {
+	if (!isEnabled()) return;
+	lock_guard<std::mutex> lock(mutex);
+	threadNames[getThreadTrack()] = name;
+}
+
+void Trace::append(const TraceEvent &event) {
+	if (events.size() < TRACE_MAX_EVENTS) events.push_back(event);
+	else dropped++;
+}
+
+void Trace::addHostEvent(const char *name, unsigned long long start, unsigned long long end) {
+	if (!isEnabled()) return;
+	lock_guard<std::mutex> lock(mutex);
+	TraceEvent event = {name, getThreadTrack(), start, end, 0};
+	append(event);
+}
+
+void Trace::addDeviceCommand(const char *name, cl_event event, unsigned long long queued) {
+	if (!isEnabled() || event == NULL) return;
+	lock_guard<std::mutex> lock(mutex);
+	clRetainEvent(event);
+	pending.push_back(event);
+	pendingNames.push_back(name);
+	pendingQueued.push_back(queued);
+	resolveCommands(false);
+}
+
+void Trace::resolveCommands(bool wait) {
+	unsigned int kept = 0;
+	for (unsigned int i = 0; i < pending.size(); i++) {
+		cl_int status = CL_COMPLETE;
+		if (wait)
+			clWaitForEvents(1, &pending[i]);
+		else
+			clGetEventInfo(pending[i], CL_EVENT_COMMAND_EXECUTION_STATUS,
+						   sizeof(cl_int), &status, NULL);
+		if (status != CL_COMPLETE) {
+			pending[kept] = pending[i];
+			pendingNames[kept] = pendingNames[i];
+			pendingQueued[kept] = pendingQueued[i];
+			kept++;
+			continue;
+		}
+
+		/* Device times relative to the time the command was queued */
+		cl_ulong queued = 0, submit = 0, start = 0, end = 0;
+		clGetEventProfilingInfo(pending[i], CL_PROFILING_COMMAND_QUEUED, sizeof(cl_ulong), &queued, NULL);
+		clGetEventProfilingInfo(pending[i], CL_PROFILING_COMMAND_SUBMIT, sizeof(cl_ulong), &submit, NULL);
+		clGetEventProfilingInfo(pending[i], CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL);
+		clGetEventProfilingInfo(pending[i], CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+		clReleaseEvent(pending[i]);
+
+		unsigned long long host = pendingQueued[i];
+		TraceEvent waiting = {pendingNames[i], TRACE_QUEUE_TID, host, host + (start - queued), host + (submit - queued)};
+		TraceEvent running = {pendingNames[i], TRACE_DEVICE_TID, host + (start - queued), host + (end - queued), host + (submit - queued)};
+		append(waiting);
+		append(running);
+	}
+	pending.resize(kept);
+	pendingNames.resize(kept);
+	pendingQueued.resize(kept);
+}
+
+/* Microseconds since opening the trace */
+static inline double traceTime(unsigned long long time, unsigned long long origin) {
+	return time >= origin ? (time - origin) * 1.0e-3 : -((origin - time) * 1.0e-3);
+}
+
+int Trace::close() {
+	if (!isEnabled()) return 0;
+	enabled.store(false);
+	lock_guard<std::mutex> lock(mutex);
+	resolveCommands(true);
+
+	FILE *file = fopen(path.c_str(), "w");
+	if (file == NULL) {
+		fprintf(stderr, "Could not open trace file %s\n", path.c_str());
+		return -1;
+	}
+
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"GameOfLife\"}}");
+	for (unsigned int tid = 0; tid < threadNames.size(); tid++)
+		fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+				tid, threadNames[tid].c_str());
+	fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%i,\"args\":{\"name\":\"OpenCL device\"}}",
+			TRACE_DEVICE_TID);
+	fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%i,\"args\":{\"name\":\"OpenCL queue\"}}",
+			TRACE_QUEUE_TID);
+
+	for (unsigned int i = 0; i < events.size(); i++) {
+		const TraceEvent &event = events[i];
+		fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%i,\"ts\":%.3f,\"dur\":%.3f",
+				event.name, event.submit ? "device" : "host", event.tid,
+				traceTime(event.start, origin), (event.end - event.start) * 1.0e-3);
+		if (event.tid == TRACE_QUEUE_TID)
+			fprintf(file, ",\"args\":{\"queued to submit us\":%.3f,\"submit to start us\":%.3f}",
+					(event.submit - event.start) * 1.0e-3, (event.end - event.submit) * 1.0e-3);
+		fprintf(file, "}");
+	}
+	fprintf(file, "\n]}\n");
+
+	if (dropped > 0)
+		fprintf(stderr, "Trace was full, dropped %lu events\n", dropped);
+	events.clear();
+	return fclose(file) == 0 ? 0 : -1;
+}
+
+Trace & getTrace() {
+	/* Never destroyed, so the trace can still be written by exit handlers */
+	static Trace *trace = new Trace();
+	return *trace;
+}
@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <dirent.h>					/* for reading pattern directories */
+#include <sys/stat.h>
+
+#include "../inc/Verifier.hpp"
+#include "../inc/PatternFile.hpp"	/* for size of patterns */
+using namespace std;
+
+/**
+* 64 bit FNV-1a digest of cell states.
+* @param states one state per cell
+* @param cells number of cells
+* @return digest
+*/
+static unsigned long long digest(const unsigned char *states, size_t cells) {
+	unsigned long long hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < cells; i++)
+		hash = (hash ^ states[i]) * 1099511628211ULL;
+	return hash;
+}
+
+/**
+* Copy a string, for APIs taking non-const strings.
+* @param text string
+* @return characters with terminating zero
+*/
+static vector<char> writable(const string &text) {
+	return vector<char>(text.c_str(), text.c_str() + text.size() + 1);
+}
+
+int Verifier::setEngines(const char *list) {
+	string text(list);
+	size_t comma = text.find(',');
+	if (comma == string::npos) return -1;
+	engines[0] = text.substr(0, comma);
+	engines[1] = text.substr(comma + 1);
+	for (int i = 0; i < 2; i++)
+		if (engines[i] != "opencl" && engines[i] != "pixel" && engines[i] != "block"
+			&& engines[i] != "changes" && engines[i] != "sparse" && engines[i] != "tiles"
+			&& engines[i] != "rowtiles")
+			return -1;
+	return 0;
+}
+
+void Verifier::findPatterns(const string &path, vector<string> &files) {
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0) return;
+	if (!S_ISDIR(info.st_mode)) {
+		files.push_back(path);
+		return;
+	}
+
+	DIR *directory = opendir(path.c_str());
+	if (directory == NULL) return;
+	vector<string> names;
+	struct dirent *entry;
+	while ((entry = readdir(directory)) != NULL)
+		if (entry->d_name[0] != '.') names.push_back(entry->d_name);
+	closedir(directory);
+
+	sort(names.begin(), names.end());
+	for (unsigned int i = 0; i < names.size(); i++) {
+		string child = path + "/" + names[i];
+		if (stat(child.c_str(), &info) != 0) continue;
+		if (S_ISDIR(info.st_mode))
+			findPatterns(child, files);
+		else if (child.size() > 4 && child.substr(child.size() - 4) == ".rle")
+			files.push_back(child);
+	}
+}
+
+int Verifier::run(const char *path) {
+	vector<string> files;
+	findPatterns(path, files);
+	if (files.empty()) {
+		fprintf(stderr, "No patterns found in %s\n", path);
+		return -1;
+	}
+
+	printf("Verify %s against %s for %lu generations\n",
+		   engines[0].c_str(), engines[1].c_str(), generations);
+	for (unsigned int i = 0; i < files.size(); i++) {
+		for (int t = TOPOLOGY_TORUS; t <= TOPOLOGY_CROSS; t++) {
+			if (topology >= 0 && t != topology) continue;
+			int status = verifyPattern(files[i], t);
+			runs++;
+			if (status > 0) diverged++;
+			if (status < 0) skipped++;
+		}
+	}
+
+	printf("%lu runs: %lu agree, %lu diverged, %lu skipped\n",
+		   runs, runs - diverged - skipped, diverged, skipped);
+	return diverged == 0 && skipped < runs ? 0 : -1;
+}
+
+int Verifier::setupGame(GameOfLife &game, const string &engine, const string &file,
+						int _topology, const int boardSize[2]) {
+	vector<char> name = writable(file);
+	vector<char> gameRule = writable(rule.empty() ? "23/3" : rule);
+	game.setFilename(&name[0]);
+	if (game.setRule(&gameRule[0]) != 0) return -1;
+	if (engine != "opencl" && game.setCPUEngine(engine.c_str()) != 0) return -1;
+	if (engine != "opencl") game.setCPUOnly();
+	game.setTopology(_topology);
+	game.setKernelBuildOptions("", "");
+	game.setSize(boardSize[0], boardSize[1]);
+	return game.setup();
+}
+
+int Verifier::verifyPattern(const string &file, int _topology) {
+	const char *mode = topologyName(_topology);
+
+	/* Default board leaves a margin, even for the block engine on the torus */
+	int boardSize[2] = {size[0], size[1]};
+	if (boardSize[0] <= 0 || boardSize[1] <= 0) {
+		PatternFile pattern;
+		vector<char> name = writable(file);
+		pattern.setFilename(&name[0]);
+		if (pattern.parse() != 0) {
+			printf("%s %s: cannot parse pattern, skipped\n", file.c_str(), mode);
+			return -1;
+		}
+		boardSize[0] = max(VERIFY_MIN_SIZE, (pattern.getWidth() + 2*VERIFY_MARGIN + 1) & ~1);
+		boardSize[1] = max(VERIFY_MIN_SIZE, (pattern.getHeight() + 2*VERIFY_MARGIN + 1) & ~1);
+	}
+
+	GameOfLife games[2];
+	for (int i = 0; i < 2; i++) {
+		if (setupGame(games[i], engines[i], file, _topology, boardSize) != 0) {
+			printf("%s %s: %s cannot run this pattern, skipped\n",
+				   file.c_str(), mode, engines[i].c_str());
+			return -1;
+		}
+	}
+
+	/* Compare starting population and every generation */
+	const size_t cells = (size_t)boardSize[0] * boardSize[1];
+	vector<unsigned char> states[2] = {vector<unsigned char>(cells), vector<unsigned char>(cells)};
+	unsigned long long digests[2] = {0, 0};
+	for (unsigned long generation = 0; generation <= generations; generation++) {
+		if (generation > 0) {
+			games[0].step(1);
+			games[1].step(1);
+		}
+		for (int i = 0; i < 2; i++) {
+			games[i].getRegion(0, 0, boardSize[0], boardSize[1], &states[i][0]);
+			digests[i] = digest(&states[i][0], cells);
+		}
+		if (digests[0] == digests[1]) continue;
+
+		size_t cell = 0;
+		while (cell < cells && states[0][cell] == states[1][cell])
+			cell++;
+		printf("%s %s %ix%i: diverged at generation %lu, cell (%i,%i) is %i with %s and %i with %s\n",
+			   file.c_str(), mode, boardSize[0], boardSize[1], generation,
+			   (int)(cell % boardSize[0]), (int)(cell / boardSize[0]),
+			   states[0][cell], engines[0].c_str(), states[1][cell], engines[1].c_str());
+		return 1;
+	}
+
+	printf("%s %s %ix%i: agree, digest %016llx\n",
+		   file.c_str(), mode, boardSize[0], boardSize[1], digests[0]);
+	return 0;
+}
@@ -4,22 +4,67 @@
 #ifndef TPBY
 #define TPBY 12		// work items (threads) per work group (block) Y
 #endif
+#ifndef NEIGHBOURHOOD
+#define NEIGHBOURHOOD 0x1EF	// 3x3 mask, bit 3*(k+1)+(i+1) for neighbour (i,k): Moore
+#endif
 
-/* properties for reading/writing images */
-#ifdef CLAMP
-sampler_t sampler = CLK_NORMALIZED_COORDS_FALSE |
-							CLK_ADDRESS_CLAMP | CLK_FILTER_NEAREST;
-#else
-sampler_t sampler = CLK_NORMALIZED_COORDS_TRUE |
-							CLK_ADDRESS_REPEAT | CLK_FILTER_NEAREST;
+/*
+ * With BIRTH_MASK and SURVIVE_MASK the rule is baked in at compile time,
+ * bit n is set for birth/survival with n neighbours.
+ * Else the rules buffer is used.
+ */
+#if defined(BIRTH_MASK) && defined(SURVIVE_MASK)
+#define BAKED_RULE
 #endif
 
+/* Apply OP(i,k) to every neighbour of the neighbourhood, fully unrolled */
+#define FOR_EACH_NEIGHBOUR(OP) \
+	if (NEIGHBOURHOOD & 0x001) OP(-1,-1); \
+	if (NEIGHBOURHOOD & 0x002) OP( 0,-1); \
+	if (NEIGHBOURHOOD & 0x004) OP( 1,-1); \
+	if (NEIGHBOURHOOD & 0x008) OP(-1, 0); \
+	if (NEIGHBOURHOOD & 0x020) OP( 1, 0); \
+	if (NEIGHBOURHOOD & 0x040) OP(-1, 1); \
+	if (NEIGHBOURHOOD & 0x080) OP( 0, 1); \
+	if (NEIGHBOURHOOD & 0x100) OP( 1, 1);
+
+/* Topologies of the board, see Topology.hpp */
+#define TOPOLOGY_TORUS 0
+#define TOPOLOGY_PLANE 1
+#define TOPOLOGY_KLEIN 2
+#define TOPOLOGY_CROSS 3
+
+/*
+ * Find the board cell a cell outside of the board stands for,
+ * returns false if the cell is dead
+ */
+inline bool ghostSource(
+				__private int topology,
+				__private int2 boardDim,
+				__private int2 *cell
+				) {
+	if ((*cell).x < 0 || (*cell).x >= boardDim.x) {
+		if (topology == TOPOLOGY_PLANE) return false;
+		(*cell).x = ((*cell).x + boardDim.x) % boardDim.x;
+		if (topology == TOPOLOGY_CROSS) (*cell).y = boardDim.y-1 - (*cell).y;
+	}
+	if ((*cell).y < 0 || (*cell).y >= boardDim.y) {
+		if (topology == TOPOLOGY_PLANE) return false;
+		(*cell).y = ((*cell).y + boardDim.y) % boardDim.y;
+		if (topology != TOPOLOGY_TORUS) (*cell).x = boardDim.x-1 - (*cell).x;
+	}
+	return true;
+}
+
+/*
+ * properties for reading/writing images,
+ * images have a ghost border of 1 cell, so no read is outside
+ */
+sampler_t sampler = CLK_NORMALIZED_COORDS_FALSE |
+							CLK_ADDRESS_NONE | CLK_FILTER_NEAREST;
+
 inline uint4 getState(
-			#ifdef CLAMP
 				__private int2 coord,
-			#else
-				__private float2 coord,
-			#endif
 				__read_only image2d_t image
 				) {
 	return read_imageui(image, sampler, coord);
@@ -34,76 +79,295 @@ inline void setState(
 }
 
 uchar getNumberOfNeighbours(
-				__private uint4 state,
-			#ifdef CLAMP
 				__private int2 coord,
-			#else
-				__private float2 coord,
-			#endif
-				__private int2 imageDim,
 				__read_only image2d_t image
 				) {
 	
 	uchar counter = 0;
-#ifdef CLAMP
-	int2 neighbourCoord;
-#else
-	float2 neighbourCoord;
-#endif	
-	uint4 neighbourState;
-	
-	for (int i=-1; i<=1; i++) {
-		for (int k=-1; k<=1; k++) {
-		#ifdef CLAMP
-			neighbourCoord = (int2)(coord.x+i,coord.y+k);
-		#else
-			neighbourCoord =
-				(float2)( (float)coord.x+((float)i/(float)imageDim.x),
-						  (float)coord.y+((float)k/(float)imageDim.x)
-						 );
-		#endif
-			neighbourState = getState(neighbourCoord, image);
-			counter += (neighbourState.x >> 7);
-		}
-	}
 	
-	return (counter - (state.x >> 7));
+	#define COUNT_NEIGHBOUR(i,k) \
+		counter += (getState((int2)(coord.x+(i),coord.y+(k)), image).x >> 7)
+	FOR_EACH_NEIGHBOUR(COUNT_NEIGHBOUR)
+	#undef COUNT_NEIGHBOUR
+	
+	return counter;
 }
 
+/*
+ * Work-items cover the board and its ghost border. A work-item of the
+ * border calculates the cell it stands for in the topology, so the next
+ * generation has its border filled and neighbour reads need no checks.
+ */
 __kernel
 __attribute__( (reqd_work_group_size(TPBX, TPBY, 1)) )
 	void nextGeneration(
 		__read_only image2d_t imageA,
 		__write_only image2d_t imageB,
-		__constant uchar *rules
+		__constant uchar *rules,
+		__private int topology
 		) {
 	
-	/* Get image dimensions */
-	__private int2 imageDim = get_image_dim(imageA);
-	/* Get coordinates of current cell */
-	__private int2 coord = (int2)(get_global_id(0),get_global_id(1));
+	/* Get board dimensions without ghost border */
+	__private int2 boardDim = get_image_dim(imageA) - 2;
+	/* Get board coordinates of written cell, -1 and boardDim are the border */
+	__private int2 ghost = (int2)(get_global_id(0),get_global_id(1)) - 1;
 	
 	/* Only valid coordinates calculate next generation */
-	if (!(coord.x<imageDim.x) || !(coord.y<imageDim.y)) return;
+	if (!(ghost.x<=boardDim.x) || !(ghost.y<=boardDim.y)) return;
+	
+	/* Border cells of the plane stay dead */
+	__private int2 coord = ghost;
+	if (!ghostSource(topology, boardDim, &coord)) {
+		setState(ghost + 1, (uint4)(0,0,0,1), imageB);
+		return;
+	}
+	coord += 1;
 	
-#ifdef CLAMP
 	/* Get state of current cell from current generation (imageA) */
 	__private uint4 state = getState(coord, imageA);
 	/* Get number of neighbours of current cell from current generation (imageA)*/
-	__private uchar numberOfNeighbours =
-				getNumberOfNeighbours(state, coord, imageDim, imageA);
-#else
-	/* Calculate normalized coords which are required for read_imageui */
-	__private float2 coordNormalized = (float2)((float)coord.x/(float)imageDim.x,
-									  (float)coord.y/(float)imageDim.y);
-	/* Get state of current cell from current generation (imageA) */
-	__private uint4 state = getState(coordNormalized, imageA);
-	/* Get number of neighbours of current cell from current generation (imageA)*/
-	__private uchar numberOfNeighbours =
-				getNumberOfNeighbours(state, coordNormalized, imageDim, imageA);
-#endif
+	__private uchar numberOfNeighbours = getNumberOfNeighbours(coord, imageA);
 	/* Write state of cell in next generation to imageB according to rules */
+#ifdef BAKED_RULE
+	__private uchar next =
+		((((state.x >> 7) ? SURVIVE_MASK : BIRTH_MASK) >> numberOfNeighbours) & 1) ? 255 : 0;
+	setState(ghost + 1, (uint4)(next,next,next,1), imageB);
+#else
 	__private uchar i = numberOfNeighbours + 9*(state.x >> 7);
-	setState(coord, (uint4)(rules[i],rules[i],rules[i],1), imageB);
+	setState(ghost + 1, (uint4)(rules[i],rules[i],rules[i],1), imageB);
+#endif
+	
+}
+
+/*
+ * Copy a board uploaded without ghost border and fill the border
+ */
+__kernel
+	void copyGhostBorder(
+		__read_only image2d_t imageA,
+		__write_only image2d_t imageB,
+		__private int topology
+		) {
+	
+	__private int2 boardDim = get_image_dim(imageA) - 2;
+	__private int2 ghost = (int2)(get_global_id(0),get_global_id(1)) - 1;
+	if (!(ghost.x<=boardDim.x) || !(ghost.y<=boardDim.y)) return;
+	
+	__private int2 coord = ghost;
+	__private uint4 state = (uint4)(0,0,0,1);
+	if (ghostSource(topology, boardDim, &coord))
+		state = getState(coord + 1, imageA);
+	setState(ghost + 1, state, imageB);
+}
+
+
+/*
+ * Density pyramid: level k has one texel per 2^k x 2^k cells
+ * holding the average color of its cells, the ghost border is skipped
+ */
+sampler_t densitySampler = CLK_NORMALIZED_COORDS_FALSE |
+							CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
+
+__kernel
+	void densityLevel(
+		__read_only image2d_t image,
+		__global uchar *texels,
+		__private int level,
+		__private int2 origin,
+		__private int2 size
+		) {
+	
+	__private int2 texel = (int2)(get_global_id(0), get_global_id(1));
+	
+	/* Only valid texels are calculated */
+	if (!(texel.x<size.x) || !(texel.y<size.y)) return;
 	
+	__private int2 first = (origin + texel) << level;
+	__private int2 last = min(first + (1 << level), get_image_dim(image) - 2);
+	__private ulong sum = 0;
+	for (int y = first.y; y < last.y; y++)
+		for (int x = first.x; x < last.x; x++)
+			sum += read_imageui(image, densitySampler, (int2)(x + 1, y + 1)).x;
+	
+	__private ulong count = (ulong)(last.x - first.x) * (last.y - first.y);
+	texels[texel.y*size.x + texel.x] = count ? sum / count : 0;
+}
+
+/*
+ * Multi-state (Generations) rules on packed boards
+ */
+#ifndef CELL_BITS
+#define CELL_BITS 8		// bits per cell: 2, 4 or 8
+#endif
+#define CELLS_PER_BYTE (8/CELL_BITS)
+#define CELL_MASK ((1<<CELL_BITS)-1)
+#define FIRING 1
+
+inline uchar getPackedState(
+				__private int x,
+				__private int y,
+				__private int2 boardDim,
+				__private uint rowBytes,
+				__private int topology,
+				__global const uchar *cells
+				) {
+	__private int2 cell = (int2)(x, y);
+	if (!ghostSource(topology, boardDim, &cell)) return 0;
+	return (cells[cell.y*rowBytes + cell.x/CELLS_PER_BYTE] >> ((cell.x%CELLS_PER_BYTE)*CELL_BITS))
+			& CELL_MASK;
+}
+
+__kernel
+__attribute__( (reqd_work_group_size(TPBX, TPBY, 1)) )
+	void nextGenerationMultiState(
+		__global const uchar *cellsA,
+		__global uchar *cellsB,
+		__constant uchar *transition,
+		__private int2 boardDim,
+		__private uint rowBytes,
+		__private int topology
+		) {
+	
+	/* Every work-item calculates all cells of one packed byte */
+	__private int byteX = get_global_id(0);
+	__private int y = get_global_id(1);
+	
+	/* Only valid coordinates calculate next generation */
+	if (!(byteX<rowBytes) || !(y<boardDim.y)) return;
+	
+	__private uchar packed = 0;
+	for (int c = 0; c < CELLS_PER_BYTE; c++) {
+		int x = byteX*CELLS_PER_BYTE + c;
+		if (x >= boardDim.x) break;
+		
+		/* Only firing cells are counted as neighbours */
+		uchar numberOfNeighbours = 0;
+		#define COUNT_FIRING(i,k) numberOfNeighbours += \
+			(getPackedState(x+(i), y+(k), boardDim, rowBytes, topology, cellsA) == FIRING)
+		FOR_EACH_NEIGHBOUR(COUNT_FIRING)
+		#undef COUNT_FIRING
+		
+		uchar state = getPackedState(x, y, boardDim, rowBytes, topology, cellsA);
+		uchar next;
+#ifdef BAKED_RULE
+		/* Birth and survival by bitmask, decay of refractory states by table lookup */
+		if (state == 0)
+			next = (BIRTH_MASK >> numberOfNeighbours) & 1;
+		else if (state == FIRING)
+			next = ((SURVIVE_MASK >> numberOfNeighbours) & 1) ? FIRING : 2;
+		else
+			next = transition[numberOfNeighbours + 9*state];
+#else
+		/* Birth, survival and decay of refractory states by table lookup */
+		next = transition[numberOfNeighbours + 9*state];
+#endif
+		packed |= next << (c*CELL_BITS);
+	}
+	cellsB[y*rowBytes + byteX] = packed;
+}
+
+/*
+ * Batched soup search: every work-item advances one small torus.
+ * Rows are bit-packed, bit x of a row is the cell in column x.
+ */
+#ifdef BAKED_RULE
+#ifndef SOUP_BOARD
+#define SOUP_BOARD 32	// width and height of the torus around a soup, at most 32
+#endif
+#ifndef SOUP_STEPS
+#define SOUP_STEPS 32	// generations per launch
+#endif
+#define SOUP_MASK ((uint)(((ulong)1 << SOUP_BOARD) - 1))
+
+/* States of a soup slot */
+#define SOUP_RUNNING 0
+#define SOUP_STABLE 1
+#define SOUP_TIMEOUT 2
+#define SOUP_EMPTY 3
+
+/* Rotate a row on the torus, so column x holds column x+i */
+inline uint shiftRow(uint row, int i) {
+	if (i > 0) return ((row >> i) | (row << (SOUP_BOARD-i))) & SOUP_MASK;
+	if (i < 0) return ((row << -i) | (row >> (SOUP_BOARD+i))) & SOUP_MASK;
+	return row;
 }
+
+/* Calculate the next generation of one row with a bit-sliced neighbour count */
+inline uint nextSoupRow(uint north, uint centre, uint south) {
+	uint rows[3] = {north, centre, south};
+	uint s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+	#define ADD_NEIGHBOUR(i,k) { \
+		uint b = shiftRow(rows[(k)+1], (i)); \
+		uint c0 = s0 & b; s0 ^= b; \
+		uint c1 = s1 & c0; s1 ^= c0; \
+		uint c2 = s2 & c1; s2 ^= c1; \
+		s3 |= c2; }
+	FOR_EACH_NEIGHBOUR(ADD_NEIGHBOUR)
+	#undef ADD_NEIGHBOUR
+	
+	uint next = 0;
+	for (uint n = 0; n <= 8; n++) {
+		uint count = ((n & 1) ? s0 : ~s0) & ((n & 2) ? s1 : ~s1)
+				   & ((n & 4) ? s2 : ~s2) & ((n & 8) ? s3 : ~s3);
+		if ((BIRTH_MASK >> n) & 1) next |= count & ~centre;
+		if ((SURVIVE_MASK >> n) & 1) next |= count & centre;
+	}
+	return next & SOUP_MASK;
+}
+
+/*
+ * A soup is stable as soon as its board repeats. The board of every
+ * power-of-two generation is kept as checkpoint and compared with every
+ * following generation (Brent's cycle detection), which finds any period
+ * up to the checkpoint generation, e.g. gliders circling the torus.
+ */
+__kernel
+	void nextGenerationSoups(
+		__global uint *soups,
+		__global uint *checkpoints,
+		__global uchar *done,
+		__global uint *generations,
+		__private uint numberOfSoups,
+		__private uint maxGenerations
+		) {
+	
+	__private uint id = get_global_id(0);
+	if (!(id < numberOfSoups) || done[id] != SOUP_RUNNING) return;
+	
+	__private uint rows[SOUP_BOARD], next[SOUP_BOARD], checkpoint[SOUP_BOARD];
+	for (int y = 0; y < SOUP_BOARD; y++) {
+		rows[y] = soups[id*SOUP_BOARD + y];
+		checkpoint[y] = checkpoints[id*SOUP_BOARD + y];
+	}
+	
+	uint gens = generations[id];
+	bool stable = false;
+	for (int step = 0; step < SOUP_STEPS && !stable; step++) {
+		/* Checkpoint at generation 0 and every power of two */
+		if ((gens & (gens - 1)) == 0)
+			for (int y = 0; y < SOUP_BOARD; y++)
+				checkpoint[y] = rows[y];
+		
+		for (int y = 0; y < SOUP_BOARD; y++)
+			next[y] = nextSoupRow(rows[(y+SOUP_BOARD-1) % SOUP_BOARD], rows[y],
+								  rows[(y+1) % SOUP_BOARD]);
+		stable = true;
+		for (int y = 0; y < SOUP_BOARD; y++) {
+			rows[y] = next[y];
+			stable = stable && (rows[y] == checkpoint[y]);
+		}
+		gens++;
+	}
+	
+	for (int y = 0; y < SOUP_BOARD; y++) {
+		soups[id*SOUP_BOARD + y] = rows[y];
+		checkpoints[id*SOUP_BOARD + y] = checkpoint[y];
+	}
+	
+	generations[id] = gens;
+	if (stable)
+		done[id] = SOUP_STABLE;
+	else if (gens >= maxGenerations)
+		done[id] = SOUP_TIMEOUT;
+}
+#endif
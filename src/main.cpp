@@ -20,15 +20,21 @@
 #include <iostream>
 #include <cstring>
 #include <unistd.h>				/* for command line parsing */
+#include <getopt.h>				/* for long options */
 #include <ctime>				/* for time() */
 #include <cstdlib>				/* for srand() and rand() */
-#ifdef WIN32				// Windows system specific
-	#include <windows.h>		/* for QueryPerformanceCounter */
-#else						// Unix based system specific
-	#include <sys/time.h>		/* for gettimeofday() */
-#endif
+#include <thread>				/* for simulation thread */
+#include <mutex>				/* for access to GameOfLife from both threads */
 
 #include "../inc/GameOfLife.hpp"
+#include "../inc/SoupSearch.hpp"
+#include "../inc/TripleBuffer.hpp"
+#include "../inc/Frame.hpp"
+#include "../inc/FrameExport.hpp"
+#include "../inc/Metrics.hpp"
+#include "../inc/Trace.hpp"
+#include "../inc/StatsServer.hpp"
+#include "../inc/Verifier.hpp"
 
 /**
 * Macro for OpenGL buffer offset
@@ -43,8 +49,22 @@ using namespace std;
 /* Create an instance of GameOfLife */
 GameOfLife GameOfLife;
 
+/* Global variables for simulation thread */
+std::thread simulationThread;
+std::mutex gameMutex;			/* guards GameOfLife, resetGame and sleeperBarrier */
+std::atomic<bool> quit(false);	/* stops simulation, set on exit or on failure */
+TripleBuffer frames;			/* finished frames from simulation to display */
+int frameFormat = FRAME_BITS;	/* format of level 0 of frames, see Frame.hpp */
+std::mutex viewMutex;			/* guards requestedView and viewRequested */
+FrameView requestedView;		/* part of the density pyramid the display needs */
+bool viewRequested = false;		/* requestedView changed since the last frame */
+
 /* Global variables for OpenGL */
 GLuint glPBO, glTex, glShader;
+int maxFrameSize[2];			/* size of texture, frames never have more texels */
+FrameView pboView;				/* view of the frame in the PBO */
+FrameView textureView;			/* view of the frame in the texture */
+bool pboFresh = false;			/* PBO holds a frame not copied to the texture yet */
 int GLUTWindowHandle;
 char title[57*(int)sizeof(char)+(int)sizeof(float)+(int)sizeof(int)+(int)sizeof(long)];
 bool mouseLeftDown, mouseRightDown;
@@ -56,18 +76,59 @@ float clampMove = 0.0f;
 bool drawGrid = false;
 bool resetGame = false;
 float sleeperBarrier = 0.0f;
-#ifdef WIN32
-	LARGE_INTEGER frequency;	/* ticks per second */
-	LARGE_INTEGER start;
-	LARGE_INTEGER end;
-#else
-	timeval start;
-	timeval end;
-#endif
-GLfloat gridControlPoints[2][2][3] = {
-		{{-1.0, -1.0, 0.0}, {1.0, -1.0, 0.0}},
-		{{-1.0, 1.0, 0.0}, {1.0, 1.0, 0.0}}
-	};
+unsigned long soups = 0;		/* number of soups for soup search, 0 for interactive mode */
+unsigned long soupSeed = 0;		/* seed for soup search */
+char *exportPath = NULL;		/* path of frame export, NULL for interactive mode */
+int exportEvery = 1;			/* export every k-th generation */
+unsigned long exportGenerations = 1000;	/* number of generations to export */
+int exportLevel = 0;			/* level of density pyramid, downscales by 2^level */
+int exportCrop[4] = {0, 0, 0, 0};	/* exported cells as x, y, width, height */
+Verifier verifier;				/* compares engines in verification mode */
+bool verifyMode = false;		/* run verification instead of the simulation */
+const char *verifyPath = "patterns";	/* patterns of verification mode */
+
+/* Global variables for metrics */
+bool printMetrics = false;		/* print metrics at exit */
+Histogram *stepTime = getMetrics().histogram("step");			/* generations, readback and packing of a frame */
+Histogram *displayTime = getMetrics().histogram("display");		/* one redraw */
+Histogram *pboTime = getMetrics().histogram("pbo map");			/* mapping, filling and unmapping the PBO */
+Histogram *textureTime = getMetrics().histogram("texture upload");	/* copying the PBO to the texture */
+Counter *publishedFrames = getMetrics().counter("frames");		/* frames handed to the display */
+unsigned long long startTime;	/* start of timer in ns */
+StatsServer statsServer;		/* answers requests for counters of the simulation */
+char *statsPath = NULL;			/* path of stats socket, NULL without stats server */
+/* Fragment shader expanding packed frames to colour */
+const char *boardShaderSource =
+	"#version 120\n"
+	"uniform sampler2D board;\n"
+	"uniform bool packedBits;    // 8 cells per texel\n"
+	"uniform vec2 textureSize;   // size of texture in texels\n"
+	"uniform vec2 cellsPerTexel; // cells covered by one texel\n"
+	"uniform bool drawGrid;      // draw lines between cells\n"
+	"void main() {\n"
+	"	vec2 coord = gl_TexCoord[0].st;\n"
+	"	float value;\n"
+	"	if (packedBits) {\n"
+	"		float x = floor(coord.x * textureSize.x * 8.0);\n"
+	"		float texel = floor(texture2D(board,\n"
+	"			vec2((floor(x / 8.0) + 0.5) / textureSize.x, coord.y)).r * 255.0 + 0.5);\n"
+	"		value = mod(floor(texel / exp2(mod(x, 8.0))), 2.0);\n"
+	"	} else {\n"
+	"		value = texture2D(board, coord).r;\n"
+	"	}\n"
+	"	vec3 color = vec3(value);\n"
+	"	if (drawGrid) {\n"
+	"		// Frames start at a cell border, so borders are at whole cells\n"
+	"		vec2 cell = coord * textureSize * cellsPerTexel;\n"
+	"		vec2 pixelsPerCell = 1.0 / max(fwidth(cell), vec2(1e-6));\n"
+	"		vec2 border = min(fract(cell), 1.0 - fract(cell)) * pixelsPerCell;\n"
+	"		float line = 1.0 - clamp(min(border.x, border.y), 0.0, 1.0);\n"
+	"		// Fade out grid if cells are smaller than 8 pixels\n"
+	"		float fade = clamp((min(pixelsPerCell.x, pixelsPerCell.y) - 4.0) / 4.0, 0.0, 1.0);\n"
+	"		color = mix(color, vec3(0.0, 0.2, 1.0), line * fade);\n"
+	"	}\n"
+	"	gl_FragColor = vec4(color, 1.0);\n"
+	"}\n";
 
 /********************************************
 *            Global functions
@@ -77,6 +138,9 @@ void showHelp() {
 	printf( "\n" );
 	printf( "Usage: GameOfLife -f PATH [-l RULE] [ADV OPTIONS] WIDTH [HEIGHT]\n");
 	printf( "  or:  GameOfLife -r DENSITY [-l RULE] [ADV OPTIONS] WIDTH [HEIGHT]\n");
+	printf( "  or:  GameOfLife -s SOUPS [-d SEED] [-l RULE]\n");
+	printf( "  or:  GameOfLife -o FILE [EXPORT OPTIONS] -f PATH|-r DENSITY WIDTH [HEIGHT]\n");
+	printf( "  or:  GameOfLife --verify ENGINE,ENGINE [-f PATH] [-g NUMBER] [-t TOPOLOGY] [WIDTH [HEIGHT]]\n");
 	printf( "\n" );
 	printf( "---- Options ----\n" );
 	printf( " -h            Prints this help\n");
@@ -84,11 +148,66 @@ void showHelp() {
 	printf( " -r DENSITY    Use random starting population with given density\n");
 	printf( " -l RULE       rule for next generations as a list of Survival/Birth\n");
 	printf( "               default: 23/3\n");
+	printf( "               Generations rules add the number of states\n");
+	printf( "               as Survival/Birth/States, e.g. /2/3\n");
+	printf( "               a suffix H or V selects the hexagonal or\n");
+	printf( "               von Neumann neighbourhood, e.g. 34/2H\n");
+	printf( " -n NEIGHBOURS neighbourhood: moore, vonneumann, hex or a 3x3\n");
+	printf( "               mask with bit 3*(dy+1)+(dx+1) per neighbour\n");
+	printf( "               default: moore\n");
 	printf( "               defintion is overwritten when there is a\n");
 	printf( "               rule specified in the file\n");
+	printf( " -e ENGINE     engine for calculating in CPU mode: pixel, block,\n");
+	printf( "               changes, which only evaluates cells next to the\n");
+	printf( "               cells changed in the previous generation,\n");
+	printf( "               sparse, which keeps a sorted list of live cells\n");
+	printf( "               (torus and plane, no rules with birth on 0),\n");
+	printf( "               tiles, which steps 8x8 bit tiles stored in Z-order,\n");
+	printf( "               or rowtiles with the tiles stored row by row\n");
+	printf( "               default: pixel\n");
+	printf( " -t TOPOLOGY   topology of the board: torus, plane (dead border),\n");
+	printf( "               klein (Klein bottle) or cross (cross-surface)\n");
+	printf( "               default: torus\n");
+	printf( " -j THREADS    threads of the pixel engine, each pinned to a CPU\n");
+	printf( "               and owning a band of rows placed on its NUMA node,\n");
+	printf( "               idle threads steal active 64x64 tiles of others,\n");
+	printf( "               -m shows busy and idle time per thread\n");
+	printf( "               default: 1\n");
+	printf( " -s SOUPS      search given number of random 16x16 soups on 32x32 tori\n");
+	printf( "               in batches without OpenGL output and print\n");
+	printf( "               a census of the objects in their ash\n");
+	printf( " -d SEED       seed for soup search\n");
+	printf( "               default: current time\n");
+	printf( " -m            print timing metrics at exit\n");
+	printf( " --cpu         calculate on the CPU only, without OpenCL,\n");
+	printf( "               c does not switch to OpenCL\n");
+	printf( " --trace FILE  write a timeline of host phases and OpenCL commands\n");
+	printf( "               as trace-event JSON for chrome://tracing or Perfetto\n");
+	printf( " --verify ENGINE,ENGINE\n");
+	printf( "               run two of opencl and the engines of -e in lockstep on\n");
+	printf( "               every pattern of -f PATH, default: patterns, on every\n");
+	printf( "               topology or the one of -t for -g generations and\n");
+	printf( "               report the first generation and cell they differ\n");
+	printf( " --stats SOCKET answer requests for generation, rate, population\n");
+	printf( "               and latencies on a Unix domain socket as JSON, or as\n");
+	printf( "               Prometheus text for a request line \"prometheus\"\n");
+	printf( "\n" );
+	printf( "---- Export Options ----\n" );
+	printf( " -o FILE       export frames without OpenGL output, format by\n");
+	printf( "               extension: .png writes one file per frame and\n");
+	printf( "               may contain a pattern like frames/%%06lu.png,\n");
+	printf( "               .ppm and .y4m write a stream, -.ppm and -.y4m\n");
+	printf( "               write it to stdout\n");
+	printf( " -k NUMBER     export every k-th generation\n");
+	printf( "               default: 1\n");
+	printf( " -g NUMBER     number of generations to calculate\n");
+	printf( "               default: 1000\n");
+	printf( " -z LEVEL      downscale by 2^LEVEL, pixels are the density of cells\n");
+	printf( "               default: 0\n");
+	printf( " -w X,Y,W,H    export only the given window of cells\n");
 	printf( "\n" );
 	printf( "---- Advanced OpenCL Options ----\n" );
-	printf( " -c            Use clamp mode for images\n");
+	printf( " -c            Use clamp mode for images, same as -t plane\n");
 	printf( "               default: wrap mode\n");
 	printf( " -x NUMBER     threads per block for x\n");
 	printf( "               default: 32\n");
@@ -101,12 +220,22 @@ void showHelp() {
 int readArguments(int argc, char **argv) {
 	
 	int optionChar;
-	int fSet=0, rSet=0, lSet=0, cSet=0;
+	int fSet=0, rSet=0, lSet=0;
+	int topology = -1;
 	string x(""),y("");
 	extern char *optarg;
 	extern int optind, optopt;
 	
-	while ((optionChar = getopt(argc, argv, ":hf:l:r:cx:y:")) != -1) {
+	static struct option longOptions[] = {
+		{"trace", required_argument, NULL, 'T'},
+		{"stats", required_argument, NULL, 'S'},
+		{"verify", required_argument, NULL, 'V'},
+		{"cpu", no_argument, NULL, 'C'},
+		{NULL, 0, NULL, 0}
+	};
+	
+	while ((optionChar = getopt_long(argc, argv, ":hf:l:r:e:t:j:n:s:d:o:k:g:z:w:mcx:y:",
+									 longOptions, NULL)) != -1) {
 		switch (optionChar) {
 		case 'f':			/* Set filename */
 			if (rSet) {
@@ -114,6 +243,7 @@ int readArguments(int argc, char **argv) {
 				return -1;
 			} else {
 				GameOfLife.setFilename(optarg);
+				verifyPath = optarg;
 				fSet++;
 			}
 			break;
@@ -135,11 +265,95 @@ int readArguments(int argc, char **argv) {
 				fprintf(stderr,"\nError in rule definition\n");
 				return -1;
 			} else {
+				verifier.setRule(optarg);
 				lSet = 2;
 			}
 			break;
+		case 'n':			/* Set neighbourhood */
+			if (GameOfLife.setNeighbourhood(optarg) != 0) {
+				fprintf(stderr,"\nError in neighbourhood definition\n");
+				return -1;
+			}
+			break;
+		case 'e':			/* Set engine for CPU mode */
+			if (GameOfLife.setCPUEngine(optarg) != 0) {
+				fprintf(stderr,"\nUnknown CPU engine %s\n", optarg);
+				return -1;
+			}
+			break;
+		case 'j':			/* Set workers of the pixel engine */
+			if (atoi(optarg) < 1) {
+				fprintf(stderr,"\nNumber of threads must be at least 1\n");
+				return -1;
+			}
+			GameOfLife.setThreads(atoi(optarg));
+			break;
+		case 't':			/* Set topology of the board */
+			if (parseTopology(optarg, &topology) != 0) {
+				fprintf(stderr,"\nUnknown topology %s\n", optarg);
+				return -1;
+			}
+			break;
+		case 's':			/* Set number of soups for soup search */
+			if (atol(optarg) <= 0) {
+				fprintf(stderr,"\nError in number of soups\n");
+				return -1;
+			}
+			soups = strtoul(optarg, NULL, 10);
+			break;
+		case 'd':			/* Set seed for soup search */
+			soupSeed = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':			/* Print metrics at exit */
+			printMetrics = true;
+			break;
+		case 'T':			/* Record trace */
+			if (getTrace().open(optarg) != 0) return -1;
+			getTrace().setThreadName("main");
+			break;
+		case 'V':			/* Set engines of verification mode */
+			if (verifier.setEngines(optarg) != 0) {
+				fprintf(stderr,"\nError in engines to verify\n");
+				return -1;
+			}
+			verifyMode = true;
+			break;
+		case 'C':			/* Calculate without OpenCL */
+			GameOfLife.setCPUOnly();
+			break;
+		case 'S':			/* Set path of stats socket */
+			statsPath = optarg;
+			break;
+		case 'o':			/* Set path of frame export */
+			exportPath = optarg;
+			break;
+		case 'k':			/* Set generations per exported frame */
+			if (atoi(optarg) <= 0) {
+				fprintf(stderr,"\nError in number of generations per frame\n");
+				return -1;
+			}
+			exportEvery = atoi(optarg);
+			break;
+		case 'g':			/* Set number of exported generations */
+			exportGenerations = strtoul(optarg, NULL, 10);
+			break;
+		case 'z':			/* Set level of exported frames */
+			if (atoi(optarg) < 0 || atoi(optarg) > 16) {
+				fprintf(stderr,"\nError in export level\n");
+				return -1;
+			}
+			exportLevel = atoi(optarg);
+			break;
+		case 'w':			/* Set exported window */
+			if (sscanf(optarg, "%i,%i,%i,%i", &exportCrop[0], &exportCrop[1],
+					   &exportCrop[2], &exportCrop[3]) != 4
+				|| exportCrop[2] <= 0 || exportCrop[3] <= 0) {
+				fprintf(stderr,"\nError in export window\n");
+				return -1;
+			}
+			break;
 		case 'c':			/* Set clamp mode for images */
-			cSet++;
+			topology = TOPOLOGY_PLANE;
 			break;
 		case 'x':			/* Set work-items per work group for x */
 			x.append(optarg);
@@ -158,6 +372,25 @@ int readArguments(int argc, char **argv) {
 		}
 	}
 	
+	if (verifyMode) {
+		/* Board size is optional, default fits every pattern */
+		if (argc-optind == 1)
+			verifier.setSize(atoi(argv[optind]), atoi(argv[optind]));
+		else if (argc-optind == 2)
+			verifier.setSize(atoi(argv[optind]), atoi(argv[optind+1]));
+		verifier.setGenerations(exportGenerations);
+		if (topology >= 0) verifier.setTopology(topology);
+		return 0;
+	}
+	
+	if (soups > 0) {
+		if (lSet == 0) {
+			char defaultRule[] = "23/3";
+			GameOfLife.setRule(defaultRule);
+		}
+		return 0;
+	}
+	
 	if (fSet == 0 && rSet == 0) {
 		fprintf(stderr,"\nNo spawn mode specified\n");
 		return -1;
@@ -166,7 +399,8 @@ int readArguments(int argc, char **argv) {
 		char defaultRule[] = "23/3";
 		GameOfLife.setRule(defaultRule);
 	}
-	GameOfLife.setKernelBuildOptions(cSet,x,y);
+	GameOfLife.setTopology(topology >= 0 ? topology : TOPOLOGY_TORUS);
+	GameOfLife.setKernelBuildOptions(x,y);
 	
 	/* Get width and height */
 	switch (argc-optind) {
@@ -197,12 +431,15 @@ void showControls() {
 	cout << "---- by Thomas Rumpf          ----" << endl;
 	cout << "----------------------------------" << endl;
 	printf("Game preferences:\n");
-	printf("rule: %s | mode: %s | width: %i | height: %i \n",
+	printf("rule: %s | mode: %s | CPU engine: %s | width: %i | height: %i \n",
 			GameOfLife.getRule().c_str(),
 			GameOfLife.isFileMode() ? "file" : "random",
+			GameOfLife.getCPUEngine(),
 			GameOfLife.getWidth(), GameOfLife.getHeight());
+	printf("host memory: %s\n",
+			GameOfLife.hasHugePages() ? "reserved huge pages" : "transparent huge pages if enabled");
 	printf("Kernel info: \n");
-	printf("%s\n",GameOfLife.getKernelInfo().c_str());
+	printf("%s\n",GameOfLife.isCPUOnly() ? "none, CPU only" : GameOfLife.getKernelInfo().c_str());
 	printf("\n");
 	printf("Controls:\n");
 	printf(" key  | state | description\n");
@@ -226,6 +463,11 @@ void showControls() {
 
 /* Free host memory */
 void freeMem(void) {
+	/* Stop simulation before releasing anything it uses */
+	quit = true;
+	if (simulationThread.joinable())
+		simulationThread.join();
+	
 	if (glTex) {
 		glDeleteTextures(1, &glTex);
 		glTex = 0;
@@ -237,113 +479,219 @@ void freeMem(void) {
 	}
 	glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
 	if (glShader) {
-		glDeleteProgramsARB(1, &glShader);
+		glDeleteProgram(glShader);
+		glShader = 0;
 	}
 	if (GLUTWindowHandle)
 		glutDestroyWindow(GLUTWindowHandle);
+	
+	statsServer.stop();
+	if (printMetrics)
+		getMetrics().print(stderr);
+	getTrace().close();
 }
 
-/* Get current time in milliseconds */
+/* Get time since last reset of timer in milliseconds */
 inline float getCurrentTime() {
-#ifdef WIN32
-	QueryPerformanceCounter(&end);
-	return ( endCount.QuadPart * (1000.0f / frequency.QuadPart)
-			 - startCount.QuadPart * (1000.0f / frequency.QuadPart)
-			);
-#else
-	gettimeofday(&end, NULL);
-	return ( (float)(end.tv_sec - start.tv_sec) * 1000.0f
-			 + (float)(end.tv_usec - start.tv_usec) / 1000.0f
-			);
-#endif
+	return (metricsNow() - startTime) * 1.0e-6f;
 }
 
 /* Reset timer */
 inline void resetTime() {
-	#ifdef WIN32
-		QueryPerformanceFrequency(&frequency);
-		QueryPerformanceCounter(&start);
-	#else
-		gettimeofday(&start, NULL);
-	#endif
+	startTime = metricsNow();
+}
+
+/* Publish counters of the game to the stats server, never blocks */
+void publishStats() {
+	if (!statsServer.isRunning()) return;
+	SimulationStats stats;
+	memset(&stats, 0, sizeof(stats));
+	stats.generation = GameOfLife.getGenerations();
+	stats.liveCells = GameOfLife.getLiveCells();
+	stats.liveCellsGeneration = GameOfLife.getLiveCellsGeneration();
+	stats.size[0] = GameOfLife.getWidth();
+	stats.size[1] = GameOfLife.getHeight();
+	snprintf(stats.engine, sizeof(stats.engine), "%s",
+			 GameOfLife.isCPUMode() ? GameOfLife.getCPUEngine() : "opencl");
+	stats.paused = GameOfLife.isPaused();
+	statsServer.publish(stats);
 }
 
 /********************************************
-*         GLUT callback functions
+*         Simulation thread
 *********************************************/
-/* functions which change the board before displaying it */
-void displayFunctions() {
-	if(!GameOfLife.isPaused() && getCurrentTime() >= sleeperBarrier) {
-		resetTime();
-	/*
-	 * Calculate next generation if game is not paused
-	 */
-		/*
-		 * Map buffer to host memory space
-		 * and return address of buffer in host address space
-		 *
-         * Note that glMapBufferARB() causes sync issue.
-		 * If GPU is working with this buffer, glMapBufferARB() will wait(stall)
-         * for GPU to finish its job. To avoid waiting (stall), you can call
-         * first glBufferDataARB() with NULL pointer before glMapBufferARB().
-         * If you do that, the previous data in PBO will be discarded and
-         * glMapBufferARB() returns a new allocated pointer immediately
-         * even if GPU is still working with the previous data.
-		 */
-		glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB,
-						4*GameOfLife.getWidth()*GameOfLife.getHeight(),
-						0, GL_STREAM_DRAW_ARB);
-		GLubyte* bufferImage =
-			(GLubyte *)glMapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, GL_WRITE_ONLY_ARB);
+/*
+ * Calculate next generations independent of the display
+ * and publish every finished frame to the triple buffer
+ */
+void simulate() {
+	getTrace().setThreadName("simulation");
+	while (!quit) {
+		/* Take the view the display needs */
+		FrameView view;
+		bool newView;
+		{
+			std::lock_guard<std::mutex> lock(viewMutex);
+			view = requestedView;
+			newView = viewRequested;
+			viewRequested = false;
+		}
 		
-		if (bufferImage) {
-		  	/* Write image of next generation directly on the mapped buffer */
-			int state = GameOfLife.nextGeneration(bufferImage);
-			
-			/* Release the mapped buffer */
-			glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB);
+		bool published = false;
+		{
+			std::lock_guard<std::mutex> lock(gameMutex);
+			if (newView) GameOfLife.setFrameView(view);
 			
-			if (state != 0) exit(-1);
+			if (!GameOfLife.isPaused() && getCurrentTime() >= sleeperBarrier) {
+				resetTime();
+				/* Calculate next generation if game is not paused */
+				ScopedTimer timer(stepTime);
+				if (GameOfLife.nextGeneration(frames.getBackBuffer()) != 0) quit = true;
+				published = true;
+				
+			} else if (GameOfLife.isPaused() && resetGame) {
+				/* Reset game if game is paused */
+				if (GameOfLife.resetGame(frames.getBackBuffer()) != 0) quit = true;
+				published = true;
+				resetGame = false;
+				showControls();
+				
+			} else if (newView) {
+				/* Zoom or pan changed, show current generation in the new view */
+				if (GameOfLife.getFrame(frames.getBackBuffer()) != 0) quit = true;
+				published = true;
+			}
+			publishStats();
 		}
 		
-	} else if (GameOfLife.isPaused() && resetGame) {
+		if (published) {
+			frames.publish();
+			publishedFrames->add();
+		} else	/* Nothing to do while paused or waiting */
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+/********************************************
+*         GLUT callback functions
+*********************************************/
+/* Request the level and texels of the density pyramid for the current camera */
+void updateView() {
+	/* Visible part of the board quad from -1 to 1 after zoom and move */
+	float x0 = -1.0f/cameraDistance - verticalMove;
+	float x1 = 1.0f/cameraDistance - verticalMove;
+	float y0 = -1.0f/cameraDistance - horizontalMove;
+	float y1 = 1.0f/cameraDistance - horizontalMove;
+	float visible[4] = {
+		(x0 + 1.0f) / 2.0f * GameOfLife.getWidth(),
+		(1.0f - y1) / 2.0f * GameOfLife.getHeight(),
+		(x1 + 1.0f) / 2.0f * GameOfLife.getWidth(),
+		(1.0f - y0) / 2.0f * GameOfLife.getHeight()
+	};
+	int pixels[2] = {glutGet(GLUT_WINDOW_WIDTH), glutGet(GLUT_WINDOW_HEIGHT)};
+	
+	FrameView view = makeFrameView(GameOfLife.getWidth(), GameOfLife.getHeight(),
+								   visible, pixels, frameFormat, maxFrameSize);
+	
+	std::lock_guard<std::mutex> lock(viewMutex);
+	if (memcmp(&view, &requestedView, sizeof(FrameView)) != 0) {
+		requestedView = view;
+		viewRequested = true;
+	}
+}
+
+/* Upload the newest finished frame to the PBO */
+void uploadFrame() {
+	if (!frames.update()) return;
+	
+	ScopedTimer timer(pboTime);
+	const unsigned char *frame = frames.getFrontBuffer();
+	memcpy(&pboView, frame, sizeof(FrameView));
+	size_t texelBytes = frameSizeBytes(pboView) - sizeof(FrameView);
+	
 	/*
-	 * Reset game if game is paused
+	 * Map buffer to host memory space
+	 * and return address of buffer in host address space
+	 *
+	 * Note that glMapBufferARB() causes sync issue.
+	 * If GPU is working with this buffer, glMapBufferARB() will wait(stall)
+	 * for GPU to finish its job. To avoid waiting (stall), you can call
+	 * first glBufferDataARB() with NULL pointer before glMapBufferARB().
+	 * If you do that, the previous data in PBO will be discarded and
+	 * glMapBufferARB() returns a new allocated pointer immediately
+	 * even if GPU is still working with the previous data.
 	 */
-		glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB, 4*GameOfLife.getWidth()*GameOfLife.getHeight(), 0, GL_STREAM_DRAW_ARB);
-		GLubyte* bufferImage = (GLubyte *)glMapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, GL_WRITE_ONLY_ARB);
-		
-		if (bufferImage) {
-		  	/* Write image of next generation directly on the mapped buffer */
-			int state = GameOfLife.resetGame(bufferImage);
-			
-			/* Release the mapped buffer */
-			glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB);
-			
-			if (state != 0) exit(-1);
-		}
-		
+	glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB, texelBytes, 0, GL_STREAM_DRAW_ARB);
+	GLubyte* bufferImage =
+		(GLubyte *)glMapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, GL_WRITE_ONLY_ARB);
+	
+	if (bufferImage) {
+		memcpy(bufferImage, frame + sizeof(FrameView), texelBytes);
 		
-		resetGame = false;
-		showControls();
+		/* Release the mapped buffer */
+		glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB);
+		pboFresh = true;
 	}
 }
 
+/* Draw the texels of the texture at their place on the board */
+void drawFrame() {
+	if (textureView.size[0] == 0 || textureView.size[1] == 0) return;
+	
+	const int cellsX = texelCells(textureView, 0);
+	const int cellsY = texelCells(textureView, 1);
+	const float width = (float)GameOfLife.getWidth();
+	const float height = (float)GameOfLife.getHeight();
+	
+	/* Cells covered by the frame, texels at the border may be cut off */
+	float x0 = textureView.origin[0] * cellsX;
+	float y0 = textureView.origin[1] * cellsY;
+	float x1 = min((float)(textureView.origin[0] + textureView.size[0]) * cellsX, width);
+	float y1 = min((float)(textureView.origin[1] + textureView.size[1]) * cellsY, height);
+	float s1 = (x1 - x0) / cellsX / maxFrameSize[0];
+	float t1 = (y1 - y0) / cellsY / maxFrameSize[1];
+	
+	glUseProgram(glShader);
+	glUniform1i(glGetUniformLocation(glShader, "packedBits"), textureView.format == FRAME_BITS);
+	glUniform2f(glGetUniformLocation(glShader, "cellsPerTexel"), (float)cellsX, (float)cellsY);
+	glUniform1i(glGetUniformLocation(glShader, "drawGrid"), drawGrid);
+	glColor3f(1.0f, 1.0f, 1.0f);
+	glBegin(GL_QUADS);
+		glTexCoord2f(0.0f, 0.0f); glVertex2f(-1.0f + 2.0f*x0/width, 1.0f - 2.0f*y0/height);
+		glTexCoord2f(s1, 0.0f);   glVertex2f(-1.0f + 2.0f*x1/width, 1.0f - 2.0f*y0/height);
+		glTexCoord2f(s1, t1);     glVertex2f(-1.0f + 2.0f*x1/width, 1.0f - 2.0f*y1/height);
+		glTexCoord2f(0.0f, t1);   glVertex2f(-1.0f + 2.0f*x0/width, 1.0f - 2.0f*y1/height);
+	glEnd();
+	glUseProgram(0);
+}
+
 /* Display function */
 void display() {
+	/* Simulation failed */
+	if (quit) exit(-1);
+	ScopedTimer timer(displayTime);
+	
 	/* Bind the texture and PBO */
 	glBindTexture(GL_TEXTURE_2D, glTex);
 	glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, glPBO);
 	
-	/* Copy pixels from PBO to texture object */
-	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
-					GameOfLife.getWidth(), GameOfLife.getHeight(),
-					GL_RGBA, GL_UNSIGNED_BYTE, BUFFER_DATA(0));
+	/* Copy texels of the frame from PBO to texture object */
+	if (pboFresh) {
+		ScopedTimer timer(textureTime);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
+						pboView.size[0], pboView.size[1],
+						GL_RED, GL_UNSIGNED_BYTE, BUFFER_DATA(0));
+		textureView = pboView;
+		pboFresh = false;
+	}
 	
 	/*
-	 * Execute functions which change the board
+	 * Request the frame for the current zoom and move
+	 * and upload the newest frame of the simulation thread,
+	 * it is shown with the next redraw
 	 */
-	displayFunctions();
+	updateView();
+	uploadFrame();
 	
 	/*
 	 * Release PBOs with ID 0 after use
@@ -366,54 +714,30 @@ void display() {
 	glTranslatef(verticalMove,horizontalMove,0.0f);	// move
 	
 	
-	/* Draw textured geometry */
-	glColor3f(1.0f, 1.0f, 1.0f);
-	glBegin(GL_QUADS);
-		glTexCoord2f(0.0f, 0.0f); glVertex2f(-1.0f, 1.0f);
-		glTexCoord2f(1.0f, 0.0f); glVertex2f(1.0f, 1.0f);
-		glTexCoord2f(1.0f, 1.0f); glVertex2f(1.0f, -1.0f);
-		glTexCoord2f(0.0f, 1.0f); glVertex2f(-1.0f, -1.0f);
-	glEnd();
+	/* Draw textured geometry, the shader expands the frame to colour */
+	drawFrame();
 	
 	/* Unbind texture */
 	glBindTexture(GL_TEXTURE_2D, 0);
-
-	
-	/* Draw grid */
-	if (drawGrid) {
-		glColor3f(0.0f, 0.2f, 1.0f);
-		glEnable(GL_MAP2_VERTEX_3);
-		glMap2f(GL_MAP2_VERTEX_3,
-			0.0, 1.0,	/* U ranges 0..1 */
-			3,			/* U stride, 3 floats per coord */
-			2,			/* U is 2nd order, ie. linear */
-			0.0, 1.0,	/* V ranges 0..1 */
-			2 * 3,		/* V stride, row is 2 coords, 3 floats per coord */
-			2,			/* V is 2nd order, ie linear */
-			&gridControlPoints[0][0][0]);	/* control points */
-			
-		glMapGrid2f(GameOfLife.getWidth(), 0.0, 1.0, GameOfLife.getHeight(), 0.0, 1.0);
-		
-		glEvalMesh2(GL_LINE,
-			0, GameOfLife.getWidth(),	/* Starting at 0 mesh width steps. */
-			0, GameOfLife.getHeight());	/* Starting at 0 mesh height steps. */
-		glDisable(GL_MAP2_VERTEX_3);
-	}
 	
 	glPopMatrix();
 	
 	glutSwapBuffers();
 	glutReportErrors();
 
-	/* Append execution information to window title */
-	snprintf(title, 57*sizeof(char)+sizeof(float)+sizeof(int)+sizeof(long),
-			 		"Game of Life @ %s @ %f ms/gen @ %i gens/copy @ generation %lu",
-					GameOfLife.isCPUMode() ? "CPU" : "OpenCL",
-					GameOfLife.getExecutionTime(),
-					GameOfLife.getGenerationsPerCopyEvent(),
-					GameOfLife.getGenerations()
-					);
-	glutSetWindowTitle(title);
+	/* Append execution information to window title, never wait for the simulation */
+	std::unique_lock<std::mutex> lock(gameMutex, std::try_to_lock);
+	if (lock.owns_lock()) {
+		snprintf(title, 57*sizeof(char)+sizeof(float)+sizeof(int)+sizeof(long),
+						"Game of Life @ %s @ %f ms/gen @ %i gens/copy @ generation %lu",
+						GameOfLife.isCPUMode() ? "CPU" : "OpenCL",
+						GameOfLife.getExecutionTime(),
+						GameOfLife.getGenerationsPerCopyEvent(),
+						GameOfLife.getGenerations()
+						);
+		lock.unlock();
+		glutSetWindowTitle(title);
+	}
 }
 
 /* Idle function */
@@ -421,6 +745,11 @@ void idle(void) { glutPostRedisplay(); }
 
 /* Keyboard function */
 void keyboard(unsigned char key, int mouseX, int mouseY) {
+	/* Pressing escape or q exits, without holding the lock for freeMem() */
+	if (key == 27 || key == 'q' || key == 'Q')
+		exit(0);
+	
+	std::lock_guard<std::mutex> lock(gameMutex);
 	switch(key) {
 		/* Pressing space starts/stops calculation of next generation */
 		case ' ': GameOfLife.switchPause(); break;
@@ -434,7 +763,6 @@ void keyboard(unsigned char key, int mouseX, int mouseY) {
 		case 'r': resetGame = !resetGame; break;
 		/* Pressing s switches single generation mode on/off */
 		case 's': GameOfLife.switchSingleGeneration(); break;
-		/* Pressing escape or q exits */
 		/* Pressing p switches waiting time between calculations on/off */
 		case '+':
 			sleeperBarrier += 100.0f;
@@ -442,10 +770,6 @@ void keyboard(unsigned char key, int mouseX, int mouseY) {
 		case '-':
 			sleeperBarrier = max(0.0f, sleeperBarrier-100.0f);
 			break;
-		case 27:
-		case 'q':
-		case 'Q':
-			exit(0);
 		default: break;
 	}
 	showControls();
@@ -568,6 +892,40 @@ void initOpenGL(void) {
 	glDepthFunc(GL_LEQUAL);				// type of depth test
 }
 
+/* Compile and link the fragment shader for the board */
+int initShader() {
+	GLint status;
+	GLuint shader = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(shader, 1, &boardShaderSource, NULL);
+	glCompileShader(shader);
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+	if (status != GL_TRUE) {
+		char log[1024];
+		glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+		cerr << "Could not compile board shader:\n" << log << endl;
+		return -1;
+	}
+	
+	glShader = glCreateProgram();
+	glAttachShader(glShader, shader);
+	glLinkProgram(glShader);
+	glDeleteShader(shader);
+	glGetProgramiv(glShader, GL_LINK_STATUS, &status);
+	if (status != GL_TRUE) {
+		cerr << "Could not link board shader" << endl;
+		return -1;
+	}
+	
+	/* Frame layout is fixed for the whole game */
+	glUseProgram(glShader);
+	glUniform1i(glGetUniformLocation(glShader, "board"), 0);
+	glUniform2f(glGetUniformLocation(glShader, "textureSize"),
+				(float)maxFrameSize[0], (float)maxFrameSize[1]);
+	glUseProgram(0);
+	
+	return 0;
+}
+
 /* Initialise OpenGL Pixel Buffer Objects */
 void initOpenGLBuffers() {
 	
@@ -581,6 +939,15 @@ void initOpenGLBuffers() {
 		glPBO = 0;
 	}
 
+	/*
+	 * The texture only holds the visible part of one level of the
+	 * density pyramid, which has at most 2 texels per pixel in each direction
+	 */
+	GLint maxTextureSize;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+	maxFrameSize[0] = min((int)maxTextureSize, 2*glutGet(GLUT_SCREEN_WIDTH) + 16);
+	maxFrameSize[1] = min((int)maxTextureSize, 2*glutGet(GLUT_SCREEN_HEIGHT) + 16);
+	
     /* Create new texture */
 	glEnable(GL_TEXTURE_2D);
 	glGenTextures(1, &glTex);
@@ -589,18 +956,19 @@ void initOpenGLBuffers() {
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, GameOfLife.getWidth(), GameOfLife.getHeight(),
-					0, GL_RGBA, GL_UNSIGNED_BYTE, GameOfLife.getImage());
+	/* Rows of packed frames are not aligned */
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, maxFrameSize[0], maxFrameSize[1],
+					0, GL_RED, GL_UNSIGNED_BYTE, NULL);
 	glBindTexture(GL_TEXTURE_2D, 0);
 	
 	/* Generate new pixel buffer object */
 	glGenBuffers(1, &glPBO);
 	/* Bind the buffer object */
 	glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, glPBO);
-	/* Copy pixel data to the buffer object */
+	/* Buffer object is filled with the first frame of the simulation */
 	glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB,
-				 GameOfLife.getWidth() * GameOfLife.getHeight() * 4,
-				 GameOfLife.getImage(), GL_STREAM_DRAW_ARB);
+				 maxFrameSize[0] * maxFrameSize[1], NULL, GL_STREAM_DRAW_ARB);
 }
 
 /* Initalise display */
@@ -613,6 +981,7 @@ void initDisplay(int argc, char *argv[]) {
 	initGLUT(argc, argv);
 	initOpenGL();
 	initOpenGLBuffers();
+	if (initShader() != 0) exit(-1);
 }
 
 /********************************************
@@ -627,6 +996,44 @@ void mainLoopGL(void) {
 	glutMainLoop();
 }
 
+/* Export frames without OpenGL output */
+int exportFrames() {
+	if (GameOfLife.setup() != 0) return -1;
+	
+	FrameExport exporter;
+	if (exporter.setup(exportPath, exportLevel, exportCrop,
+					   GameOfLife.getWidth(), GameOfLife.getHeight()) != 0)
+		return -1;
+	
+	/* Every frame is exactly k generations after the last one */
+	const FrameView &view = exporter.getView();
+	GameOfLife.setFrameView(view);
+	GameOfLife.setGenerationsPerFrame(exportEvery);
+	unsigned char *frame = (unsigned char *)malloc(frameSizeBytes(view));
+	if (frame == NULL) return -1;
+	
+	/* Export runs without pausing, so stats report it as running */
+	if (GameOfLife.isPaused()) GameOfLife.switchPause();
+	
+	/* Starting population is the first frame */
+	int status = GameOfLife.getFrame(frame);
+	publishStats();
+	if (status == 0) status = exporter.push(frame, 0);
+	while (status == 0 && GameOfLife.getGenerations() < exportGenerations) {
+		status = GameOfLife.nextGeneration(frame);
+		publishStats();
+		if (status == 0) status = exporter.push(frame, GameOfLife.getGenerations());
+	}
+	free(frame);
+	
+	/* Wait for writer thread */
+	if (exporter.finish() != 0) status = -1;
+	fprintf(stderr, "Exported %lu frames of %ix%i pixels, waited %lu times for the writer\n",
+			exporter.getWrittenFrames(), view.size[0], view.size[1], exporter.getWaits());
+	
+	return status;
+}
+
 int main(int argc, char **argv) {
 	/* Register exit function */
 	atexit(freeMem);
@@ -637,6 +1044,38 @@ int main(int argc, char **argv) {
 		return -1;
 	}
 	
+	/* Compare engines without OpenGL output */
+	if (verifyMode) return verifier.run(verifyPath);
+	
+	/* Search soups without OpenGL output */
+	if (soups > 0) {
+		if (GameOfLife.isMultiState()) {
+			fprintf(stderr,"\nSoup search does not support multi-state rules\n");
+			return -1;
+		}
+		if (soupSeed == 0) soupSeed = time(NULL);
+		printf("Soup search: rule %s | seed %lu\n", GameOfLife.getRule().c_str(), soupSeed);
+		
+		SoupSearch soupSearch;
+		soupSearch.setRule(GameOfLife.getBirthRule(), GameOfLife.getSurvivalRule(),
+						   GameOfLife.getNeighbourhood());
+		if (soupSearch.setup(min(soups, (unsigned long)SOUP_BATCH), soupSeed) != 0)
+			return -1;
+		return soupSearch.run(soups);
+	}
+	
+	/* Find the device and build the program while the population is set up */
+	GameOfLife.startDevice();
+	
+	/* Answer stats requests of long running simulations */
+	if (statsPath != NULL) {
+		if (statsServer.start(statsPath) != 0) return -1;
+		GameOfLife.setCountLiveCells(true);
+	}
+	
+	/* Export frames without OpenGL output */
+	if (exportPath != NULL) return exportFrames();
+	
 	/* Setup host/device memory, starting population and OpenCL */
 	if(GameOfLife.setup()!=0) return -1;
 
@@ -654,13 +1093,30 @@ int main(int argc, char **argv) {
 	/* Show controls for Game of Life in console */
 	showControls();
 	
+	/*
+	 * Level 0 of frames is packed to 1 bit per cell,
+	 * multi-state rules need 1 byte for the color of refractory cells
+	 */
+	frameFormat = GameOfLife.isMultiState() ? FRAME_R8 : FRAME_BITS;
+	
 	/* Setup OpenGL */
 	initDisplay(argc, argv);
 	
+	/* Frames are produced for the view requested by the first redraw */
+	size_t frameSize = sizeof(FrameView) + (size_t)maxFrameSize[0] * maxFrameSize[1];
+	unsigned char *frame = (unsigned char *)calloc(frameSize, 1);
+	if (frame == NULL) return -1;
+	int status = frames.setup(frameSize, frame);
+	free(frame);
+	if (status != 0) return -1;
+	
 	/* Start timer */
 	resetTime();
 	
-	/* Display GameOfLife image/board and calculate next generations */
+	/* Calculate next generations on the simulation thread */
+	simulationThread = std::thread(simulate);
+	
+	/* Display GameOfLife image/board */
 	mainLoopGL();
 #endif
 	